@@ -0,0 +1,947 @@
+// cima_bench - hardware-counter benchmark runner for pipeline binaries
+//
+// Runs every <test>_<variant>_final executable in a directory, interleaving
+// the variants of each test in a fresh random order every round, and counts
+// each run with perf_event_open: cycles, instructions, branch misses, L1D and
+// LLC read misses, task clock and wall time, all at nanosecond resolution.
+// Results are printed as a table (mean, 95% confidence interval, overhead
+// relative to the test's "none" variant) and optionally written as JSON.
+//
+// Memory is reported next to the timings: the peak RSS of every measured run,
+// and from one extra untimed run per binary (--memory-runs) the resident ASan
+// shadow, stack and total memory, sampled from /proc/<pid>/smaps while the
+// process is stopped at exit under ptrace. Per-function stack frame sizes are
+// read from the .stack_sizes section the pipeline links into each binary.
+//
+// With --forkserver, binaries linked with cima_forkserver.o are started once
+// and every measured run is forked from the process parked before main (or,
+// with --entry, is one in-process call of cima_bench_entry()), so ASan
+// startup is no longer part of each measurement.
+//
+// Usage: cima_bench <directory> [options]
+
+#include <sched.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.h"
+
+namespace {
+
+constexpr size_t kNumCounters = PERF_NUM_COUNTERS;
+
+// Metrics after wall time and the counters: peak RSS of every measured run,
+// then the exit-time samples of the memory runs
+const char* const kMemoryMetrics[] = {"peak_rss_kb", "exit_rss_kb", "shadow_rss_kb", "stack_rss_kb"};
+constexpr size_t kPeakRss = 1 + kNumCounters;
+constexpr size_t kExitRss = kPeakRss + 1;
+constexpr size_t kNumMemoryMetrics = sizeof(kMemoryMetrics) / sizeof(kMemoryMetrics[0]);
+constexpr size_t kNumMetrics = kPeakRss + kNumMemoryMetrics;
+
+// Application shadow of ASan's x86-64 layout (offset 0x7fff8000, as in
+// cima_runtime.cpp): low shadow through high shadow, gap included
+constexpr uint64_t kAsanShadowBegin = 0x00007fff8000ULL;
+constexpr uint64_t kAsanShadowEnd = 0x10007fff8000ULL;
+
+// Variants the pipeline appends to binary names, in report order
+const char* const kVariants[] = {"none", "asan", "base", "nearest", "tainted", "native", "mixed",
+                                 "bounds"};
+
+// How each measured run is started
+enum class Mode {
+    Exec,        // fork + exec the binary
+    ForkServer,  // fork from the binary's fork server, parked before main
+    Entry,       // call cima_bench_entry() inside the fork server
+};
+
+struct Options {
+    std::string directory;
+    Mode mode = Mode::Exec;
+    int runs = 30;
+    int warmups = 3;
+    int cpu = -1;  // -1: last CPU in the affinity mask
+    bool pin = true;
+    unsigned seed = 0;
+    bool seed_set = false;
+    int memory_runs = 1;
+    std::string json_path;
+};
+
+struct Binary {
+    std::string path;
+    std::string test;
+    std::string variant;
+    // samples[0] is wall time; samples[1 + i] is perf_counters[i]; then
+    // kMemoryMetrics from kPeakRss on
+    std::vector<std::vector<double>> samples;
+    // (function, bytes) from .stack_sizes, largest first
+    std::vector<std::pair<std::string, uint64_t>> stack_frames;
+    int failed_runs = 0;
+    // Exit code of the latest run, or -1 before one exits normally
+    int exit_code = -1;
+    // Fork server connection (Mode::ForkServer / Mode::Entry)
+    pid_t server = -1;
+    int cmd_fd = -1;
+    int result_fd = -1;
+};
+
+struct Summary {
+    size_t n = 0;
+    double mean = 0, stdev = 0, median = 0, min = 0, ci95 = 0;
+};
+
+int pick_cpu(int requested) {
+    if (requested >= 0) return requested;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+        if (CPU_ISSET(cpu, &set)) return cpu;
+    }
+    return -1;
+}
+
+bool pin_to_cpu(int cpu) {
+    if (cpu < 0) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Run one binary once. On success fills wall_ns, counters and peak RSS;
+// returns the raw wait status, or -1 if the run could not be started.
+int run_once(const Binary& bin, const Options& opts, int cpu, const bool* wanted, double* values) {
+    int go[2];
+    if (pipe2(go, O_CLOEXEC) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(go[0]);
+        close(go[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // Child: wait until the parent has attached the counters, then exec
+        close(go[1]);
+        if (opts.pin) pin_to_cpu(cpu);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        char byte;
+        if (read(go[0], &byte, 1) != 1) _exit(127);
+        char* const argv[] = {const_cast<char*>(bin.path.c_str()), nullptr};
+        execv(bin.path.c_str(), argv);
+        _exit(127);
+    }
+
+    close(go[0]);
+    int fds[kNumCounters];
+    perf_counters_open(pid, wanted, true, fds);
+
+    uint64_t start = perf_now_ns();
+    char byte = 1;
+    ssize_t written = write(go[1], &byte, 1);
+    close(go[1]);
+
+    int status = 0;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {
+    }
+    uint64_t end = perf_now_ns();
+
+    values[0] = written == 1 ? (double)(end - start) : NAN;
+    perf_counters_read(fds, values + 1);
+    values[kPeakRss] = (double)usage.ru_maxrss;
+    perf_counters_close(fds);
+    return written == 1 ? status : -1;
+}
+
+bool read_all(int fd, void* buf, size_t len) {
+    char* p = static_cast<char*>(buf);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Start bin once with its fork server enabled and wait until it is parked
+// before main. Fails for binaries not linked with cima_forkserver.o.
+bool start_server(Binary& bin, const Options& opts, int cpu) {
+    int cmd[2], result[2];
+    if (pipe2(cmd, O_CLOEXEC) != 0) return false;
+    if (pipe2(result, O_CLOEXEC) != 0) {
+        close(cmd[0]);
+        close(cmd[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (opts.pin) pin_to_cpu(cpu);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        // dup2 clears close-on-exec, so only these two survive the exec
+        dup2(cmd[0], FORKSERVER_CMD_FD);
+        dup2(result[1], FORKSERVER_RESULT_FD);
+        setenv("CIMA_FORKSERVER", "1", 1);
+        char* const argv[] = {const_cast<char*>(bin.path.c_str()), nullptr};
+        execv(bin.path.c_str(), argv);
+        _exit(127);
+    }
+
+    close(cmd[0]);
+    close(result[1]);
+    uint32_t hello = 0;
+    if (pid < 0 || !read_all(result[0], &hello, sizeof(hello)) || hello != FORKSERVER_HELLO) {
+        close(cmd[1]);
+        close(result[0]);
+        if (pid > 0) waitpid(pid, nullptr, 0);
+        return false;
+    }
+
+    bin.server = pid;
+    bin.cmd_fd = cmd[1];
+    bin.result_fd = result[0];
+    return true;
+}
+
+void stop_server(Binary& bin) {
+    if (bin.server < 0) return;
+    close(bin.cmd_fd);  // the server exits when its command pipe closes
+    close(bin.result_fd);
+    waitpid(bin.server, nullptr, 0);
+    bin.server = -1;
+}
+
+// One measured run through the fork server; same contract as run_once
+int run_server_once(Binary& bin, Mode mode, double* values) {
+    char cmd = mode == Mode::Entry ? FORKSERVER_ENTRY : FORKSERVER_RUN;
+    forkserver_result result;
+    if (write(bin.cmd_fd, &cmd, 1) != 1 || !read_all(bin.result_fd, &result, sizeof(result))) {
+        stop_server(bin);
+        return -1;
+    }
+
+    values[0] = (double)result.wall_ns;
+    for (size_t i = 0; i < kNumCounters; i++) values[1 + i] = result.counters[i];
+    values[kPeakRss] = result.peak_rss_kb;
+    if (result.status == -1) return -1;
+    // ENTRY reports cima_bench_entry()'s return value; encode it as an exit
+    return mode == Mode::Entry ? (result.status & 0xff) << 8 : result.status;
+}
+
+// Resident memory of pid by region: fills exit_rss_kb, shadow_rss_kb and
+// stack_rss_kb (values[0..2]) from /proc/<pid>/smaps
+bool read_smaps(pid_t pid, double* values) {
+    std::string path = "/proc/" + std::to_string(pid) + "/smaps";
+    FILE* in = fopen(path.c_str(), "r");
+    if (!in) return false;
+
+    double total = 0, shadow = 0, stack = 0;
+    bool in_shadow = false, in_stack = false;
+    char line[512];
+    while (fgets(line, sizeof(line), in)) {
+        unsigned long begin, end;
+        char perms[8];
+        int name_at = 0;
+        // A mapping header: "begin-end perms offset dev inode [name]"
+        if (sscanf(line, "%lx-%lx %7s %*s %*s %*s %n", &begin, &end, perms, &name_at) == 3) {
+            in_shadow = begin >= kAsanShadowBegin && end <= kAsanShadowEnd;
+            in_stack = strncmp(line + name_at, "[stack]", 7) == 0;
+            continue;
+        }
+        unsigned long kb;
+        if (sscanf(line, "Rss: %lu kB", &kb) == 1) {
+            total += kb;
+            if (in_shadow) shadow += kb;
+            if (in_stack) stack += kb;
+        }
+    }
+    fclose(in);
+
+    values[0] = total;
+    values[1] = shadow;
+    values[2] = stack;
+    return true;
+}
+
+// Run bin once, untimed, under ptrace and sample its memory while it is
+// stopped at exit, when the shadow and stack it touched are still mapped.
+// Fills the exit-time memory metrics (from kExitRss on); false if the run
+// could not be traced to its exit.
+bool memory_run(const Binary& bin, const Options& opts, int cpu, double* values) {
+    pid_t pid = fork();
+    if (pid < 0) return false;
+
+    if (pid == 0) {
+        if (opts.pin) pin_to_cpu(cpu);
+        int devnull = open("/dev/null", O_RDWR);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0) _exit(127);
+        char* const argv[] = {const_cast<char*>(bin.path.c_str()), nullptr};
+        execv(bin.path.c_str(), argv);
+        _exit(127);
+    }
+
+    // The child stops with SIGTRAP once exec has succeeded
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) return false;
+    ptrace(PTRACE_SETOPTIONS, pid, nullptr, (void*)(long)(PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+
+    bool sampled = false;
+    for (;;) {
+        if (waitpid(pid, &status, 0) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) break;
+        int signal = 0;
+        if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8))) {
+            sampled = read_smaps(pid, values + kExitRss);
+        } else if (WSTOPSIG(status) != SIGTRAP) {
+            // Pass on the program's own signals; a plain SIGTRAP is a traced
+            // exec, e.g. ASan re-executing itself with a compatible layout
+            signal = WSTOPSIG(status);
+        }
+        ptrace(PTRACE_CONT, pid, nullptr, (void*)(long)signal);
+    }
+    return sampled && !(WIFEXITED(status) && WEXITSTATUS(status) == 127);
+}
+
+// (function, frame bytes) from the .stack_sizes section of an ELF64
+// executable: ULEB128 sizes keyed by function address, named through
+// .symtab. Empty for binaries linked without -fstack-size-section.
+std::vector<std::pair<std::string, uint64_t>> read_stack_frames(const std::string& path) {
+    std::vector<std::pair<std::string, uint64_t>> frames;
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return frames;
+    std::vector<unsigned char> image;
+    unsigned char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) image.insert(image.end(), buf, buf + n);
+    fclose(in);
+
+    if (image.size() < sizeof(Elf64_Ehdr) || memcmp(image.data(), ELFMAG, SELFMAG) != 0 ||
+        image[EI_CLASS] != ELFCLASS64) {
+        return frames;
+    }
+    const Elf64_Ehdr* eh = reinterpret_cast<const Elf64_Ehdr*>(image.data());
+    if (eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > image.size() || eh->e_shstrndx >= eh->e_shnum) {
+        return frames;
+    }
+    const Elf64_Shdr* sh = reinterpret_cast<const Elf64_Shdr*>(image.data() + eh->e_shoff);
+    auto in_image = [&](const Elf64_Shdr& s) { return s.sh_offset + s.sh_size <= image.size(); };
+    if (!in_image(sh[eh->e_shstrndx])) return frames;
+    const char* shstr = reinterpret_cast<const char*>(image.data() + sh[eh->e_shstrndx].sh_offset);
+
+    const Elf64_Shdr* sizes = nullptr;
+    const Elf64_Shdr* symtab = nullptr;
+    for (unsigned i = 0; i < eh->e_shnum; i++) {
+        if (!in_image(sh[i]) || sh[i].sh_name >= sh[eh->e_shstrndx].sh_size) continue;
+        if (strcmp(shstr + sh[i].sh_name, ".stack_sizes") == 0) sizes = &sh[i];
+        if (sh[i].sh_type == SHT_SYMTAB && sh[i].sh_link < eh->e_shnum) symtab = &sh[i];
+    }
+    if (!sizes || !symtab || !in_image(sh[symtab->sh_link])) return frames;
+
+    std::vector<std::pair<uint64_t, std::string>> functions;
+    const Elf64_Shdr& strtab = sh[symtab->sh_link];
+    const Elf64_Sym* syms = reinterpret_cast<const Elf64_Sym*>(image.data() + symtab->sh_offset);
+    for (size_t i = 0; i < symtab->sh_size / sizeof(Elf64_Sym); i++) {
+        if (ELF64_ST_TYPE(syms[i].st_info) != STT_FUNC || syms[i].st_name >= strtab.sh_size) continue;
+        functions.emplace_back(syms[i].st_value,
+                               reinterpret_cast<const char*>(image.data() + strtab.sh_offset + syms[i].st_name));
+    }
+    std::sort(functions.begin(), functions.end());
+
+    const unsigned char* p = image.data() + sizes->sh_offset;
+    const unsigned char* end = p + sizes->sh_size;
+    while (p + sizeof(uint64_t) < end) {
+        uint64_t address;
+        memcpy(&address, p, sizeof(address));
+        p += sizeof(address);
+        uint64_t bytes = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+            unsigned char byte = *p++;
+            bytes |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        auto fn = std::lower_bound(functions.begin(), functions.end(), std::make_pair(address, std::string()));
+        if (fn != functions.end() && fn->first == address) frames.emplace_back(fn->second, bytes);
+    }
+
+    std::sort(frames.begin(), frames.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return frames;
+}
+
+// Two-sided 95% Student t critical values for 1..30 degrees of freedom
+double t_critical(size_t df) {
+    static const double kTable[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                    2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                    2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                    2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0) return NAN;
+    if (df <= 30) return kTable[df - 1];
+    return 1.96;
+}
+
+Summary summarize(const std::vector<double>& raw) {
+    std::vector<double> xs;
+    for (double x : raw) {
+        if (!std::isnan(x)) xs.push_back(x);
+    }
+
+    Summary s;
+    s.n = xs.size();
+    if (s.n == 0) {
+        s.mean = s.stdev = s.median = s.min = s.ci95 = NAN;
+        return s;
+    }
+
+    std::sort(xs.begin(), xs.end());
+    double sum = 0;
+    for (double x : xs) sum += x;
+    s.mean = sum / s.n;
+    s.min = xs.front();
+    s.median = s.n % 2 ? xs[s.n / 2] : (xs[s.n / 2 - 1] + xs[s.n / 2]) / 2;
+
+    double sq = 0;
+    for (double x : xs) sq += (x - s.mean) * (x - s.mean);
+    s.stdev = s.n > 1 ? std::sqrt(sq / (s.n - 1)) : 0;
+    s.ci95 = s.n > 1 ? t_critical(s.n - 1) * s.stdev / std::sqrt((double)s.n) : NAN;
+    return s;
+}
+
+// Overhead of v over baseline in percent, with a 95% interval from the
+// delta method on the ratio of the two means
+void overhead(const Summary& v, const Summary& baseline, double* pct, double* ci) {
+    *pct = *ci = NAN;
+    if (v.n == 0 || baseline.n == 0 || baseline.mean == 0) return;
+    double ratio = v.mean / baseline.mean;
+    *pct = (ratio - 1) * 100;
+    if (v.n < 2 || baseline.n < 2 || v.mean == 0) return;
+    double rel_v = (v.ci95 / v.mean);
+    double rel_b = (baseline.ci95 / baseline.mean);
+    *ci = ratio * std::sqrt(rel_v * rel_v + rel_b * rel_b) * 100;
+}
+
+// Split "<test>_<variant>_final" into its parts. Binaries from a single
+// variant pipeline run ("<test>_final") get variant "default".
+bool parse_name(const std::string& name, std::string* test, std::string* variant) {
+    static const std::string kSuffix = "_final";
+    if (name.size() <= kSuffix.size() || name.compare(name.size() - kSuffix.size(), kSuffix.size(), kSuffix) != 0) {
+        return false;
+    }
+    if (name.find("_validation_") != std::string::npos) return false;
+
+    std::string stem = name.substr(0, name.size() - kSuffix.size());
+    size_t sep = stem.rfind('_');
+    if (sep != std::string::npos) {
+        std::string last = stem.substr(sep + 1);
+        for (const char* v : kVariants) {
+            if (last == v) {
+                *test = stem.substr(0, sep);
+                *variant = last;
+                return true;
+            }
+        }
+    }
+    *test = stem;
+    *variant = "default";
+    return true;
+}
+
+int variant_rank(const std::string& variant) {
+    for (size_t i = 0; i < sizeof(kVariants) / sizeof(kVariants[0]); i++) {
+        if (variant == kVariants[i]) return (int)i;
+    }
+    return (int)(sizeof(kVariants) / sizeof(kVariants[0]));
+}
+
+std::vector<Binary> find_binaries(const std::string& directory) {
+    std::vector<Binary> bins;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        fprintf(stderr, "Error: Directory '%s' not found.\n", directory.c_str());
+        exit(1);
+    }
+
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        std::string path = directory + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || access(path.c_str(), X_OK) != 0) {
+            continue;
+        }
+
+        Binary bin;
+        if (!parse_name(name, &bin.test, &bin.variant)) continue;
+        bin.path = path;
+        bin.samples.resize(kNumMetrics);
+        bin.stack_frames = read_stack_frames(path);
+        bins.push_back(bin);
+    }
+    closedir(dir);
+
+    std::sort(bins.begin(), bins.end(), [](const Binary& a, const Binary& b) {
+        if (a.test != b.test) return a.test < b.test;
+        return variant_rank(a.variant) < variant_rank(b.variant) ||
+               (variant_rank(a.variant) == variant_rank(b.variant) && a.variant < b.variant);
+    });
+    return bins;
+}
+
+void json_number(FILE* out, double x) {
+    if (std::isnan(x)) {
+        fputs("null", out);
+    } else {
+        fprintf(out, "%.6g", x);
+    }
+}
+
+void json_summary(FILE* out, const Summary& s) {
+    fprintf(out, "{\"n\": %zu, \"mean\": ", s.n);
+    json_number(out, s.mean);
+    fputs(", \"ci95\": ", out);
+    json_number(out, s.ci95);
+    fputs(", \"median\": ", out);
+    json_number(out, s.median);
+    fputs(", \"min\": ", out);
+    json_number(out, s.min);
+    fputs(", \"stdev\": ", out);
+    json_number(out, s.stdev);
+    fputs("}", out);
+}
+
+const Binary* find_baseline(const std::vector<Binary>& bins, const std::string& test) {
+    for (const Binary& b : bins) {
+        if (b.test == test && b.variant == "none") return &b;
+    }
+    return nullptr;
+}
+
+// A run counts when it exited on its own with the status the test's none
+// build exits with; a nonzero status is taken as is until none has exited
+bool run_completed(const std::vector<Binary>& bins, const Binary& bin, int status) {
+    if (WIFSIGNALED(status)) return false;
+    if (WEXITSTATUS(status) == 0) return true;
+    const Binary* none = find_baseline(bins, bin.test);
+    return !none || none->exit_code < 0 || none->exit_code == WEXITSTATUS(status);
+}
+
+const char* metric_name(size_t m) {
+    if (m == 0) return "wall_ns";
+    if (m < kPeakRss) return perf_counters[m - 1].name;
+    return kMemoryMetrics[m - kPeakRss];
+}
+
+const char* mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::Exec:
+            return "exec";
+        case Mode::ForkServer:
+            return "forkserver";
+        case Mode::Entry:
+            return "entry";
+    }
+    return "exec";
+}
+
+void write_json(const std::string& path, const Options& opts, int cpu, const std::vector<Binary>& bins) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+
+    fprintf(out, "{\n  \"directory\": \"%s\",\n  \"runs\": %d,\n  \"warmups\": %d,\n", opts.directory.c_str(),
+            opts.runs, opts.warmups);
+    fprintf(out, "  \"mode\": \"%s\",\n  \"memory_runs\": %d,\n", mode_name(opts.mode), opts.memory_runs);
+    fprintf(out, "  \"cpu\": %d,\n  \"seed\": %u,\n  \"binaries\": [", opts.pin ? cpu : -1, opts.seed);
+
+    for (size_t b = 0; b < bins.size(); b++) {
+        const Binary& bin = bins[b];
+        const Binary* base = find_baseline(bins, bin.test);
+        fprintf(out, "%s\n    {\"test\": \"%s\", \"variant\": \"%s\", \"failed_runs\": %d,\n", b ? "," : "",
+                bin.test.c_str(), bin.variant.c_str(), bin.failed_runs);
+        fprintf(out, "     \"metrics\": {");
+        for (size_t m = 0; m < kNumMetrics; m++) {
+            Summary s = summarize(bin.samples[m]);
+            fprintf(out, "%s\n       \"%s\": ", m ? "," : "", metric_name(m));
+            json_summary(out, s);
+        }
+        fputs("\n     }", out);
+
+        if (!bin.stack_frames.empty()) {
+            fputs(",\n     \"stack_frames\": {", out);
+            for (size_t f = 0; f < bin.stack_frames.size(); f++) {
+                fprintf(out, "%s\"%s\": %llu", f ? ", " : "", bin.stack_frames[f].first.c_str(),
+                        (unsigned long long)bin.stack_frames[f].second);
+            }
+            fputs("}", out);
+        }
+
+        if (base) {
+            fputs(",\n     \"overhead_pct\": {", out);
+            for (size_t m = 0; m < kNumMetrics; m++) {
+                double pct, ci;
+                overhead(summarize(bin.samples[m]), summarize(base->samples[m]), &pct, &ci);
+                fprintf(out, "%s\"%s\": {\"value\": ", m ? ", " : "", metric_name(m));
+                json_number(out, pct);
+                fputs(", \"ci95\": ", out);
+                json_number(out, ci);
+                fputs("}", out);
+            }
+            fputs("}", out);
+        }
+        fputs("}", out);
+    }
+    fputs("\n  ]\n}\n", out);
+    fclose(out);
+}
+
+// "1.23M"-style rendering for counter means
+std::string human(double x) {
+    if (std::isnan(x)) return "n/a";
+    char buf[32];
+    if (x >= 1e9) {
+        snprintf(buf, sizeof(buf), "%.2fG", x / 1e9);
+    } else if (x >= 1e6) {
+        snprintf(buf, sizeof(buf), "%.2fM", x / 1e6);
+    } else if (x >= 1e3) {
+        snprintf(buf, sizeof(buf), "%.2fK", x / 1e3);
+    } else {
+        snprintf(buf, sizeof(buf), "%.0f", x);
+    }
+    return buf;
+}
+
+std::string with_ci(double mean, double ci, const char* mean_fmt, const char* ci_fmt) {
+    if (std::isnan(mean)) return "n/a";
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), mean_fmt, mean);
+    if (!std::isnan(ci) && len > 0 && len < (int)sizeof(buf)) {
+        snprintf(buf + len, sizeof(buf) - len, ci_fmt, ci);
+    }
+    return buf;
+}
+
+// Left-justify to width display columns ("±" is two bytes but one column)
+std::string pad(std::string text, size_t width) {
+    size_t columns = 0;
+    for (unsigned char c : text) {
+        if ((c & 0xC0) != 0x80) columns++;
+    }
+    if (columns < width) text.append(width - columns, ' ');
+    return text;
+}
+
+void print_table(const std::vector<Binary>& bins) {
+    const char* rule =
+        "-------------------------------------------------------------------------------------------------"
+        "-----------------------";
+    printf("%-34s | %-8s | %-18s | %-16s | %-8s | %-8s | %-5s | %-8s | %-8s | %-8s\n", "Test", "Variant",
+           "Wall (ms)", "Overhead (%)", "Cycles", "Instr", "IPC", "BrMiss", "L1DMiss", "LLCMiss");
+    puts(rule);
+
+    std::string current;
+    for (const Binary& bin : bins) {
+        if (!current.empty() && bin.test != current) puts(rule);
+        current = bin.test;
+
+        Summary wall = summarize(bin.samples[0]);
+        Summary cycles = summarize(bin.samples[1]);
+        Summary instrs = summarize(bin.samples[2]);
+        double ipc = cycles.n && instrs.n && cycles.mean > 0 ? instrs.mean / cycles.mean : NAN;
+
+        std::string over = "-";
+        if (const Binary* base = find_baseline(bins, bin.test)) {
+            if (base != &bin) {
+                double pct, ci;
+                overhead(wall, summarize(base->samples[0]), &pct, &ci);
+                over = with_ci(pct, ci, "%+.1f", " ±%.1f");
+            }
+        }
+
+        char ipc_buf[16];
+        if (std::isnan(ipc)) {
+            snprintf(ipc_buf, sizeof(ipc_buf), "n/a");
+        } else {
+            snprintf(ipc_buf, sizeof(ipc_buf), "%.2f", ipc);
+        }
+
+        std::string variant = bin.variant;
+        if (bin.failed_runs) variant += "!";
+        printf("%-34s | %-8s | %s | %s | %-8s | %-8s | %-5s | %-8s | %-8s | %-8s\n", bin.test.c_str(),
+               variant.c_str(), pad(with_ci(wall.mean / 1e6, wall.ci95 / 1e6, "%.3f", " ±%.3f"), 18).c_str(),
+               pad(over, 16).c_str(),
+               human(cycles.mean).c_str(), human(instrs.mean).c_str(), ipc_buf,
+               human(summarize(bin.samples[3]).mean).c_str(), human(summarize(bin.samples[4]).mean).c_str(),
+               human(summarize(bin.samples[5]).mean).c_str());
+    }
+    puts(rule);
+}
+
+// Memory per binary: peak RSS of the measured runs with its overhead over
+// "none", the exit-time shadow and stack residency, and the largest frame
+void print_memory_table(const std::vector<Binary>& bins) {
+    const char* rule =
+        "----------------------------------------------------------------------------------------------------"
+        "----------------------";
+    printf("\n%-34s | %-8s | %-14s | %-12s | %-12s | %-11s | %s\n", "Test", "Variant", "Peak RSS (MiB)",
+           "Overhead (%)", "Shadow (MiB)", "Stack (KiB)", "Largest frame");
+    puts(rule);
+
+    std::string current;
+    for (const Binary& bin : bins) {
+        if (!current.empty() && bin.test != current) puts(rule);
+        current = bin.test;
+
+        Summary peak = summarize(bin.samples[kPeakRss]);
+        std::string over = "-";
+        if (const Binary* base = find_baseline(bins, bin.test)) {
+            if (base != &bin) {
+                double pct, ci;
+                overhead(peak, summarize(base->samples[kPeakRss]), &pct, &ci);
+                over = with_ci(pct, ci, "%+.1f", " ±%.1f");
+            }
+        }
+
+        std::string frame = "n/a";
+        if (!bin.stack_frames.empty()) {
+            frame = bin.stack_frames[0].first + " (" + std::to_string(bin.stack_frames[0].second) + " B)";
+        }
+        Summary shadow = summarize(bin.samples[kExitRss + 1]);
+        Summary stack = summarize(bin.samples[kExitRss + 2]);
+        printf("%-34s | %-8s | %-14s | %s | %-12s | %-11s | %s\n", bin.test.c_str(), bin.variant.c_str(),
+               with_ci(peak.mean / 1024, NAN, "%.2f", "").c_str(), pad(over, 12).c_str(),
+               with_ci(shadow.mean / 1024, NAN, "%.2f", "").c_str(), with_ci(stack.mean, NAN, "%.0f", "").c_str(),
+               frame.c_str());
+    }
+    puts(rule);
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "Usage: %s <directory> [options]\n"
+            "\n"
+            "Benchmarks every <test>_<variant>_final executable in <directory>.\n"
+            "\n"
+            "Options:\n"
+            "  -n, --runs=N      Measured runs per binary (default: 30)\n"
+            "  -w, --warmups=N   Discarded warmup runs per binary (default: 3)\n"
+            "  --cpu=N           Pin benchmarks to CPU N (default: last CPU available)\n"
+            "  --no-pin          Do not pin benchmarks to a CPU\n"
+            "  --seed=N          Seed for the interleaving order (default: time-based)\n"
+            "  --json=FILE       Also write results as JSON to FILE\n"
+            "  --memory-runs=N   Untimed runs per binary sampling shadow and stack\n"
+            "                    residency at exit under ptrace (default: 1, 0: off)\n"
+            "  --forkserver      Fork runs from a server parked before main (binaries\n"
+            "                    linked with cima_forkserver.o; --forkserver pipeline flag)\n"
+            "  --entry           With the fork server, time in-process calls of\n"
+            "                    cima_bench_entry() instead of forked runs of main\n",
+            argv0);
+}
+
+bool parse_int(const char* text, int* out) {
+    char* end;
+    long v = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || v < 0 || v > 1000000) return false;
+    *out = (int)v;
+    return true;
+}
+
+bool parse_args(int argc, char** argv, Options* opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name, const char** out) {
+            std::string prefix = std::string(name) + "=";
+            if (arg.compare(0, prefix.size(), prefix) == 0) {
+                *out = argv[i] + prefix.size();
+                return true;
+            }
+            return false;
+        };
+
+        const char* v = nullptr;
+        if ((arg == "-n" || arg == "-w") && i + 1 < argc) {
+            if (!parse_int(argv[++i], arg == "-n" ? &opts->runs : &opts->warmups)) return false;
+        } else if (value("--runs", &v)) {
+            if (!parse_int(v, &opts->runs)) return false;
+        } else if (value("--warmups", &v)) {
+            if (!parse_int(v, &opts->warmups)) return false;
+        } else if (value("--cpu", &v)) {
+            if (!parse_int(v, &opts->cpu)) return false;
+        } else if (arg == "--forkserver") {
+            if (opts->mode == Mode::Exec) opts->mode = Mode::ForkServer;
+        } else if (arg == "--entry") {
+            opts->mode = Mode::Entry;
+        } else if (arg == "--no-pin") {
+            opts->pin = false;
+        } else if (value("--seed", &v)) {
+            int seed;
+            if (!parse_int(v, &seed)) return false;
+            opts->seed = (unsigned)seed;
+            opts->seed_set = true;
+        } else if (value("--memory-runs", &v)) {
+            if (!parse_int(v, &opts->memory_runs)) return false;
+        } else if (value("--json", &v)) {
+            opts->json_path = v;
+        } else if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg[0] != '-' && opts->directory.empty()) {
+            opts->directory = arg;
+        } else {
+            fprintf(stderr, "Error: Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return !opts->directory.empty() && opts->runs > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_args(argc, argv, &opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!opts.seed_set) opts.seed = (unsigned)perf_now_ns();
+
+    std::vector<Binary> bins = find_binaries(opts.directory);
+    if (bins.empty()) {
+        printf("No <test>_<variant>_final executables found in %s\n", opts.directory.c_str());
+        return 0;
+    }
+
+    bool available[kNumCounters];
+    perf_counters_probe(available);
+    std::string missing;
+    for (size_t i = 0; i < kNumCounters; i++) {
+        if (!available[i]) missing += std::string(missing.empty() ? "" : ", ") + perf_counters[i].name;
+    }
+    if (!missing.empty()) {
+        fprintf(stderr,
+                "Warning: counters unavailable (%s); check /proc/sys/kernel/perf_event_paranoid. "
+                "Reporting them as n/a.\n",
+                missing.c_str());
+    }
+
+    int cpu = opts.pin ? pick_cpu(opts.cpu) : -1;
+    if (opts.pin && !pin_to_cpu(cpu)) {
+        fprintf(stderr, "Warning: cannot pin to CPU %d; running unpinned\n", cpu);
+        opts.pin = false;
+    }
+
+    printf("Benchmarking executables in: %s\n", opts.directory.c_str());
+    printf("Runs per binary: %d (+%d warmup), interleaved, seed %u, %s, mode %s\n\n", opts.runs, opts.warmups,
+           opts.seed, opts.pin ? ("pinned to CPU " + std::to_string(cpu)).c_str() : "unpinned",
+           mode_name(opts.mode));
+
+    if (opts.mode != Mode::Exec) {
+        for (Binary& bin : bins) {
+            if (!start_server(bin, opts, cpu)) {
+                fprintf(stderr, "Warning: %s has no fork server (link it with cima_forkserver.o)\n",
+                        bin.path.c_str());
+            }
+        }
+    }
+
+    // Every round runs each binary once, in a fresh random order, so drift
+    // (thermal, frequency, background load) spreads across all variants
+    // instead of landing on whichever ran last
+    std::mt19937 rng(opts.seed);
+    std::vector<size_t> order(bins.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+    double values[kNumMetrics];
+    for (int round = 0; round < opts.warmups + opts.runs; round++) {
+        std::shuffle(order.begin(), order.end(), rng);
+        for (size_t idx : order) {
+            Binary& bin = bins[idx];
+            int status;
+            if (opts.mode == Mode::Exec) {
+                status = run_once(bin, opts, cpu, available, values);
+            } else {
+                status = bin.server < 0 ? -1 : run_server_once(bin, opts.mode, values);
+            }
+            if (status == -1 || (WIFEXITED(status) && WEXITSTATUS(status) == 127)) {
+                if (round >= opts.warmups) bin.failed_runs++;
+                continue;
+            }
+            if (WIFEXITED(status)) bin.exit_code = WEXITSTATUS(status);
+            if (round < opts.warmups) continue;
+            // A run cut short by a crash, or failing where none does not,
+            // would pass its truncated time off as a fast one
+            if (!run_completed(bins, bin, status)) {
+                bin.failed_runs++;
+                continue;
+            }
+            for (size_t m = 0; m <= kPeakRss; m++) bin.samples[m].push_back(values[m]);
+        }
+    }
+
+    for (Binary& bin : bins) stop_server(bin);
+
+    // Memory runs come last so tracing never perturbs the timed rounds
+    for (int run = 0; run < opts.memory_runs; run++) {
+        for (Binary& bin : bins) {
+            if (!memory_run(bin, opts, cpu, values)) continue;
+            for (size_t m = kExitRss; m < kNumMetrics; m++) bin.samples[m].push_back(values[m]);
+        }
+    }
+
+    print_table(bins);
+    print_memory_table(bins);
+    for (const Binary& bin : bins) {
+        if (bin.failed_runs) {
+            fprintf(stderr, "Note: %s_%s: %d run(s) failed to start, died on a signal or exited unlike none\n",
+                    bin.test.c_str(), bin.variant.c_str(), bin.failed_runs);
+        }
+    }
+
+    if (!opts.json_path.empty()) {
+        write_json(opts.json_path, opts, cpu, bins);
+        printf("JSON written to %s\n", opts.json_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+// cima_forkserver.c - fork server linked into benchmark binaries
+//
+// Without CIMA_FORKSERVER in the environment this object does nothing. With
+// it, a constructor that runs after ASan's runtime and module constructors
+// parks the process before main and serves cima_bench on the descriptors
+// from perf_counters.h:
+//
+//   'R'  fork; the child stops itself, the server attaches the counter
+//        group, resumes it and counts it through main() and exit
+//   'E'  call cima_bench_entry() in the server process itself, counting
+//        only that call (for programs that export a repeatable entry)
+//
+// Both avoid paying exec, dynamic loading, ASan shadow mapping and module
+// constructors on every measured run.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "perf_counters.h"
+
+// Optional entry point a benchmark can export for in-process iterations
+int cima_bench_entry(void) __attribute__((weak));
+
+static bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void run_forked(const bool* available, struct forkserver_result* result) {
+    pid_t pid = fork();
+    if (pid < 0) return;
+
+    if (pid == 0) {
+        // Child: drop the protocol descriptors and wait to be resumed once
+        // the counters are attached; returning continues into main()
+        close(FORKSERVER_CMD_FD);
+        close(FORKSERVER_RESULT_FD);
+        raise(SIGSTOP);
+        return;
+    }
+
+    int status;
+    if (waitpid(pid, &status, WUNTRACED) < 0 || !WIFSTOPPED(status)) return;
+
+    int fds[PERF_NUM_COUNTERS];
+    perf_counters_open(pid, available, false, fds);
+    uint64_t start = perf_now_ns();
+    perf_counters_enable(fds);
+    kill(pid, SIGCONT);
+
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {
+    }
+    result->wall_ns = perf_now_ns() - start;
+    result->peak_rss_kb = (double)usage.ru_maxrss;
+    perf_counters_read(fds, result->counters);
+    perf_counters_close(fds);
+    result->status = status;
+}
+
+static void run_entry(const bool* available, struct forkserver_result* result) {
+    if (!cima_bench_entry) return;
+
+    int fds[PERF_NUM_COUNTERS];
+    perf_counters_open(0, available, false, fds);
+    uint64_t start = perf_now_ns();
+    perf_counters_enable(fds);
+    int ret = cima_bench_entry();
+    perf_counters_disable(fds);
+    result->wall_ns = perf_now_ns() - start;
+    perf_counters_read(fds, result->counters);
+    perf_counters_close(fds);
+    result->status = ret;
+}
+
+__attribute__((constructor(65535))) static void cima_forkserver(void) {
+    if (!getenv("CIMA_FORKSERVER")) return;
+    unsetenv("CIMA_FORKSERVER");
+
+    uint32_t hello = FORKSERVER_HELLO;
+    if (!write_all(FORKSERVER_RESULT_FD, &hello, sizeof(hello))) return;
+
+    bool available[PERF_NUM_COUNTERS];
+    perf_counters_probe(available);
+
+    for (;;) {
+        char cmd;
+        ssize_t n = read(FORKSERVER_CMD_FD, &cmd, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != 1) _exit(0);  // harness went away
+
+        struct forkserver_result result;
+        memset(&result, 0, sizeof(result));
+        result.status = -1;
+        for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) result.counters[i] = NAN;
+        result.peak_rss_kb = NAN;
+
+        pid_t self = getpid();
+        if (cmd == FORKSERVER_RUN) {
+            run_forked(available, &result);
+        } else if (cmd == FORKSERVER_ENTRY) {
+            run_entry(available, &result);
+        }
+        // The resumed child returns from run_forked and goes on to main()
+        if (getpid() != self) return;
+
+        if (!write_all(FORKSERVER_RESULT_FD, &result, sizeof(result))) _exit(0);
+    }
+}
@@ -0,0 +1,333 @@
+// cima_microbench - microbenchmarks for the CIMA runtime and recovery paths
+//
+// Builds controlled ASan shadow layouts (heap chunks, stack frames and
+// globals with their redzones, and a fully poisoned gap with one valid
+// granule at a chosen distance) and times, in isolation:
+//
+//   nearest   __cima_find_nearest_valid against distance to valid memory,
+//             search direction and access size
+//   checks    the runtime validity checks behind callback mode
+//   recovery  the full check-fail-recover sequence of every pass variant,
+//             using micro_recover.c built through each CIMA plugin
+//
+// Usage: cima_microbench [--iters=N] [--repeats=N] [--filter=SECTION] [--json=FILE]
+
+#include <sanitizer/asan_interface.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+extern "C" {
+void* __cima_find_nearest_valid(void* invalid_ptr, size_t access_size);
+bool __cima_load4(uint64_t addr);
+bool __cima_loadN(uint64_t addr, size_t size);
+}
+
+#ifdef CIMA_MICRO_RECOVERY
+// Kernels from micro_recover.c, one build per variant. Only the recovering
+// variants may be pointed at poisoned memory; asan would abort.
+#define CIMA_MICRO_VARIANTS(X) \
+    X(none, false)             \
+    X(asan, false)             \
+    X(base, true)              \
+    X(nearest, true)           \
+    X(tainted, true)           \
+    X(native, true)
+
+extern "C" {
+#define CIMA_MICRO_DECLARE(variant, recovers)                  \
+    long micro_load_loop_##variant(int* p, long n);            \
+    void micro_store_loop_##variant(int* p, long n);
+CIMA_MICRO_VARIANTS(CIMA_MICRO_DECLARE)
+#undef CIMA_MICRO_DECLARE
+}
+#endif
+
+namespace {
+
+constexpr uint64_t kGranule = 8;
+
+struct Options {
+    long iters = 200000;
+    int repeats = 7;
+    std::string filter;
+    std::string json_path;
+};
+
+struct Result {
+    std::string section;
+    std::string name;
+    double ns_per_op;
+    double cycles_per_op;
+    std::string note;
+};
+
+std::vector<Result> results;
+bool counters_available[PERF_NUM_COUNTERS];
+volatile uintptr_t sink;
+
+// Keep p (and whatever it points into) alive and opaque to the optimizer
+inline void escape(const void* p) { asm volatile("" : : "r"(p) : "memory"); }
+
+// Median per-operation wall time and cycles of fn(iters) over the repeats
+template <typename Fn>
+void measure(const Options& opts, const char* section, const std::string& name, Fn fn,
+             const std::string& note = "") {
+    std::vector<double> ns, cycles;
+    bool wanted[PERF_NUM_COUNTERS] = {};
+    wanted[0] = counters_available[0];  // cycles
+
+    fn(opts.iters / 10 + 1);  // warm caches and branch predictors
+    for (int r = 0; r < opts.repeats; r++) {
+        int fds[PERF_NUM_COUNTERS];
+        double values[PERF_NUM_COUNTERS];
+        perf_counters_open(0, wanted, false, fds);
+        uint64_t start = perf_now_ns();
+        perf_counters_enable(fds);
+        fn(opts.iters);
+        perf_counters_disable(fds);
+        uint64_t end = perf_now_ns();
+        perf_counters_read(fds, values);
+        perf_counters_close(fds);
+
+        ns.push_back((double)(end - start) / opts.iters);
+        cycles.push_back(values[0] / opts.iters);
+    }
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+    Result res{section, name, ns[ns.size() / 2], cycles[cycles.size() / 2], note};
+    if (std::isnan(res.cycles_per_op)) {
+        printf("  %-44s %9.2f ns      n/a cyc  %s\n", name.c_str(), res.ns_per_op, note.c_str());
+    } else {
+        printf("  %-44s %9.2f ns %8.1f cyc  %s\n", name.c_str(), res.ns_per_op, res.cycles_per_op, note.c_str());
+    }
+    results.push_back(res);
+}
+
+bool selected(const Options& opts, const char* section) {
+    return opts.filter.empty() || opts.filter == section;
+}
+
+// base + off computed on integers: the probes deliberately point outside
+// their objects, which the compiler would otherwise warn about
+char* at(const void* base, int64_t off) { return reinterpret_cast<char*>((uintptr_t)base + off); }
+
+// Distance in granules from probe to what the lookup returned
+std::string found_note(const void* probe, const void* found) {
+    if (!found) return "not found";
+    int64_t delta = ((int64_t)(uintptr_t)found - (int64_t)((uintptr_t)probe & ~(kGranule - 1))) / (int64_t)kGranule;
+    return "found at " + std::to_string(delta) + " granules";
+}
+
+void time_lookup(const Options& opts, const char* layout, const std::string& what, char* probe, size_t size) {
+    void* found = __cima_find_nearest_valid(probe, size);
+    measure(
+        opts, "nearest", std::string(layout) + " " + what + " size " + std::to_string(size),
+        [&](long n) {
+            for (long i = 0; i < n; i++) {
+                escape(probe);
+                sink = (uintptr_t)__cima_find_nearest_valid(probe, size);
+            }
+        },
+        found_note(probe, found));
+}
+
+// A poisoned gap with a single valid granule dist granules away from the
+// probe, in either direction; past the search window the lookup misses
+void bench_gap(const Options& opts) {
+    static const uint64_t kDistances[] = {1, 2, 8, 32, 128, 511, 600};
+    static const size_t kSizes[] = {1, 4, 8};
+    const uint64_t span = 1024 * kGranule;
+
+    char* buf = static_cast<char*>(aligned_alloc(kGranule, 2 * span + kGranule));
+    char* probe = buf + span;
+    for (int dir = 1; dir >= -1; dir -= 2) {
+        for (uint64_t dist : kDistances) {
+            ASAN_POISON_MEMORY_REGION(buf, 2 * span + kGranule);
+            ASAN_UNPOISON_MEMORY_REGION(probe + dir * (int64_t)(dist * kGranule), kGranule);
+            for (size_t size : kSizes) {
+                time_lookup(opts, "gap", std::string(dir > 0 ? "fwd " : "bwd ") + std::to_string(dist), probe,
+                            size);
+            }
+        }
+    }
+    ASAN_UNPOISON_MEMORY_REGION(buf, 2 * span + kGranule);
+    free(buf);
+}
+
+char global_object[40];
+
+__attribute__((noinline)) void bench_stack(const Options& opts) {
+    char frame_object[40];
+    escape(frame_object);
+    for (int64_t off : {40, 48, 64}) {
+        time_lookup(opts, "stack", "+" + std::to_string(off), at(frame_object, off), 4);
+    }
+    time_lookup(opts, "stack", "-8", at(frame_object, -8), 4);
+}
+
+void bench_layouts(const Options& opts) {
+    char* heap_object = static_cast<char*>(malloc(40));
+    escape(heap_object);
+    for (int64_t off : {40, 48, 64}) {
+        time_lookup(opts, "heap", "+" + std::to_string(off), at(heap_object, off), 4);
+    }
+    time_lookup(opts, "heap", "-8", at(heap_object, -8), 4);
+    free(heap_object);
+
+    // Freed memory stays poisoned while quarantined
+    char* freed = static_cast<char*>(malloc(256));
+    char* probe = at(freed, 128);
+    free(freed);
+    time_lookup(opts, "heap", "freed+128", probe, 4);
+
+    bench_stack(opts);
+
+    escape(global_object);
+    for (int64_t off : {40, 48, 64}) {
+        time_lookup(opts, "global", "+" + std::to_string(off), at(global_object, off), 4);
+    }
+}
+
+void bench_checks(const Options& opts) {
+    char* heap_object = static_cast<char*>(malloc(40));
+    uint64_t valid = (uint64_t)(uintptr_t)heap_object;
+    uint64_t invalid = valid + 40;
+
+    measure(opts, "checks", "__cima_load4 valid", [&](long n) {
+        for (long i = 0; i < n; i++) sink = __cima_load4(valid);
+    });
+    measure(opts, "checks", "__cima_load4 invalid", [&](long n) {
+        for (long i = 0; i < n; i++) sink = __cima_load4(invalid);
+    });
+    measure(opts, "checks", "__cima_loadN 32 bytes valid", [&](long n) {
+        for (long i = 0; i < n; i++) sink = __cima_loadN(valid, 32);
+    });
+    measure(opts, "checks", "__cima_loadN 32 bytes straddling end", [&](long n) {
+        for (long i = 0; i < n; i++) sink = __cima_loadN(valid + 24, 32);
+    });
+    free(heap_object);
+}
+
+#ifdef CIMA_MICRO_RECOVERY
+void bench_recovery(const Options& opts) {
+    // Valid target: an ordinary heap int. Invalid target: memory we own but
+    // poisoned by hand, so even the uninstrumented variant may touch it.
+    // Its neighbour stays valid for the nearest-valid search.
+    int* valid = static_cast<int*>(malloc(sizeof(int)));
+    *valid = 1;
+    char* region = static_cast<char*>(aligned_alloc(kGranule, 4 * kGranule));
+    memset(region, 0, 4 * kGranule);
+    ASAN_POISON_MEMORY_REGION(region + 2 * kGranule, 2 * kGranule);
+    int* invalid = reinterpret_cast<int*>(region + 2 * kGranule);
+
+#define CIMA_MICRO_RUN(variant, recovers)                                                      \
+    measure(opts, "recovery", #variant " load valid",                                           \
+            [&](long n) { sink = micro_load_loop_##variant(valid, n); });                       \
+    measure(opts, "recovery", #variant " store valid",                                          \
+            [&](long n) { micro_store_loop_##variant(valid, n); });                             \
+    if (recovers) {                                                                             \
+        measure(opts, "recovery", #variant " load invalid (check-fail-recover)",                \
+                [&](long n) { sink = micro_load_loop_##variant(invalid, n); });                 \
+        measure(opts, "recovery", #variant " store invalid (check-fail-recover)",               \
+                [&](long n) { micro_store_loop_##variant(invalid, n); });                       \
+    }
+    CIMA_MICRO_VARIANTS(CIMA_MICRO_RUN)
+#undef CIMA_MICRO_RUN
+
+    ASAN_UNPOISON_MEMORY_REGION(region, 4 * kGranule);
+    free(region);
+    free(valid);
+}
+#endif
+
+void write_json(const std::string& path, const Options& opts) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot write %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    fprintf(out, "{\n  \"iters\": %ld,\n  \"repeats\": %d,\n  \"results\": [", opts.iters, opts.repeats);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(out, "%s\n    {\"section\": \"%s\", \"name\": \"%s\", \"ns_per_op\": %.4f, \"cycles_per_op\": ",
+                i ? "," : "", r.section.c_str(), r.name.c_str(), r.ns_per_op);
+        if (std::isnan(r.cycles_per_op)) {
+            fputs("null", out);
+        } else {
+            fprintf(out, "%.2f", r.cycles_per_op);
+        }
+        fprintf(out, ", \"note\": \"%s\"}", r.note.c_str());
+    }
+    fputs("\n  ]\n}\n", out);
+    fclose(out);
+}
+
+bool parse_args(int argc, char** argv, Options* opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (key == "--iters" && !value.empty()) {
+            opts->iters = atol(value.c_str());
+        } else if (key == "--repeats" && !value.empty()) {
+            opts->repeats = atoi(value.c_str());
+        } else if (key == "--filter" && !value.empty()) {
+            opts->filter = value;
+        } else if (key == "--json" && !value.empty()) {
+            opts->json_path = value;
+        } else {
+            return false;
+        }
+    }
+    return opts->iters > 0 && opts->repeats > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_args(argc, argv, &opts)) {
+        fprintf(stderr,
+                "Usage: %s [--iters=N] [--repeats=N] [--filter=nearest|checks|recovery] [--json=FILE]\n",
+                argv[0]);
+        return 1;
+    }
+    perf_counters_probe(counters_available);
+
+    printf("CIMA microbenchmarks: %ld iterations, median of %d repeats\n", opts.iters, opts.repeats);
+    if (selected(opts, "nearest")) {
+        printf("\n[nearest] __cima_find_nearest_valid\n");
+        bench_gap(opts);
+        bench_layouts(opts);
+    }
+    if (selected(opts, "checks")) {
+        printf("\n[checks] callback-mode validity checks\n");
+        bench_checks(opts);
+    }
+#ifdef CIMA_MICRO_RECOVERY
+    if (selected(opts, "recovery")) {
+        printf("\n[recovery] per-iteration cost of micro_recover.c kernels\n");
+        bench_recovery(opts);
+    }
+#else
+    if (selected(opts, "recovery")) {
+        printf("\n[recovery] skipped: built without clang/opt to compile the kernels\n");
+    }
+#endif
+
+    if (!opts.json_path.empty()) write_json(opts.json_path, opts);
+    return 0;
+}
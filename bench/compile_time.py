@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+"""Compile-time scalability benchmark for the CIMA plugins.
+
+Generates synthetic IR in three shapes, each at a range of sizes counted in
+memory accesses (one ASan check each):
+
+  straight   one basic block of loads and stores: a SplitBlock per check
+  loops      nests of --loop-depth loops with accesses at every level
+  switch     a switch with one access pair per case, all joining one block
+             (a merge block with thousands of predecessors)
+
+For every plugin the input is prepared the way pipeline_unified.sh does it
+(ASan before the post-ASan passes, raw IR for the native pass) and saved as
+bitcode. The script then times opt running only that plugin, minus the
+time opt needs to read and write the same module, and records peak RSS.
+A least-squares fit of log(time) over log(size) gives the growth exponent
+of each plugin and shape. Exponents above --max-exponent are flagged as
+super-linear and make the script exit 1.
+"""
+import argparse
+import json
+import math
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+
+BUILD_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "build", "cimapass")
+
+# name -> (plugin, pass, options, runs after ASan)
+PLUGINS = {
+    "base": ("CIMAPass.so", "CIMAPass", [], True),
+    "nearest": ("CIMAPassNearestValid.so", "CIMAPassNearestValid", ["-cima-use-nearest-valid"], True),
+    "tainted": ("CIMAPassTainted.so", "CIMAPassTainted", [], True),
+    "native": ("CIMAPassNative.so", "CIMAPassNative", [], False),
+}
+SHAPES = ["straight", "loops", "switch"]
+DEFAULT_SIZES = "1000,3000,10000,30000,100000"
+
+
+class Function:
+    """Text of one generated function, with unique value names."""
+
+    def __init__(self, name):
+        self.lines = [f"define void @{name}(ptr %p, i64 %i) #0 {{", "entry:"]
+        self.next_id = 0
+
+    def access(self, index, offset):
+        """p[index + offset + 1] = p[index + offset]: two checked accesses."""
+        n = self.next_id
+        self.next_id += 1
+        self.lines += [
+            f"  %a{n} = add i64 {index}, {offset}",
+            f"  %g{n} = getelementptr inbounds i32, ptr %p, i64 %a{n}",
+            f"  %v{n} = load i32, ptr %g{n}, align 4",
+            f"  %s{n} = getelementptr inbounds i32, ptr %g{n}, i64 1",
+            f"  store i32 %v{n}, ptr %s{n}, align 4",
+        ]
+
+    def label(self, name):
+        self.lines.append(f"{name}:")
+
+    def emit(self, line):
+        self.lines.append(f"  {line}")
+
+    def text(self):
+        return "\n".join(self.lines + ["}"])
+
+
+def gen_straight(accesses):
+    f = Function("straight")
+    for k in range(accesses // 2):
+        f.access("%i", k)
+    f.emit("ret void")
+    return f.text()
+
+
+def gen_loops(accesses, depth, trip=4):
+    # Every level of a nest holds two access pairs: 4 * depth accesses
+    per_level = 2
+    nests = max(1, accesses // (2 * per_level * depth))
+    f = Function("loops")
+    pred = "entry"
+    f.emit("br label %n0_h0")
+    for k in range(nests):
+        for d in range(depth):
+            f.label(f"n{k}_h{d}")
+            loop_pred = pred if d == 0 else f"n{k}_h{d - 1}"
+            f.emit(f"%iv{k}_{d} = phi i64 [ 0, %{loop_pred} ], [ %iv{k}_{d}.next, %n{k}_x{d} ]")
+            for a in range(per_level):
+                f.access(f"%iv{k}_{d}", a * 2)
+            f.emit(f"br label %n{k}_{'h' + str(d + 1) if d + 1 < depth else 'x' + str(d)}")
+        for d in reversed(range(depth)):
+            f.label(f"n{k}_x{d}")
+            f.emit(f"%iv{k}_{d}.next = add i64 %iv{k}_{d}, 1")
+            f.emit(f"%c{k}_{d} = icmp ult i64 %iv{k}_{d}.next, {trip}")
+            out = f"n{k}_x{d - 1}" if d > 0 else (f"n{k + 1}_h0" if k + 1 < nests else "exit")
+            f.emit(f"br i1 %c{k}_{d}, label %n{k}_h{d}, label %{out}")
+        pred = f"n{k}_x0"
+    f.label("exit")
+    f.emit("ret void")
+    return f.text()
+
+
+def gen_switch(accesses):
+    cases = max(1, accesses // 2)
+    f = Function("switch")
+    f.emit("switch i64 %i, label %merge [")
+    for c in range(cases):
+        f.emit(f"  i64 {c}, label %case{c}")
+    f.emit("]")
+    for c in range(cases):
+        f.label(f"case{c}")
+        f.access("%i", c)
+        f.emit("br label %merge")
+    f.label("merge")
+    f.emit("ret void")
+    return f.text()
+
+
+def generate(shape, accesses, depth):
+    if shape == "straight":
+        body = gen_straight(accesses)
+    elif shape == "loops":
+        body = gen_loops(accesses, depth)
+    else:
+        body = gen_switch(accesses)
+    return body + "\n\nattributes #0 = { noinline nounwind sanitize_address }\n"
+
+
+def run_opt(cmd, timeout=None):
+    """Run one opt command; returns (cpu seconds, peak RSS in MiB), or None
+    when it was killed after timeout seconds."""
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    timer = threading.Timer(timeout, proc.kill) if timeout else None
+    if timer:
+        timer.start()
+    stderr = proc.stderr.read().decode(errors="replace")
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    proc.stderr.close()
+    if timer:
+        timer.cancel()
+        if proc.returncode == -signal.SIGKILL:
+            return None
+    if proc.returncode != 0:
+        sys.exit(f"Error: {' '.join(cmd)} failed:\n{stderr}")
+    return usage.ru_utime + usage.ru_stime, usage.ru_maxrss / 1024.0
+
+
+def best_of(cmd, repeats, timeout=None):
+    samples = []
+    for _ in range(repeats):
+        sample = run_opt(cmd, timeout)
+        if sample is None:
+            return None
+        samples.append(sample)
+    return min(s[0] for s in samples), max(s[1] for s in samples)
+
+
+def fit_exponent(points):
+    """Slope of log(time) over log(size) for points with measurable time."""
+    pts = [(math.log(n), math.log(t)) for n, t in points if t >= 0.02]
+    if len(pts) < 2:
+        return None
+    mx = sum(x for x, _ in pts) / len(pts)
+    my = sum(y for _, y in pts) / len(pts)
+    sxx = sum((x - mx) ** 2 for x, _ in pts)
+    if sxx == 0:
+        return None
+    return sum((x - mx) * (y - my) for x, y in pts) / sxx
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure CIMA plugin compile time and memory on synthetic IR.")
+    parser.add_argument("--plugins", default=",".join(PLUGINS), help="Plugins to measure (default: %(default)s)")
+    parser.add_argument("--shapes", default=",".join(SHAPES), help="IR shapes (default: %(default)s)")
+    parser.add_argument("--sizes", default=DEFAULT_SIZES, help="Accesses per function (default: %(default)s)")
+    parser.add_argument("--loop-depth", type=int, default=4, help="Depth of each loop nest (default: 4)")
+    parser.add_argument("--repeats", type=int, default=3, help="Runs per measurement; the fastest is kept")
+    parser.add_argument("--build-dir", default=BUILD_DIR, help="Directory with the plugins (default: build/cimapass)")
+    parser.add_argument("--opt", default="opt", help="opt executable (default: opt)")
+    parser.add_argument("--opt-args", default="", help="Extra arguments for every opt invocation")
+    parser.add_argument("--max-exponent", type=float, default=1.25,
+                        help="Growth exponent above which a plugin is flagged (default: 1.25)")
+    parser.add_argument("--timeout", type=float, default=300,
+                        help="Seconds before a plugin run is abandoned; larger sizes of that plugin and "
+                             "shape are skipped and it is flagged (default: 300)")
+    parser.add_argument("--keep", help="Keep the generated IR in this directory")
+    parser.add_argument("--json", help="Write the results to this file")
+    args = parser.parse_args()
+
+    plugins = args.plugins.split(",")
+    shapes = args.shapes.split(",")
+    sizes = [int(s) for s in args.sizes.split(",")]
+    opt = [args.opt] + args.opt_args.split()
+    for name in plugins:
+        if name not in PLUGINS:
+            sys.exit(f"Error: unknown plugin {name}; choose from {', '.join(PLUGINS)}")
+        if not os.path.isfile(os.path.join(args.build_dir, PLUGINS[name][0])):
+            sys.exit(f"Error: {PLUGINS[name][0]} not found in {args.build_dir}; run ./build.sh first")
+
+    work = args.keep or tempfile.mkdtemp(prefix="cima_compile_time_")
+    os.makedirs(work, exist_ok=True)
+
+    results = []
+    timed_out = set()
+    print(f"{'Plugin':<8} {'Shape':<9} {'Accesses':>9} {'Pass (s)':>9} {'I/O (s)':>8} {'RSS (MiB)':>10}")
+    print("-" * 58)
+    try:
+        for shape in shapes:
+            for size in sizes:
+                raw_ll = os.path.join(work, f"{shape}_{size}.ll")
+                with open(raw_ll, "w") as f:
+                    f.write(generate(shape, size, args.loop_depth))
+                # Inputs as the pipeline hands them to each plugin, as bitcode
+                # so parsing stays a small, subtractable cost
+                raw_bc = os.path.join(work, f"{shape}_{size}.bc")
+                asan_bc = os.path.join(work, f"{shape}_{size}_asan.bc")
+                run_opt(opt + ["-passes=verify", raw_ll, "-o", raw_bc])
+                run_opt(opt + ["-passes=module(asan),asan", raw_bc, "-o", asan_bc])
+
+                for name in plugins:
+                    if (name, shape) in timed_out:
+                        continue
+                    plugin, pass_name, pass_opts, after_asan = PLUGINS[name]
+                    plugin_path = os.path.join(args.build_dir, plugin)
+                    src = asan_bc if after_asan else raw_bc
+                    out = os.path.join(work, "out.bc")
+                    io_time, _ = best_of(opt + ["-passes=verify", src, "-o", out], args.repeats)
+                    measured = best_of(opt + [f"-load-pass-plugin={plugin_path}", f"-passes={pass_name}"] +
+                                       pass_opts + [src, "-o", out], args.repeats, args.timeout)
+                    if measured is None:
+                        timed_out.add((name, shape))
+                        print(f"{name:<8} {shape:<9} {size:>9} {'timeout':>9}", flush=True)
+                        continue
+                    total, rss = measured
+                    pass_time = max(0.0, total - io_time)
+                    results.append({"plugin": name, "shape": shape, "accesses": size,
+                                    "pass_s": pass_time, "io_s": io_time, "peak_rss_mib": rss})
+                    print(f"{name:<8} {shape:<9} {size:>9} {pass_time:>9.3f} {io_time:>8.3f} {rss:>10.1f}", flush=True)
+    finally:
+        if not args.keep:
+            shutil.rmtree(work, ignore_errors=True)
+
+    print()
+    print(f"{'Plugin':<8} {'Shape':<9} {'Exponent':>8}  Growth")
+    print("-" * 40)
+    flagged = []
+    exponents = {}
+    for name in plugins:
+        for shape in shapes:
+            points = [(r["accesses"], r["pass_s"]) for r in results if r["plugin"] == name and r["shape"] == shape]
+            k = fit_exponent(points)
+            exponents.setdefault(name, {})[shape] = k
+            if (name, shape) in timed_out:
+                flagged.append(f"{name}/{shape}")
+                print(f"{name:<8} {shape:<9} {f'{k:.2f}' if k is not None else '-':>8}  TIMEOUT after {args.timeout:g}s")
+                continue
+            if k is None:
+                print(f"{name:<8} {shape:<9} {'-':>8}  too fast to fit")
+                continue
+            verdict = "linear"
+            if k > args.max_exponent:
+                verdict = "SUPER-LINEAR"
+                flagged.append(f"{name}/{shape}")
+            print(f"{name:<8} {shape:<9} {k:>8.2f}  {verdict}")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"results": results, "exponents": exponents, "max_exponent": args.max_exponent,
+                       "timed_out": sorted(f"{n}/{s}" for n, s in timed_out)}, f, indent=2)
+        print(f"JSON written to {args.json}")
+
+    if flagged:
+        print(f"Super-linear compile time: {', '.join(flagged)}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,27 @@
+// micro_recover.c - recovery microbenchmark kernels
+//
+// Compiled once per pass variant (bench/CMakeLists.txt) the same way
+// pipeline_unified.sh builds programs: -O0 IR, ASan, then the variant's
+// CIMA pass. CIMA_MICRO_VARIANT names the variant and suffixes every
+// symbol so all builds link into cima_microbench together.
+
+#define MICRO_CAT(fn, variant) fn##_##variant
+#define MICRO_NAME(fn, variant) MICRO_CAT(fn, variant)
+#define MICRO(fn) MICRO_NAME(fn, CIMA_MICRO_VARIANT)
+
+// n loads of *p: one check per iteration, plus a recovery whenever p
+// points at poisoned memory
+long MICRO(micro_load_loop)(int* p, long n) {
+    long sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += *p;
+    }
+    return sum;
+}
+
+// n stores to *p, likewise
+void MICRO(micro_store_loop)(int* p, long n) {
+    for (long i = 0; i < n; i++) {
+        *p = (int)i;
+    }
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""Static instrumentation-overhead report per function.
+
+Builds the benchmark suite for every pass variant with
+tests/pipeline_unified.sh, runs the cima-overhead-report pass over each
+variant's final IR, and subtracts the ASan-only IR to show what each CIMA
+variant adds per function: basic blocks, instructions, PHIs, runtime calls,
+shadow allocas and taint ORs. The bounds variant has no ASan underneath, so
+it is compared with the uninstrumented none build instead. The .text size of every function comes from
+the linked binary (nm -S) and is compared the same way.
+
+Nothing is run beyond what the pipeline itself does, so the report shows
+where the bloat comes from before any benchmark is measured. The rows are
+written as JSON (and optionally CSV); the console gets per-variant totals,
+or every function with --verbose.
+
+Run through the build: make cima-overhead-report.
+"""
+import argparse
+import csv
+import glob
+import json
+import os
+import subprocess
+import sys
+
+REPORT_VERSION = 1
+
+REPO_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+TESTS_DIR = os.path.join(REPO_DIR, "tests")
+DEFAULT_BUILD_ROOT = os.path.join(REPO_DIR, "build")
+DEFAULT_SOURCES = ["embedded_tests/*.c"]
+BASELINE_VARIANT = "asan"
+# Variants not built on top of ASan, with the build they are compared with
+BASELINES = {"bounds": "none"}
+VARIANTS = ["base", "nearest", "tainted", "native", "bounds"]
+IR_METRICS = ["blocks", "instructions", "phis", "runtime_calls", "shadow_allocas", "taint_ors"]
+METRICS = IR_METRICS + ["text_bytes"]
+
+
+def build_suite(sources, build_root, bin_dir, pipeline_args):
+    """Build every source for every variant into bin_dir, keeping the final IR."""
+    env = dict(os.environ, CIMA_BUILD_ROOT=build_root)
+    for source in sources:
+        print(f"Building {os.path.relpath(source, REPO_DIR)} for all variants ...", flush=True)
+        cmd = [os.path.join(TESTS_DIR, "pipeline_unified.sh"), source, "--pass=all", f"--output-dir={bin_dir}"]
+        result = subprocess.run(cmd + pipeline_args, cwd=TESTS_DIR, env=env, stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT, text=True)
+        if result.returncode != 0:
+            print(result.stdout)
+            sys.exit(f"Error: pipeline failed for {source}")
+
+
+def ir_counts(opt, plugin, ir_file, json_path):
+    """{function: {metric: count}} from the cima-overhead-report pass."""
+    cmd = [opt, f"-load-pass-plugin={plugin}", "-passes=cima-overhead-report", "-disable-output",
+           f"-cima-overhead-report-file={json_path}", ir_file]
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if result.returncode != 0:
+        sys.exit(f"Error: cima-overhead-report failed on {ir_file}:\n{result.stderr}")
+    with open(json_path) as f:
+        report = json.load(f)
+    return {fn["name"]: {m: fn[m] for m in IR_METRICS} for fn in report["functions"]}
+
+
+def text_sizes(nm, binary):
+    """{function: bytes} for the code symbols of a linked binary."""
+    result = subprocess.run([nm, "-S", "--defined-only", binary], stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE, text=True)
+    if result.returncode != 0:
+        sys.exit(f"Error: {nm} failed on {binary}:\n{result.stderr}")
+    sizes = {}
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        # address size type name; symbols without a size have three fields
+        if len(fields) == 4 and fields[2] in ("T", "t"):
+            sizes[fields[3]] = int(fields[1], 16)
+    return sizes
+
+
+def baseline_of(variant):
+    return BASELINES.get(variant, BASELINE_VARIANT)
+
+
+def collect(test, bin_dir, work_dir, opt, plugin, nm, variants):
+    """Per-variant {function: {metric: value}} for one test, baselines included."""
+    counts = {}
+    baselines = sorted({baseline_of(v) for v in variants})
+    for variant in baselines + variants:
+        stem = os.path.join(bin_dir, f"{test}_{variant}_final")
+        # The pipeline keeps the final IR as bitcode, or as text with --keep-ir
+        ir = next((stem + ext for ext in (".bc", ".ll") if os.path.isfile(stem + ext)), None)
+        if not ir or not os.path.isfile(stem):
+            print(f"Warning: no {variant} build of {test} in {bin_dir}; skipping it")
+            continue
+        functions = ir_counts(opt, plugin, ir, os.path.join(work_dir, f"{test}_{variant}.json"))
+        sizes = text_sizes(nm, stem)
+        for name, entry in functions.items():
+            # Functions inlined or dropped at link time have no symbol
+            entry["text_bytes"] = sizes.get(name)
+        counts[variant] = functions
+    return counts
+
+
+def rows_for(test, counts, variants):
+    """One row per (function, variant): absolute values plus the delta to the variant's baseline."""
+    rows = []
+    for variant in variants:
+        base = counts.get(baseline_of(variant), {})
+        for name, entry in sorted(counts.get(variant, {}).items()):
+            row = {"test": test, "function": name, "variant": variant, "baseline": baseline_of(variant)}
+            ref = base.get(name, {})
+            for metric in METRICS:
+                value = entry[metric]
+                row[metric] = value
+                if value is None:
+                    row[metric + "_added"] = None
+                else:
+                    row[metric + "_added"] = value - (ref.get(metric) or 0)
+            rows.append(row)
+    return rows
+
+
+def print_rows(rows, verbose):
+    def cell(x):
+        return f"{x:+d}" if x is not None else "-"
+
+    header = (f"{'Test':<22} {'Variant':<8} {'Function':<24} {'Blocks':>7} {'Insts':>7} {'PHIs':>6} "
+              f"{'RtCalls':>7} {'Shadow':>6} {'TaintOr':>7} {'.text':>8}")
+    print(header)
+    print("-" * len(header))
+
+    if verbose:
+        shown = rows
+    else:
+        # Sum each test and variant over its functions
+        totals = {}
+        for row in rows:
+            key = (row["test"], row["variant"])
+            total = totals.setdefault(key, {"test": row["test"], "variant": row["variant"], "function": "(total)"})
+            for metric in METRICS:
+                added = row[metric + "_added"]
+                if added is not None:
+                    total[metric + "_added"] = total.get(metric + "_added", 0) + added
+        shown = list(totals.values())
+
+    for row in shown:
+        added = [cell(row.get(m + "_added")) for m in METRICS]
+        print(f"{row['test']:<22} {row['variant']:<8} {row['function'][:24]:<24} {added[0]:>7} {added[1]:>7} "
+              f"{added[2]:>6} {added[3]:>7} {added[4]:>6} {added[5]:>7} {added[6]:>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Report what each CIMA variant adds to every function.")
+    parser.add_argument("--build-root", default=DEFAULT_BUILD_ROOT,
+                        help="CMake build directory with the plugins (default: %(default)s)")
+    parser.add_argument("--opt", default="opt", help="opt executable (default: %(default)s)")
+    parser.add_argument("--nm", default="nm", help="nm executable for .text sizes (default: %(default)s)")
+    parser.add_argument("--work-dir", help="Directory for binaries and reports (default: <build-root>/overhead_report)")
+    parser.add_argument("--sources", default=",".join(DEFAULT_SOURCES),
+                        help="Comma-separated globs relative to tests/ (default: %(default)s)")
+    parser.add_argument("--variants", default=",".join(VARIANTS), help="Variants to report (default: %(default)s)")
+    parser.add_argument("--pipeline-args", default="", help="Extra pipeline_unified.sh options")
+    parser.add_argument("--json", help="Report file (default: <work-dir>/overhead_report.json)")
+    parser.add_argument("--csv", help="Also write the rows as CSV")
+    parser.add_argument("--no-build", action="store_true", help="Report on the builds already in the work directory")
+    parser.add_argument("--verbose", action="store_true", help="Print every function instead of per-variant totals")
+    args = parser.parse_args()
+
+    build_root = os.path.abspath(args.build_root)
+    work_dir = os.path.abspath(args.work_dir or os.path.join(build_root, "overhead_report"))
+    bin_dir = os.path.join(work_dir, "bin")
+    plugin = os.path.join(build_root, "cimapass", "CIMAPass.so")
+    variants = args.variants.split(",")
+    for variant in variants:
+        if variant not in VARIANTS:
+            sys.exit(f"Error: unknown variant {variant}; choose from {', '.join(VARIANTS)}")
+    if not os.path.isfile(plugin):
+        sys.exit(f"Error: plugin not found: {plugin}; build the project first")
+
+    sources = []
+    for pattern in args.sources.split(","):
+        sources += sorted(glob.glob(os.path.join(TESTS_DIR, pattern)))
+    if not sources:
+        sys.exit("Error: no benchmark sources matched")
+
+    os.makedirs(bin_dir, exist_ok=True)
+    if not args.no_build:
+        build_suite(sources, build_root, bin_dir, args.pipeline_args.split())
+
+    rows = []
+    for source in sources:
+        test = os.path.splitext(os.path.basename(source))[0]
+        counts = collect(test, bin_dir, work_dir, args.opt, plugin, args.nm, variants)
+        rows += rows_for(test, counts, variants)
+
+    json_path = args.json or os.path.join(work_dir, "overhead_report.json")
+    with open(json_path, "w") as f:
+        json.dump({"version": REPORT_VERSION, "baseline": BASELINE_VARIANT, "baselines": BASELINES,
+                   "metrics": METRICS, "rows": rows}, f, indent=2)
+        f.write("\n")
+    if args.csv:
+        fields = ["test", "function", "variant", "baseline"] + [k for m in METRICS for k in (m, m + "_added")]
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=fields)
+            writer.writeheader()
+            writer.writerows(rows)
+
+    print_rows(rows, args.verbose)
+    print(f"Report written to {json_path}")
+
+
+if __name__ == "__main__":
+    main()
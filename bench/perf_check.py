@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""Overhead regression gate against the checked-in baseline.
+
+Builds the benchmark suite for every pass variant with
+tests/pipeline_unified.sh, measures it with cima_bench, and compares each
+test's overhead relative to its none variant with stats/perf_baseline.json.
+A benchmark regresses when its overhead grew by more than the tolerance
+and by more than the combined 95% confidence interval of the baseline and
+the current measurement. On a regression, on a baseline entry missing
+from the measurement, or on any run cima_bench counts as failed (it did
+not start, died on a signal, or exited with a status other than none's),
+the script prints a per-benchmark diff and exits 1.
+
+With --update the current measurement becomes the new baseline instead.
+
+Run through the build: make cima-perf-check / make cima-perf-baseline.
+"""
+import argparse
+import datetime
+import glob
+import json
+import math
+import os
+import platform
+import shutil
+import subprocess
+import sys
+
+BASELINE_VERSION = 1
+
+REPO_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+TESTS_DIR = os.path.join(REPO_DIR, "tests")
+DEFAULT_BASELINE = os.path.join(REPO_DIR, "stats", "perf_baseline.json")
+DEFAULT_BUILD_ROOT = os.path.join(REPO_DIR, "build")
+DEFAULT_SOURCES = ["embedded_tests/*.c"]
+DEFAULT_METRICS = "wall_ns,instructions"
+
+
+def git_commit():
+    result = subprocess.run(["git", "-C", REPO_DIR, "rev-parse", "--short", "HEAD"], stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL, text=True)
+    return result.stdout.strip() or None
+
+
+def build_suite(sources, build_root, bin_dir, pipeline_args):
+    """Build every source for every variant into bin_dir."""
+    env = dict(os.environ, CIMA_BUILD_ROOT=build_root)
+    for source in sources:
+        print(f"Building {os.path.relpath(source, REPO_DIR)} for all variants ...", flush=True)
+        cmd = [os.path.join(TESTS_DIR, "pipeline_unified.sh"), source, "--pass=all", f"--output-dir={bin_dir}"]
+        # The pipeline runs each binary once after linking; keep that quiet
+        result = subprocess.run(cmd + pipeline_args, cwd=TESTS_DIR, env=env, stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT, text=True)
+        if result.returncode != 0:
+            print(result.stdout)
+            sys.exit(f"Error: pipeline failed for {source}")
+
+
+def measure(bench, bin_dir, runs, json_path):
+    cmd = [bench, bin_dir, f"--runs={runs}", "--seed=1", f"--json={json_path}"]
+    if subprocess.run(cmd).returncode != 0:
+        sys.exit("Error: cima_bench failed")
+    with open(json_path) as f:
+        return json.load(f)
+
+
+def overheads(results, metrics):
+    """{test: {variant: {metric: {"overhead_pct", "ci95"}}}} from cima_bench JSON."""
+    table = {}
+    for binary in results["binaries"]:
+        if binary["variant"] == "none" or "overhead_pct" not in binary:
+            continue
+        entry = {}
+        for metric in metrics:
+            o = binary["overhead_pct"].get(metric)
+            if o and o["value"] is not None:
+                entry[metric] = {"overhead_pct": round(o["value"], 3),
+                                 "ci95": round(o["ci95"], 3) if o["ci95"] is not None else None}
+        if entry:
+            table.setdefault(binary["test"], {})[binary["variant"]] = entry
+    return table
+
+
+def failed_binaries(results):
+    """(test, variant, failed_runs) of binaries with runs that cima_bench counted as failed."""
+    return [(b["test"], b["variant"], b["failed_runs"]) for b in results["binaries"] if b.get("failed_runs")]
+
+
+def compare(baseline, current, metrics, tolerance):
+    """Rows of (test, variant, metric, base, cur, delta, bound, status)."""
+    rows = []
+    for test in sorted(set(baseline) | set(current)):
+        for variant in sorted(set(baseline.get(test, {})) | set(current.get(test, {}))):
+            for metric in metrics:
+                b = baseline.get(test, {}).get(variant, {}).get(metric)
+                c = current.get(test, {}).get(variant, {}).get(metric)
+                if not b and not c:
+                    continue  # metric not measured (no hardware counters)
+                if not b or not c:
+                    rows.append((test, variant, metric, b, c, None, None, "missing" if b else "new"))
+                    continue
+                delta = c["overhead_pct"] - b["overhead_pct"]
+                # Both overheads carry their own 95% interval; the difference
+                # is significant once it leaves the combined interval
+                bound = max(tolerance, math.hypot(b["ci95"] or 0.0, c["ci95"] or 0.0))
+                status = "ok"
+                if delta > bound:
+                    status = "REGRESSED"
+                elif delta < -bound:
+                    status = "improved"
+                rows.append((test, variant, metric, b, c, delta, bound, status))
+    return rows
+
+
+def print_rows(rows, verbose):
+    def pct(x):
+        return f"{x['overhead_pct']:+.2f}%" if x else "-"
+
+    header = f"{'Test':<22} {'Variant':<8} {'Metric':<14} {'Baseline':>10} {'Current':>10} {'Delta':>9} {'Bound':>8}  Status"
+    print(header)
+    print("-" * len(header))
+    for test, variant, metric, b, c, delta, bound, status in rows:
+        if not verbose and status in ("ok", "new"):
+            continue
+        d = f"{delta:+.2f}" if delta is not None else "-"
+        bd = f"{bound:.2f}" if bound is not None else "-"
+        print(f"{test:<22} {variant:<8} {metric:<14} {pct(b):>10} {pct(c):>10} {d:>9} {bd:>8}  {status}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fail when CIMA overhead regresses against the baseline.")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE, help="Baseline file (default: %(default)s)")
+    parser.add_argument("--update", action="store_true", help="Write the measurement as the new baseline")
+    parser.add_argument("--build-root", default=DEFAULT_BUILD_ROOT,
+                        help="CMake build directory with the plugins and cima_bench (default: %(default)s)")
+    parser.add_argument("--bench", help="cima_bench executable (default: <build-root>/bench/cima_bench)")
+    parser.add_argument("--work-dir", help="Directory for binaries and results (default: <build-root>/perf_check)")
+    parser.add_argument("--sources", default=",".join(DEFAULT_SOURCES),
+                        help="Comma-separated globs relative to tests/ (default: %(default)s)")
+    parser.add_argument("--pipeline-args", default="", help="Extra pipeline_unified.sh options")
+    parser.add_argument("--runs", type=int, default=10, help="cima_bench runs per binary (default: 10)")
+    parser.add_argument("--metrics", default=DEFAULT_METRICS, help="Overhead metrics to gate on (default: %(default)s)")
+    parser.add_argument("--tolerance", type=float, default=2.0,
+                        help="Overhead growth in percentage points always accepted (default: 2.0)")
+    parser.add_argument("--no-build", action="store_true", help="Measure the binaries already in the work directory")
+    parser.add_argument("--verbose", action="store_true", help="List unchanged benchmarks too")
+    args = parser.parse_args()
+
+    build_root = os.path.abspath(args.build_root)
+    bench = args.bench or os.path.join(build_root, "bench", "cima_bench")
+    work_dir = os.path.abspath(args.work_dir or os.path.join(build_root, "perf_check"))
+    bin_dir = os.path.join(work_dir, "bin")
+    metrics = args.metrics.split(",")
+    pipeline_args = args.pipeline_args.split()
+
+    baseline = None
+    if not args.update:
+        if not os.path.isfile(args.baseline):
+            sys.exit(f"Error: no baseline at {args.baseline}; create one with --update (make cima-perf-baseline)")
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("version") != BASELINE_VERSION:
+            sys.exit(f"Error: baseline version {baseline.get('version')} is not {BASELINE_VERSION}; "
+                     "regenerate it with --update")
+        if baseline.get("pipeline_args", []) != pipeline_args:
+            print(f"Warning: baseline was measured with pipeline options {baseline.get('pipeline_args')}")
+
+    sources = []
+    for pattern in args.sources.split(","):
+        sources += sorted(glob.glob(os.path.join(TESTS_DIR, pattern)))
+    if not sources:
+        sys.exit("Error: no benchmark sources matched")
+
+    if not args.no_build:
+        # Start clean so binaries of removed benchmarks are not measured
+        shutil.rmtree(bin_dir, ignore_errors=True)
+        os.makedirs(bin_dir)
+        build_suite(sources, build_root, bin_dir, pipeline_args)
+
+    results = measure(bench, bin_dir, args.runs, os.path.join(work_dir, "results.json"))
+    current = overheads(results, metrics)
+    # A crashing variant's truncated runs say nothing about its overhead
+    failed = failed_binaries(results)
+    for test, variant, count in failed:
+        print(f"Error: {test} ({variant}): {count} run(s) failed")
+    if failed and args.update:
+        sys.exit("Error: not recording a baseline with failed runs")
+
+    if args.update:
+        os.makedirs(os.path.dirname(os.path.abspath(args.baseline)), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump({
+                "version": BASELINE_VERSION,
+                "created": datetime.date.today().isoformat(),
+                "commit": git_commit(),
+                "host": {"machine": platform.machine(), "system": platform.system(), "cpus": os.cpu_count()},
+                "runs": args.runs,
+                "pipeline_args": pipeline_args,
+                "metrics": metrics,
+                "results": current,
+            }, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print(f"Baseline written to {args.baseline}")
+        return
+
+    rows = compare(baseline["results"], current, metrics, args.tolerance)
+    print_rows(rows, args.verbose)
+    regressions = [r for r in rows if r[7] == "REGRESSED"]
+    improved = [r for r in rows if r[7] == "improved"]
+    # A baseline entry without a measurement is a variant that stopped
+    # building or producing results
+    missing = [r for r in rows if r[7] == "missing"]
+    print(f"{len(regressions)} regressed, {len(missing)} missing, {len(improved)} improved, "
+          f"{sum(1 for r in rows if r[7] == 'ok')} unchanged (tolerance {args.tolerance} pp)")
+    failing = regressions or missing or failed
+    if improved and not failing:
+        print("Overhead improved; refresh the baseline with make cima-perf-baseline")
+    sys.exit(1 if failing else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+// perf_counters.h - perf_event_open counter group shared by cima_bench and
+// the fork server linked into benchmark binaries. Plain C so it can be used
+// from both.
+#ifndef CIMA_PERF_COUNTERS_H
+#define CIMA_PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+// Counters collected for every run. Hardware counters share one group so
+// they are scheduled together; any the machine lacks are reported as NAN.
+struct perf_counter_spec {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+#define PERF_CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct perf_counter_spec perf_counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses", PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+#define PERF_NUM_COUNTERS (sizeof(perf_counters) / sizeof(perf_counters[0]))
+
+static inline uint64_t perf_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Open the counter group on pid (0: the calling process), one fd per entry
+// of perf_counters; counters not wanted or not supported get fd -1. The
+// group starts disabled: it is enabled either by the kernel when pid execs
+// (enable_on_exec) or by perf_counters_enable().
+static inline void perf_counters_open(pid_t pid, const bool* wanted, bool enable_on_exec, int* fds) {
+    int leader = -1;
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+        fds[i] = -1;
+        if (!wanted[i]) continue;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_counters[i].type;
+        attr.config = perf_counters[i].config;
+        attr.disabled = leader == -1;
+        attr.enable_on_exec = leader == -1 && enable_on_exec;
+        attr.inherit = 1;  // include threads and children of the benchmark
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, pid, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) continue;
+        if (leader == -1) leader = fd;
+        fds[i] = fd;
+    }
+}
+
+static inline int perf_counters_leader(const int* fds) {
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (fds[i] >= 0) return fds[i];
+    }
+    return -1;
+}
+
+static inline void perf_counters_enable(const int* fds) {
+    int leader = perf_counters_leader(fds);
+    if (leader >= 0) ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+static inline void perf_counters_disable(const int* fds) {
+    int leader = perf_counters_leader(fds);
+    if (leader >= 0) ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// Read every counter into values, scaled for multiplexing; NAN for
+// counters that were not opened or never ran
+static inline void perf_counters_read(const int* fds, double* values) {
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+        uint64_t data[3];
+        values[i] = NAN;
+        if (fds[i] < 0) continue;
+        if (read(fds[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) continue;
+        values[i] = (double)data[0];
+        if (data[2] < data[1]) values[i] *= (double)data[1] / (double)data[2];
+    }
+}
+
+static inline void perf_counters_close(int* fds) {
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+        fds[i] = -1;
+    }
+}
+
+// Probe which counters this machine/kernel lets us open
+static inline void perf_counters_probe(bool* available) {
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+        bool one[PERF_NUM_COUNTERS];
+        int fds[PERF_NUM_COUNTERS];
+        memset(one, 0, sizeof(one));
+        one[i] = true;
+        perf_counters_open(0, one, false, fds);
+        available[i] = fds[i] >= 0;
+        perf_counters_close(fds);
+    }
+}
+
+// Fork server protocol (see cima_forkserver.c). The harness starts the
+// benchmark once with CIMA_FORKSERVER set and these two descriptors open;
+// the server answers FORKSERVER_HELLO once it is parked before main, then
+// one result per command byte.
+#define FORKSERVER_CMD_FD 198
+#define FORKSERVER_RESULT_FD 199
+#define FORKSERVER_HELLO 0x43494d41u  // "CIMA"
+#define FORKSERVER_RUN 'R'            // fork a child that runs main()
+#define FORKSERVER_ENTRY 'E'          // call cima_bench_entry() in-process
+
+struct forkserver_result {
+    int32_t status;  // wait status of the run; exit code for ENTRY, -1 on failure
+    int32_t reserved;
+    uint64_t wall_ns;
+    double counters[PERF_NUM_COUNTERS];
+    double peak_rss_kb;  // ru_maxrss of the forked run; NAN for ENTRY
+};
+
+#endif  // CIMA_PERF_COUNTERS_H
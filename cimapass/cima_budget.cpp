@@ -0,0 +1,257 @@
+#include "cima_budget.h"
+
+#include <string>
+#include <vector>
+
+#include "cima_policy.h"
+#include "cima_timing.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace cima {
+
+static cl::opt<double> OverheadBudget(
+    "cima-overhead-budget",
+    cl::desc("Predicted whole-program run-time overhead, in percent; cima-budget downgrades "
+             "the functions where that saves the most until the prediction fits "
+             "(default: 0, no budget)"),
+    cl::init(0));
+
+static cl::opt<std::string> BudgetReportFile(
+    "cima-budget-report-file",
+    cl::desc("File cima-budget writes its JSON report to (default: none)"), cl::init(""));
+
+namespace {
+
+// Dynamic instructions a lowering adds per checked access, and per value
+// the tainted pass propagates a taint for, on the path a passing check
+// takes. Recovery code and the PHIs joining it cost nothing until a check
+// fails. Rough counts from the IR the passes emit;
+// bench/overhead_report.py shows what they add to a given program
+struct LoweringCost {
+    Policy P;
+    double PerAccess;
+    double PerValue;
+};
+
+constexpr LoweringCost LoweringCosts[] = {
+    {Policy::None, 0, 0},
+    // Shadow address, shadow load, compare and branch
+    {Policy::Asan, 6, 0},
+    // The same check; the failing edge only joins the access again
+    {Policy::Base, 6, 0},
+    {Policy::Native, 6, 0},
+    {Policy::Nearest, 6, 0},
+    // Shadow alloca loads and stores beside the access, an OR per value
+    {Policy::Tainted, 11, 1},
+};
+
+const LoweringCost& getLoweringCost(Policy P) {
+    for (const LoweringCost& C : LoweringCosts) {
+        if (C.P == P) return C;
+    }
+    llvm_unreachable("no cost for CIMA policy");
+}
+
+// The next weaker protection level; Asan is the floor
+Policy downgrade(Policy P) {
+    switch (P) {
+        case Policy::Tainted:
+            return Policy::Nearest;
+        case Policy::Nearest:
+            return Policy::Base;
+        default:
+            return Policy::Asan;
+    }
+}
+
+// Frequency-weighted instruction counts of one call of a function
+struct FunctionCost {
+    double Instructions = 0;
+    double Accesses = 0;
+    double Values = 0;
+
+    double added(Policy P) const {
+        const LoweringCost& C = getLoweringCost(P);
+        return Accesses * C.PerAccess + Values * C.PerValue;
+    }
+
+    // Predicted overhead of P in percent of the uninstrumented function
+    double overhead(Policy P) const {
+        return Instructions > 0 ? 100 * added(P) / Instructions : 0;
+    }
+};
+
+// Accesses ASan checks: everything but direct accesses to local variables,
+// which it proves in bounds
+bool isCheckedAccess(const Instruction& I) {
+    const Value* Ptr = nullptr;
+    if (const auto* LI = dyn_cast<LoadInst>(&I)) {
+        Ptr = LI->getPointerOperand();
+    } else if (const auto* SI = dyn_cast<StoreInst>(&I)) {
+        Ptr = SI->getPointerOperand();
+    } else if (const auto* RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        Ptr = RMW->getPointerOperand();
+    } else if (const auto* CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        Ptr = CX->getPointerOperand();
+    } else {
+        return isa<MemIntrinsic>(I);
+    }
+    return !isa<AllocaInst>(Ptr->stripInBoundsConstantOffsets());
+}
+
+FunctionCost estimateCost(const Function& F, const BlockFrequencyInfo& BFI) {
+    FunctionCost C;
+    for (const BasicBlock& BB : F) {
+        double Freq = BFI.getBlockFreqRelativeToEntryBlock(&BB);
+        for (const Instruction& I : BB) {
+            if (isa<PHINode>(I) || I.isDebugOrPseudoInst()) continue;
+            C.Instructions += Freq;
+            if (isCheckedAccess(I)) C.Accesses += Freq;
+            if (!I.getType()->isVoidTy()) C.Values += Freq;
+        }
+    }
+    return C;
+}
+
+struct Decision {
+    Function* F;
+    Policy Requested;
+    Policy Chosen;
+    FunctionCost Cost;
+    // Calls per run, from a PGO entry count; 1 without one
+    double Weight;
+};
+
+// Predicted overhead of the program in percent, with every function
+// weighted by its PGO entry count, or equally without one
+double predictedOverhead(ArrayRef<Decision> Decisions) {
+    double Added = 0, Instructions = 0;
+    for (const Decision& D : Decisions) {
+        Added += D.Weight * D.Cost.added(D.Chosen);
+        Instructions += D.Weight * D.Cost.Instructions;
+    }
+    return Instructions > 0 ? 100 * Added / Instructions : 0;
+}
+
+void writeReport(const Module& M, ArrayRef<Decision> Decisions, double Predicted) {
+    std::error_code EC;
+    raw_fd_ostream OS(BudgetReportFile, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << "CIMA: cannot write budget report to " << BudgetReportFile << ": "
+               << EC.message() << "\n";
+        return;
+    }
+
+    json::OStream J(OS, 2);
+    J.object([&] {
+        J.attribute("module", M.getModuleIdentifier());
+        J.attribute("budget", OverheadBudget.getValue());
+        J.attribute("predicted", Predicted);
+        J.attributeArray("functions", [&] {
+            for (const Decision& D : Decisions) {
+                J.object([&] {
+                    J.attribute("name", D.F->getName());
+                    J.attribute("requested", policyName(D.Requested));
+                    J.attribute("chosen", policyName(D.Chosen));
+                    J.attribute("requested_overhead", D.Cost.overhead(D.Requested));
+                    J.attribute("predicted_overhead", D.Cost.overhead(D.Chosen));
+                    J.attribute("weight", D.Weight);
+                });
+            }
+        });
+    });
+    OS << "\n";
+}
+
+struct CIMABudget : public PassInfoMixin<CIMABudget> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+        if (OverheadBudget <= 0) return PreservedAnalyses::all();
+        PhaseTimer Timer("budget", "CIMA: fit policies to the overhead budget");
+        FunctionAnalysisManager& FAM =
+            MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+        std::vector<Decision> Decisions;
+        for (Function& F : M) {
+            if (F.isDeclaration() || !F.hasFnAttribute(Attribute::SanitizeAddress)) continue;
+            // A budget pinned by an earlier run must not cap this one
+            F.removeFnAttr(BudgetPolicyAttr);
+            Policy Requested = getFunctionPolicy(F, Policy::Base);
+            if (Requested == Policy::None) continue;
+
+            FunctionCost Cost = estimateCost(F, FAM.getResult<BlockFrequencyAnalysis>(F));
+            double Weight = 1;
+            if (auto Count = F.getEntryCount()) Weight = Count->getCount();
+            Decisions.push_back({&F, Requested, Requested, Cost, Weight});
+        }
+
+        // The budget is for the program as a whole: step down one level at a
+        // time where that saves the most weighted overhead. Each step costs
+        // one level of protection, so that is the cheapest step per percent
+        // saved, and hot functions go first. Steps that save nothing, such as
+        // base to asan, are never taken
+        double Predicted = predictedOverhead(Decisions);
+        while (Predicted > OverheadBudget) {
+            Decision* Best = nullptr;
+            double BestSaving = 0;
+            for (Decision& D : Decisions) {
+                double Saving =
+                    D.Weight * (D.Cost.added(D.Chosen) - D.Cost.added(downgrade(D.Chosen)));
+                if (Saving > BestSaving) {
+                    Best = &D;
+                    BestSaving = Saving;
+                }
+            }
+            if (!Best) break;
+            Best->Chosen = downgrade(Best->Chosen);
+            Predicted = predictedOverhead(Decisions);
+        }
+
+        unsigned Downgraded = 0;
+        for (const Decision& D : Decisions) {
+            D.F->addFnAttr(BudgetPolicyAttr, policyName(D.Chosen));
+            if (D.Chosen == D.Requested) continue;
+            ++Downgraded;
+            errs() << "CIMA: " << D.F->getName() << " downgraded " << policyName(D.Requested)
+                   << " -> " << policyName(D.Chosen)
+                   << format(" (predicted %.1f%% -> %.1f%%)", D.Cost.overhead(D.Requested),
+                             D.Cost.overhead(D.Chosen))
+                   << "\n";
+        }
+        if (Predicted > OverheadBudget) {
+            errs() << format("CIMA: no further downgrade lowers the predicted %.1f%%", Predicted)
+                   << "\n";
+        }
+        errs() << format("CIMA: overhead budget %.1f%%: predicted %.1f%%, ",
+                         OverheadBudget.getValue(), Predicted)
+               << Downgraded << " of " << Decisions.size() << " functions downgraded\n";
+
+        if (!BudgetReportFile.empty()) writeReport(M, Decisions, Predicted);
+        return Decisions.empty() ? PreservedAnalyses::all() : PreservedAnalyses::none();
+    }
+};
+
+}  // namespace
+
+void registerBudget(PassBuilder& PB) {
+    PB.registerPipelineParsingCallback(
+        [](StringRef Name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+            if (Name == "cima-budget") {
+                MPM.addPass(CIMABudget());
+                return true;
+            }
+            return false;
+        });
+}
+
+}  // namespace cima
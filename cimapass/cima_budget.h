@@ -0,0 +1,22 @@
+#ifndef CIMA_BUDGET_H
+#define CIMA_BUDGET_H
+
+#include "llvm/Passes/PassBuilder.h"
+
+namespace cima {
+
+// Register the "cima-budget" module pass, which runs before ASan and
+// cima-policy-prepare. With -cima-overhead-budget=<percent> it predicts the
+// program's overhead under the requested policies from block frequencies,
+// PGO entry counts and per-lowering costs of the passing path. While the
+// prediction is over the budget, it steps down the function where one level
+// (tainted > nearest > base > asan; native > asan) saves the most, skipping
+// steps that save nothing. The choice is pinned in a "cima-budget-policy"
+// function attribute that getFunctionPolicy prefers over every other
+// source. What was downgraded, and the predicted overheads, go to stderr
+// and to -cima-budget-report-file as JSON.
+void registerBudget(llvm::PassBuilder& PB);
+
+}  // namespace cima
+
+#endif  // CIMA_BUDGET_H
@@ -0,0 +1,84 @@
+#include "cima_callbacks.h"
+
+#include <vector>
+
+#include "cima_timing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#define DEBUG_TYPE "cima-callbacks"
+
+using namespace llvm;
+
+STATISTIC(NumCallbacksExpanded, "ASan callbacks rewritten into inline checks");
+
+namespace cima {
+
+bool expandAsanCallbacks(Function& F, DominatorTree& DT, LoopInfo& LI) {
+    PhaseTimer Timer("expand-callbacks", "CIMA: expand ASan callbacks");
+    static const Regex Callback("^__asan_(load|store)(1|2|4|8|16|N)(_noabort)?$");
+
+    std::vector<std::pair<CallInst*, SmallVector<StringRef, 4>>> Sites;
+    for (auto& BB : F) {
+        for (auto& I : BB) {
+            auto* CI = dyn_cast<CallInst>(&I);
+            if (!CI || !CI->getCalledFunction()) continue;
+            SmallVector<StringRef, 4> Matches;
+            if (Callback.match(CI->getCalledFunction()->getName(), &Matches)) {
+                Sites.push_back({CI, Matches});
+            }
+        }
+    }
+    if (Sites.empty()) return false;
+
+    Module& M = *F.getParent();
+    LLVMContext& Ctx = F.getContext();
+    // Batched: eager updates cost a dominator tree walk per callback, which
+    // is quadratic in functions past the call threshold
+    DomTreeUpdater DTU(DT, DomTreeUpdater::UpdateStrategy::Lazy);
+    MDNode* Unlikely = MDBuilder(Ctx).createUnlikelyBranchWeights();
+
+    // Back to front, so each split only moves the code up to the next callback
+    for (auto& [CI, Matches] : llvm::reverse(Sites)) {
+        StringRef Kind = Matches[1];
+        StringRef Size = Matches[2];
+        bool NoAbort = !Matches[3].empty();
+
+        SmallVector<Value*, 2> Args(CI->args());
+        SmallVector<Type*, 2> ArgTys;
+        for (Value* Arg : Args) ArgTys.push_back(Arg->getType());
+
+        // __cima_load4(addr) / __cima_loadN(addr, size) return true when the
+        // whole access is addressable
+        AttributeList CheckAttrs = AttributeList().addRetAttribute(Ctx, Attribute::ZExt);
+        FunctionCallee CheckFn =
+            M.getOrInsertFunction(("__cima_" + Kind + Size).str(),
+                                  FunctionType::get(Type::getInt1Ty(Ctx), ArgTys, false),
+                                  CheckAttrs);
+        std::string ReportName = ("__asan_report_" + Kind).str();
+        ReportName += Size == "N" ? "_n" : Size.str();
+        if (NoAbort) ReportName += "_noabort";
+        FunctionCallee ReportFn = M.getOrInsertFunction(
+            ReportName, FunctionType::get(Type::getVoidTy(Ctx), ArgTys, false));
+
+        IRBuilder<> B(CI);
+        Value* Ok = B.CreateCall(CheckFn, Args, "cima.cb.ok");
+        Instruction* CrashTerm = SplitBlockAndInsertIfThen(B.CreateNot(Ok), CI, !NoAbort,
+                                                           Unlikely, &DTU, &LI);
+        B.SetInsertPoint(CrashTerm);
+        B.CreateCall(ReportFn, Args);
+
+        CI->eraseFromParent();
+    }
+    NumCallbacksExpanded += Sites.size();
+
+    return true;
+}
+
+}  // namespace cima
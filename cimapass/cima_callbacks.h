@@ -0,0 +1,20 @@
+#ifndef CIMA_CALLBACKS_H
+#define CIMA_CALLBACKS_H
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+
+namespace cima {
+
+// Rewrite ASan's out-of-line __asan_{load,store}{1,2,4,8,16,N}[_noabort]
+// callbacks (emitted once a function exceeds
+// -asan-instrumentation-with-call-threshold) into the inline shape the
+// passes recover from: a call to the matching __cima_* validity check from
+// cima_runtime, a branch on its result, and a cold block reporting through
+// __asan_report_*. Returns true if changed.
+bool expandAsanCallbacks(llvm::Function& F, llvm::DominatorTree& DT, llvm::LoopInfo& LI);
+
+}  // namespace cima
+
+#endif  // CIMA_CALLBACKS_H
@@ -0,0 +1,266 @@
+#include "cima_check_sites.h"
+
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Regex.h"
+
+#define DEBUG_TYPE "cima-check-sites"
+
+using namespace llvm;
+
+STATISTIC(NumCheckSites, "ASan check sites found");
+STATISTIC(NumUnmatchedChecks, "ASan checks whose access could not be found");
+STATISTIC(NumUbsanSites, "UBSan bounds and object-size check sites found");
+
+namespace cima {
+
+AnalysisKey CheckSiteAnalysis::Key;
+
+// The handler call of a UBSan bounds or object-size check block, if BB is one
+static CallInst* getUbsanHandler(BasicBlock* BB) {
+    static const Regex HandlerName(
+        "^__ubsan_handle_(out_of_bounds|type_mismatch_v1)(_abort|_minimal|_minimal_abort)?$");
+    for (Instruction& I : *BB) {
+        auto* CI = dyn_cast<CallInst>(&I);
+        if (CI && CI->getCalledFunction() &&
+            HandlerName.match(CI->getCalledFunction()->getName())) {
+            return CI;
+        }
+    }
+    return nullptr;
+}
+
+// Type of the memory an access reads or writes; nullptr for other
+// instructions
+static Type* getAccessType(const Instruction& I) {
+    if (const auto* SI = dyn_cast<StoreInst>(&I)) return SI->getValueOperand()->getType();
+    if (const auto* CX = dyn_cast<AtomicCmpXchgInst>(&I)) return CX->getCompareOperand()->getType();
+    if (isa<LoadInst>(I) || isa<AtomicRMWInst>(I)) return I.getType();
+    return nullptr;
+}
+
+// True when no value computed on Chain ahead of Access is used past it,
+// except in the handler blocks of the checks along the way
+static bool staysUnderCheck(ArrayRef<BasicBlock*> Chain,
+                            const SmallPtrSetImpl<BasicBlock*>& Handlers, Instruction* Access) {
+    for (BasicBlock* BB : Chain) {
+        for (Instruction& I : *BB) {
+            if (&I == Access) break;
+            for (User* U : I.users()) {
+                auto* UserInst = cast<Instruction>(U);
+                BasicBlock* UserBB = UserInst->getParent();
+                if (Handlers.contains(UserBB)) continue;
+                if (UserBB != Access->getParent() && is_contained(Chain, UserBB)) continue;
+                if (UserBB == Access->getParent() &&
+                    (UserInst == Access || UserInst->comesBefore(Access))) {
+                    continue;
+                }
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The access a UBSan check in CheckBB guards, and nullptr with a Reason when
+// it cannot be recovered. Unlike ASan's, the check is emitted ahead of the
+// address computation: the passing successor computes the address, may
+// check further indices (a[i][j]), then accesses it. Skipping all of that on
+// the failing edge is only sound if nothing computed on the way is used
+// after the access and the way is entered through the checks alone; a
+// read-modify-write (a[i]++) is therefore guarded up to its store
+static Instruction* findUbsanCheckedAccess(BasicBlock* CheckBB, BasicBlock* CrashBB,
+                                           BasicBlock* SafeBB, StringRef& Reason) {
+    SmallVector<BasicBlock*, 4> Chain;
+    SmallPtrSet<BasicBlock*, 8> Handlers = {CrashBB};
+    Instruction* Access = nullptr;
+    BasicBlock* Prev = CheckBB;
+    for (BasicBlock* BB = SafeBB;;) {
+        for (BasicBlock* Pred : predecessors(BB)) {
+            if (Pred != Prev && !Handlers.contains(Pred)) {
+                Reason = "checked code is reachable around the check";
+                return nullptr;
+            }
+        }
+        Chain.push_back(BB);
+        for (Instruction& I : *BB) {
+            if (getAccessType(I)) {
+                Access = &I;
+                break;
+            }
+        }
+        if (Access) break;
+
+        auto* BI = dyn_cast<BranchInst>(BB->getTerminator());
+        BasicBlock* Handler = nullptr;
+        if (BI && BI->isConditional()) {
+            unsigned HandlerIdx = getUbsanHandler(BI->getSuccessor(0)) ? 0 : 1;
+            if (getUbsanHandler(BI->getSuccessor(HandlerIdx))) {
+                Handler = BI->getSuccessor(HandlerIdx);
+                BB = BI->getSuccessor(1 - HandlerIdx);
+            }
+        }
+        if (!Handler || is_contained(Chain, BB)) {
+            Reason = "no memory access after the check";
+            return nullptr;
+        }
+        Handlers.insert(Handler);
+        Prev = Chain.back();
+    }
+
+    // Later accesses of the block, up to the next call, are candidates too
+    for (Instruction* I = Access; I && !I->isTerminator(); I = I->getNextNode()) {
+        if (I != Access && isa<CallBase>(I) && !isa<DbgInfoIntrinsic>(I)) break;
+        if (getAccessType(*I) && staysUnderCheck(Chain, Handlers, I)) return I;
+    }
+    Reason = "a value computed under the check is used after the access";
+    return nullptr;
+}
+
+static void findUbsanSites(CallInst* Handler, CheckSites& Result) {
+    BasicBlock* CrashBB = Handler->getParent();
+    for (BasicBlock* CheckBB : predecessors(CrashBB)) {
+        auto* BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
+        if (!BI || !BI->isConditional() || BI->getSuccessor(0) == BI->getSuccessor(1)) {
+            Result.Unmatched.push_back({Handler, "handler not reached by a branch"});
+            continue;
+        }
+        unsigned CrashSuccIdx = BI->getSuccessor(0) == CrashBB ? 0 : 1;
+
+        StringRef Reason;
+        Instruction* Access =
+            findUbsanCheckedAccess(CheckBB, CrashBB, BI->getSuccessor(1 - CrashSuccIdx), Reason);
+        if (!Access) {
+            Result.Unmatched.push_back({Handler, Reason});
+            continue;
+        }
+
+        const DataLayout& DL = Access->getModule()->getDataLayout();
+        TypeSize Size = DL.getTypeStoreSize(getAccessType(*Access));
+        if (Size.isScalable()) {
+            Result.Unmatched.push_back({Handler, "scalable vector access"});
+            continue;
+        }
+
+        Result.SitesByAccess[Access].push_back(Result.Sites.size());
+        Result.Sites.push_back({Handler, BI, CrashSuccIdx, Access, Size.getFixedValue(),
+                                !isa<LoadInst>(Access), /*HasShadow=*/false});
+        ++NumUbsanSites;
+    }
+}
+
+CheckSites CheckSiteAnalysis::run(Function& F, FunctionAnalysisManager&) {
+    PhaseTimer Timer("check-sites", "CIMA: find ASan check sites");
+    static const Regex ReportName("^__asan_report_(load|store)(1|2|4|8|16|_n)(_noabort)?$");
+
+    CheckSites Result;
+    for (auto& BB : F) {
+        for (auto& I : BB) {
+            auto* Report = dyn_cast<CallInst>(&I);
+            if (!Report || !Report->getCalledFunction()) continue;
+            StringRef Name = Report->getCalledFunction()->getName();
+            if (Name.starts_with("__ubsan_handle_")) {
+                if (getUbsanHandler(&BB) == Report) findUbsanSites(Report, Result);
+                continue;
+            }
+            SmallVector<StringRef, 4> Matches;
+            if (!ReportName.match(Name, &Matches)) {
+                if (Name.starts_with("__asan_report")) {
+                    Result.Unmatched.push_back({Report, "unsupported report kind"});
+                }
+                continue;
+            }
+
+            uint64_t AccessSize = 0;
+            if (Matches[2] != "_n") Matches[2].getAsInteger(10, AccessSize);
+
+            BasicBlock* CrashBB = Report->getParent();
+            for (BasicBlock* CheckBB : predecessors(CrashBB)) {
+                auto* BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
+                // A check branching to the same crash block twice guards nothing
+                if (!BI || !BI->isConditional() || BI->getSuccessor(0) == BI->getSuccessor(1)) {
+                    Result.Unmatched.push_back({Report, "crash block not reached by a branch"});
+                    continue;
+                }
+                unsigned CrashSuccIdx = BI->getSuccessor(0) == CrashBB ? 0 : 1;
+
+                Instruction* Access = findCheckedAccess(BI->getSuccessor(1 - CrashSuccIdx));
+                if (!Access) {
+                    Result.Unmatched.push_back({Report, "no memory access after the check"});
+                    continue;
+                }
+                if (Access->isTerminator()) {
+                    Result.Unmatched.push_back({Report, "checked access is a terminator"});
+                    continue;
+                }
+
+                Result.SitesByAccess[Access].push_back(Result.Sites.size());
+                Result.Sites.push_back(
+                    {Report, BI, CrashSuccIdx, Access, AccessSize, Matches[1] == "store"});
+            }
+        }
+    }
+    NumCheckSites += Result.Sites.size();
+    NumUnmatchedChecks += Result.Unmatched.size();
+    return Result;
+}
+
+void redirectCrashEdge(const CheckSite& Site, BasicBlock* NewSucc, ArrayRef<BasicBlock*> NewBlocks,
+                       DomTreeUpdater& DTU, LoopInfo& LI) {
+    BasicBlock* CheckBB = Site.checkBlock();
+    BasicBlock* CrashBB = Site.crashBlock();
+
+    SmallVector<DominatorTree::UpdateType, 8> Updates;
+    Loop* L = LI.getLoopFor(CheckBB);
+    for (BasicBlock* BB : NewBlocks) {
+        if (L) L->addBasicBlockToLoop(BB, LI);
+        for (BasicBlock* Succ : successors(BB)) {
+            Updates.push_back({DominatorTree::Insert, BB, Succ});
+        }
+    }
+
+    Site.Branch->setSuccessor(Site.CrashSuccIdx, NewSucc);
+    Updates.push_back({DominatorTree::Insert, CheckBB, NewSucc});
+    Updates.push_back({DominatorTree::Delete, CheckBB, CrashBB});
+    DTU.applyUpdates(Updates);
+
+    if (pred_empty(CrashBB)) LI.removeBlock(CrashBB);
+}
+
+void remarkRecovered(OptimizationRemarkEmitter& ORE, const char* PassName, const CheckSite& Site,
+                     StringRef How) {
+    ORE.emit([&] {
+        OptimizationRemark R(PassName, "Recovered", Site.Access);
+        R << "recovered failing ";
+        if (Site.AccessSize) {
+            R << ore::NV("Size", Site.AccessSize) << "-byte ";
+        } else {
+            R << "variable-size ";
+        }
+        return R << (Site.IsWrite ? "write" : "read") << ": " << ore::NV("Recovery", How);
+    });
+}
+
+void remarkUnmatched(OptimizationRemarkEmitter& ORE, const char* PassName,
+                     const CheckSites& Sites) {
+    for (const UnmatchedCheck& U : Sites.Unmatched) {
+        ORE.emit([&] {
+            bool Ubsan = U.Report->getCalledFunction()->getName().starts_with("__ubsan_");
+            return OptimizationRemarkMissed(PassName, "NotRecovered", U.Report)
+                   << (Ubsan ? "UBSan check still reports: " : "ASan check still aborts: ")
+                   << ore::NV("Reason", U.Reason);
+        });
+    }
+}
+
+void registerCheckSiteAnalysis(PassBuilder& PB) {
+    PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager& FAM) {
+        FAM.registerPass([] { return CheckSiteAnalysis(); });
+    });
+}
+
+}  // namespace cima
@@ -0,0 +1,98 @@
+#ifndef CIMA_CHECK_SITES_H
+#define CIMA_CHECK_SITES_H
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+namespace cima {
+
+// One ASan check guarding a memory access: Branch jumps to the block calling
+// Report when the access is not addressable and towards Access otherwise.
+// UBSan's bounds and object-size checks (-fsanitize=bounds,object-size) are
+// sites too, with the __ubsan_handle_* call as Report
+struct CheckSite {
+    llvm::CallInst* Report;
+    llvm::BranchInst* Branch;
+    unsigned CrashSuccIdx;
+    llvm::Instruction* Access;
+    uint64_t AccessSize;  // Bytes; 0 for __asan_report_*_n, whose size is an operand
+    bool IsWrite;
+    // False for UBSan checks: the module may run without ASan, so neither
+    // the shadow-based recoveries (masked lanes, nearest valid) nor Report's
+    // operands as an address apply
+    bool HasShadow = true;
+
+    llvm::BasicBlock* checkBlock() const { return Branch->getParent(); }
+    llvm::BasicBlock* crashBlock() const { return Branch->getSuccessor(CrashSuccIdx); }
+    llvm::BasicBlock* safeBlock() const { return Branch->getSuccessor(1 - CrashSuccIdx); }
+
+    // The access size as an i64 value
+    llvm::Value* getAccessSize(llvm::IRBuilder<>& B) const {
+        return AccessSize ? B.getInt64(AccessSize) : Report->getArgOperand(1);
+    }
+};
+
+// An __asan_report_* call, reached from one of its predecessors, that no
+// pass can recover from
+struct UnmatchedCheck {
+    llvm::CallInst* Report;
+    llvm::StringRef Reason;
+};
+
+// Every check site of a function in program order. ASan guards unaligned and
+// partial-granule accesses with more than one check, so one access can own
+// several sites; SitesByAccess lists them all
+struct CheckSites {
+    std::vector<CheckSite> Sites;
+    llvm::DenseMap<llvm::Instruction*, llvm::SmallVector<unsigned, 2>> SitesByAccess;
+    std::vector<UnmatchedCheck> Unmatched;
+
+    bool empty() const { return Sites.empty(); }
+};
+
+// Finds ASan's check sites once per function so the recovery passes share
+// one scan. The result points into the IR: it stays valid only until the
+// checks are rewritten, and passes that do so must not preserve it
+class CheckSiteAnalysis : public llvm::AnalysisInfoMixin<CheckSiteAnalysis> {
+    friend llvm::AnalysisInfoMixin<CheckSiteAnalysis>;
+    static llvm::AnalysisKey Key;
+
+public:
+    using Result = CheckSites;
+    Result run(llvm::Function& F, llvm::FunctionAnalysisManager& FAM);
+};
+
+// Point Site's failing edge at NewSucc instead of the crash block. NewBlocks
+// are the recovery blocks created for the site; they join the check's loop
+// and their outgoing edges are recorded in DTU along with the redirect, so
+// the dominator tree and loop info stay valid. A crash block left without
+// predecessors is dropped from LI
+void redirectCrashEdge(const CheckSite& Site, llvm::BasicBlock* NewSucc,
+                       llvm::ArrayRef<llvm::BasicBlock*> NewBlocks, llvm::DomTreeUpdater& DTU,
+                       llvm::LoopInfo& LI);
+
+// Optimization remarks under PassName: a passed remark naming How a site is
+// recovered ("undef", "nearest valid", ...), and a missed remark for every
+// check left aborting
+void remarkRecovered(llvm::OptimizationRemarkEmitter& ORE, const char* PassName,
+                     const CheckSite& Site, llvm::StringRef How);
+void remarkUnmatched(llvm::OptimizationRemarkEmitter& ORE, const char* PassName,
+                     const CheckSites& Sites);
+
+// Register CheckSiteAnalysis with the function analysis manager
+void registerCheckSiteAnalysis(llvm::PassBuilder& PB);
+
+}  // namespace cima
+
+#endif  // CIMA_CHECK_SITES_H
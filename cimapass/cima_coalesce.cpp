@@ -0,0 +1,373 @@
+#include "cima_coalesce.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#define DEBUG_TYPE "cima-coalesce"
+
+using namespace llvm;
+
+STATISTIC(NumGroups, "Coalesced check groups");
+STATISTIC(NumCoalescedChecks, "ASan checks guarded by a coalesced check");
+
+namespace cima {
+
+cl::opt<bool> CoalesceChecks(
+    "cima-coalesce-checks",
+    cl::desc("Guard ASan checks of adjacent accesses with one wide shadow-range check"),
+    cl::init(false));
+
+static cl::opt<unsigned> CoalesceMaxSpan(
+    "cima-coalesce-max-span",
+    cl::desc("Maximum number of bytes covered by one coalesced shadow check"),
+    cl::init(32));
+
+namespace {
+
+// An inline ASan check protecting exactly one load or store
+struct CheckSite {
+    Instruction* SliceStart;  // first instruction of the shadow test
+    BasicBlock* SafeBB;       // successor holding the protected access
+    Instruction* MemInst;
+    Value* Base;
+    int64_t Offset;
+    uint64_t Size;
+};
+
+// Only fixed-size reports map one check to one access; _n and exp variants don't
+bool isFixedSizeAsanReport(StringRef Name) {
+    static const Regex FixedSizeReport("^__asan_report_(load|store)(1|2|4|8|16)(_noabort)?$");
+    return FixedSizeReport.match(Name);
+}
+
+// Instructions that could change shadow memory between two grouped accesses
+bool mayChangeShadow(const Instruction& I) {
+    if (const auto* II = dyn_cast<IntrinsicInst>(&I)) return II->mayWriteToMemory();
+    if (isa<CallBase>(&I)) return true;
+    if (const auto* SI = dyn_cast<StoreInst>(&I))
+        return isa<IntToPtrInst>(SI->getPointerOperand());
+    return false;
+}
+
+bool rangeMayChangeShadow(BasicBlock::iterator Begin, BasicBlock::iterator End) {
+    for (auto It = Begin; It != End; ++It) {
+        if (mayChangeShadow(*It)) return true;
+    }
+    return false;
+}
+
+// Collect the in-block computation of HeadBB's branch condition. The check is
+// only movable if it forms a contiguous tail of the block that nothing outside
+// the check blocks uses.
+Instruction* findCheckSlice(BasicBlock* HeadBB, Value* Cond, Value* Ptr,
+                            const SmallPtrSetImpl<BasicBlock*>& CheckBlocks) {
+    SmallPtrSet<Instruction*, 8> Slice;
+    std::vector<Instruction*> Worklist;
+    if (auto* CondI = dyn_cast<Instruction>(Cond)) Worklist.push_back(CondI);
+
+    while (!Worklist.empty()) {
+        Instruction* I = Worklist.back();
+        Worklist.pop_back();
+        if (I->getParent() != HeadBB || isa<PHINode>(I) || !Slice.insert(I).second) continue;
+        // The address itself belongs to the program; stop at its cast
+        if (auto* P2I = dyn_cast<PtrToIntInst>(I)) {
+            if (P2I->getPointerOperand() != Ptr) return nullptr;
+            continue;
+        }
+        for (Value* Op : I->operands()) {
+            if (auto* OpI = dyn_cast<Instruction>(Op)) Worklist.push_back(OpI);
+        }
+    }
+
+    if (Slice.empty()) return nullptr;
+
+    Instruction* Start = HeadBB->getTerminator();
+    while (Instruction* Prev = Start->getPrevNode()) {
+        if (!Slice.count(Prev)) break;
+        Start = Prev;
+    }
+    if (!isa<PtrToIntInst>(Start)) return nullptr;
+
+    unsigned Contiguous = 0;
+    for (Instruction* I = Start; I != HeadBB->getTerminator(); I = I->getNextNode()) {
+        for (User* U : I->users()) {
+            if (!CheckBlocks.count(cast<Instruction>(U)->getParent())) return nullptr;
+        }
+        ++Contiguous;
+    }
+    if (Contiguous != Slice.size()) return nullptr;
+    return Start;
+}
+
+// Match CheckBB -> (SlowPathBB ->) CrashBB around an __asan_report call
+bool matchCheckSite(CallInst* CI, const DataLayout& DL, CheckSite& Site) {
+    BasicBlock* CrashBB = CI->getParent();
+    BasicBlock* CheckBB = CrashBB->getSinglePredecessor();
+    if (!CheckBB) return false;
+
+    auto* BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
+    if (!BI || !BI->isConditional()) return false;
+    BasicBlock* SafeBB = BI->getSuccessor(0) == CrashBB ? BI->getSuccessor(1) : BI->getSuccessor(0);
+    if (SafeBB == CrashBB || !SafeBB->phis().empty()) return false;
+
+    // Accesses smaller than a granule first test the shadow byte for zero and
+    // only then compare against the partially addressable prefix
+    BasicBlock* HeadBB = CheckBB;
+    if (BasicBlock* Pred = CheckBB->getSinglePredecessor()) {
+        auto* PredBI = dyn_cast<BranchInst>(Pred->getTerminator());
+        if (PredBI && PredBI->isConditional() &&
+            ((PredBI->getSuccessor(0) == CheckBB && PredBI->getSuccessor(1) == SafeBB) ||
+             (PredBI->getSuccessor(1) == CheckBB && PredBI->getSuccessor(0) == SafeBB))) {
+            HeadBB = Pred;
+        }
+    }
+    if (HeadBB == SafeBB) return false;
+
+    Instruction* MemInst = nullptr;
+    for (auto& I : *SafeBB) {
+        if (isa<LoadInst>(&I) || isa<StoreInst>(&I) || isa<MemIntrinsic>(&I)) {
+            MemInst = &I;
+            break;
+        }
+    }
+    if (!MemInst) return false;
+
+    Value* Ptr = nullptr;
+    Type* AccessTy = nullptr;
+    if (auto* LI = dyn_cast<LoadInst>(MemInst)) {
+        if (!LI->isSimple()) return false;
+        Ptr = LI->getPointerOperand();
+        AccessTy = LI->getType();
+    } else if (auto* SI = dyn_cast<StoreInst>(MemInst)) {
+        if (!SI->isSimple()) return false;
+        Ptr = SI->getPointerOperand();
+        AccessTy = SI->getValueOperand()->getType();
+    } else {
+        return false;
+    }
+    if (Ptr->getType()->getPointerAddressSpace() != 0) return false;
+
+    SmallPtrSet<BasicBlock*, 4> CheckBlocks = {HeadBB, CheckBB, CrashBB};
+    auto* HeadBI = cast<BranchInst>(HeadBB->getTerminator());
+    if (!HeadBI->isConditional()) return false;
+    Instruction* SliceStart = findCheckSlice(HeadBB, HeadBI->getCondition(), Ptr, CheckBlocks);
+    if (!SliceStart) return false;
+
+    APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+    Site.Base = Ptr->stripAndAccumulateConstantOffsets(DL, Offset, /*AllowNonInbounds=*/true);
+    Site.Offset = Offset.getSExtValue();
+    Site.Size = DL.getTypeStoreSize(AccessTy).getFixedValue();
+    Site.SliceStart = SliceStart;
+    Site.SafeBB = SafeBB;
+    Site.MemInst = MemInst;
+    return true;
+}
+
+// Follow the straight-line chain from a site's protected access to the next
+// check, refusing to cross anything that could re-poison memory
+int findNextInChain(const CheckSite& S, const DenseMap<BasicBlock*, int>& SiteByHead,
+                    const std::vector<CheckSite>& Sites, SmallVectorImpl<BasicBlock*>& Path) {
+    BasicBlock* Cur = S.SafeBB;
+    BasicBlock::iterator Begin = std::next(S.MemInst->getIterator());
+    SmallPtrSet<BasicBlock*, 8> Seen;
+
+    while (Seen.insert(Cur).second) {
+        Path.push_back(Cur);
+        auto It = SiteByHead.find(Cur);
+        if (It != SiteByHead.end()) {
+            const CheckSite& Next = Sites[It->second];
+            if (Cur == S.SafeBB && !S.MemInst->comesBefore(Next.SliceStart)) return -1;
+            if (rangeMayChangeShadow(Begin, Next.SliceStart->getIterator())) return -1;
+            return It->second;
+        }
+        if (rangeMayChangeShadow(Begin, Cur->getTerminator()->getIterator())) return -1;
+
+        BasicBlock* Succ = Cur->getSingleSuccessor();
+        if (!Succ || Succ->getSinglePredecessor() != Cur) return -1;
+        Cur = Succ;
+        Begin = Cur->begin();
+    }
+    return -1;
+}
+
+// At -O0 every field access reloads its base pointer from the same alloca;
+// such reloads name one base as long as nothing in the chain overwrites it
+Value* getGroupKey(const CheckSite& S, const SmallPtrSetImpl<Value*>& StoredPtrs) {
+    auto* Reload = dyn_cast<LoadInst>(S.Base);
+    if (!Reload || !Reload->isSimple()) return S.Base;
+    Value* Slot = Reload->getPointerOperand();
+    if (!isa<AllocaInst>(Slot) || StoredPtrs.count(Slot)) return S.Base;
+    return Slot;
+}
+
+uint64_t granulesCovered(uint64_t Span, uint64_t Granularity, bool Aligned) {
+    if (Aligned) return (Span + Granularity - 1) / Granularity;
+    return (Span + Granularity - 2) / Granularity + 1;
+}
+
+void emitGroup(ArrayRef<CheckSite*> Group, const ShadowMapping& Mapping, DominatorTree& DT,
+               LoopInfo& LI) {
+    CheckSite* First = Group.front();
+    Function& F = *First->SliceStart->getFunction();
+    const DataLayout& DL = F.getParent()->getDataLayout();
+
+    int64_t Lo = First->Offset;
+    int64_t Hi = First->Offset + First->Size;
+    for (CheckSite* S : Group) {
+        Lo = std::min<int64_t>(Lo, S->Offset);
+        Hi = std::max<int64_t>(Hi, S->Offset + S->Size);
+    }
+
+    uint64_t Granularity = 1ULL << Mapping.Scale;
+    bool Aligned = First->Base->getPointerAlignment(DL).value() >= Granularity &&
+                   Lo % (int64_t)Granularity == 0;
+    uint64_t Granules = granulesCovered(Hi - Lo, Granularity, Aligned);
+
+    IRBuilder<> B(First->SliceStart);
+    Value* RangeStart = First->Base;
+    if (Lo != 0) RangeStart = B.CreateGEP(B.getInt8Ty(), RangeStart, B.getInt64(Lo), "cima.range");
+    Value* RangeLong = B.CreatePtrToInt(RangeStart, DL.getIntPtrType(F.getContext()));
+    Value* GroupOk = emitShadowRangeIsZero(B, RangeLong, Granules, Mapping);
+
+    MDNode* Weights = MDBuilder(F.getContext()).createLikelyBranchWeights();
+    for (CheckSite* S : Group) {
+        BasicBlock* HeadBB = S->SliceStart->getParent();
+        BasicBlock* SlowBB = SplitBlock(HeadBB, S->SliceStart, &DT, &LI);
+        SlowBB->setName("cima.group.slow");
+
+        BranchInst* Fast = BranchInst::Create(S->SafeBB, SlowBB, GroupOk);
+        Fast->setMetadata(LLVMContext::MD_prof, Weights);
+        ReplaceInstWithInst(HeadBB->getTerminator(), Fast);
+        DT.insertEdge(HeadBB, S->SafeBB);
+    }
+}
+
+}  // namespace
+
+bool coalesceAsanChecks(Function& F, DominatorTree& DT, LoopInfo& LI,
+                        function_ref<bool(const Instruction&)> Eligible) {
+    PhaseTimer Timer("coalesce", "CIMA: coalesce checks");
+    const DataLayout& DL = F.getParent()->getDataLayout();
+
+    std::vector<CheckSite> Sites;
+    for (auto& BB : F) {
+        for (auto& I : BB) {
+            auto* CI = dyn_cast<CallInst>(&I);
+            if (!CI || !CI->getCalledFunction()) continue;
+            if (!isFixedSizeAsanReport(CI->getCalledFunction()->getName())) continue;
+
+            // An ineligible check ends every chain that reaches it
+            CheckSite Site;
+            if (matchCheckSite(CI, DL, Site) && (!Eligible || Eligible(*Site.MemInst))) {
+                Sites.push_back(Site);
+            }
+        }
+    }
+    if (Sites.size() < 2) return false;
+
+    DenseMap<BasicBlock*, int> SiteByHead;
+    for (int Idx = 0, E = Sites.size(); Idx < E; ++Idx) {
+        SiteByHead[Sites[Idx].SliceStart->getParent()] = Idx;
+    }
+
+    std::vector<int> Next(Sites.size(), -1);
+    std::vector<bool> HasPrev(Sites.size(), false);
+    std::vector<SmallVector<BasicBlock*, 2>> Paths(Sites.size());
+    for (int Idx = 0, E = Sites.size(); Idx < E; ++Idx) {
+        Next[Idx] = findNextInChain(Sites[Idx], SiteByHead, Sites, Paths[Idx]);
+        if (Next[Idx] >= 0) HasPrev[Next[Idx]] = true;
+    }
+
+    ShadowMapping Mapping = getShadowMapping(*F.getParent());
+    std::vector<bool> InChain(Sites.size(), false);
+    bool Changed = false;
+
+    for (int Start = 0, E = Sites.size(); Start < E; ++Start) {
+        if (HasPrev[Start]) continue;
+
+        // Bucket the chain by base pointer, keeping chain order so the first
+        // member of a group dominates the rest
+        std::vector<CheckSite*> Chain;
+        SmallPtrSet<BasicBlock*, 16> ChainBlocks = {Sites[Start].SliceStart->getParent()};
+        for (int Idx = Start; Idx >= 0 && !InChain[Idx]; Idx = Next[Idx]) {
+            InChain[Idx] = true;
+            Chain.push_back(&Sites[Idx]);
+            ChainBlocks.insert(Paths[Idx].begin(), Paths[Idx].end());
+        }
+
+        // Stores ahead of the chain's first reload (e.g. parameter spills)
+        // cannot separate two reloads of the same slot
+        Instruction* ChainBegin = Sites[Start].SliceStart;
+        if (auto* Reload = dyn_cast<LoadInst>(Sites[Start].Base)) {
+            if (Reload->getParent() == ChainBegin->getParent()) ChainBegin = Reload;
+        }
+
+        SmallPtrSet<Value*, 16> StoredPtrs;
+        for (BasicBlock* BB : ChainBlocks) {
+            auto It = BB == ChainBegin->getParent() ? ChainBegin->getIterator() : BB->begin();
+            for (; It != BB->end(); ++It) {
+                if (auto* SI = dyn_cast<StoreInst>(&*It)) StoredPtrs.insert(SI->getPointerOperand());
+            }
+        }
+
+        MapVector<Value*, std::vector<CheckSite*>> ByBase;
+        for (CheckSite* S : Chain) {
+            ByBase[getGroupKey(*S, StoredPtrs)].push_back(S);
+        }
+
+        for (auto& Entry : ByBase) {
+            std::vector<CheckSite*>& Members = Entry.second;
+            if (Members.size() < 2) continue;
+
+            std::vector<CheckSite*> ByOffset = Members;
+            std::stable_sort(ByOffset.begin(), ByOffset.end(),
+                             [](CheckSite* A, CheckSite* B) { return A->Offset < B->Offset; });
+
+            // Sweep into clusters of touching ranges no wider than the span limit
+            size_t ClusterBegin = 0;
+            while (ClusterBegin < ByOffset.size()) {
+                int64_t Lo = ByOffset[ClusterBegin]->Offset;
+                int64_t Hi = Lo + ByOffset[ClusterBegin]->Size;
+                size_t ClusterEnd = ClusterBegin + 1;
+                for (; ClusterEnd < ByOffset.size(); ++ClusterEnd) {
+                    CheckSite* S = ByOffset[ClusterEnd];
+                    int64_t NewHi = std::max<int64_t>(Hi, S->Offset + S->Size);
+                    if (S->Offset > Hi || NewHi - Lo > (int64_t)CoalesceMaxSpan) break;
+                    Hi = NewHi;
+                }
+
+                if (ClusterEnd - ClusterBegin >= 2) {
+                    SmallPtrSet<CheckSite*, 8> Cluster(ByOffset.begin() + ClusterBegin,
+                                                       ByOffset.begin() + ClusterEnd);
+                    std::vector<CheckSite*> Group;
+                    for (CheckSite* S : Members) {
+                        if (Cluster.count(S)) Group.push_back(S);
+                    }
+                    emitGroup(Group, Mapping, DT, LI);
+                    ++NumGroups;
+                    NumCoalescedChecks += Group.size();
+                    Changed = true;
+                }
+                ClusterBegin = ClusterEnd;
+            }
+        }
+    }
+
+    return Changed;
+}
+
+}  // namespace cima
@@ -0,0 +1,25 @@
+#ifndef CIMA_COALESCE_H
+#define CIMA_COALESCE_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace cima {
+
+extern llvm::cl::opt<bool> CoalesceChecks;
+
+// Group ASan checks of adjacent accesses to one base pointer within a
+// straight-line chain of blocks. Each group gets a single wide shadow-range
+// test in front of its first check; when it passes, every per-access check
+// of the group is skipped, otherwise the original checks (and whatever
+// recovery CIMA attaches to them) run as before. With Eligible, only checks
+// of the accesses it accepts are grouped. Returns true if changed.
+bool coalesceAsanChecks(llvm::Function& F, llvm::DominatorTree& DT, llvm::LoopInfo& LI,
+                        llvm::function_ref<bool(const llvm::Instruction&)> Eligible = nullptr);
+
+}  // namespace cima
+
+#endif  // CIMA_COALESCE_H
@@ -0,0 +1,216 @@
+#include "cima_policy.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SpecialCaseList.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace cima {
+
+static cl::opt<std::string> PolicyList(
+    "cima-policy-list",
+    cl::desc("Special case list assigning functions and sources to CIMA policies"),
+    cl::init(""));
+
+static cl::opt<std::string> DefaultPolicy(
+    "cima-default-policy",
+    cl::desc("Policy for functions without annotation or list entry "
+             "(none, asan, base, nearest, native, tainted)"),
+    cl::init(""));
+
+static cl::opt<std::string> AnnotationPolicy(
+    "cima-annotation-policy",
+    cl::desc("Policy selected by a bare \"cima\" annotation (default: the running plugin's "
+             "own variant)"),
+    cl::init(""));
+
+std::optional<Policy> parsePolicy(StringRef Name) {
+    return StringSwitch<std::optional<Policy>>(Name)
+        .Case("none", Policy::None)
+        .Case("asan", Policy::Asan)
+        .Case("base", Policy::Base)
+        .Case("nearest", Policy::Nearest)
+        .Case("native", Policy::Native)
+        .Case("tainted", Policy::Tainted)
+        .Default(std::nullopt);
+}
+
+StringRef policyName(Policy P) {
+    switch (P) {
+        case Policy::None:
+            return "none";
+        case Policy::Asan:
+            return "asan";
+        case Policy::Base:
+            return "base";
+        case Policy::Nearest:
+            return "nearest";
+        case Policy::Native:
+            return "native";
+        case Policy::Tainted:
+            return "tainted";
+    }
+    llvm_unreachable("unknown CIMA policy");
+}
+
+// Function attribute cima-policy-pin copies a function's annotation into,
+// so the annotation still applies once llvm.global.annotations is in another
+// module (llvm-split partitions)
+static constexpr const char* PinnedAnnotationAttr = "cima-annotation";
+
+// Policy a "cima"/"cima:<policy>" annotation text selects; nullopt for
+// other annotations
+static std::optional<Policy> parseAnnotation(StringRef Text, const Function& F, Policy Self) {
+    if (Text == "cima") {
+        if (AnnotationPolicy.empty()) return Self;
+        if (std::optional<Policy> P = parsePolicy(AnnotationPolicy)) return P;
+        report_fatal_error(Twine("unknown -cima-annotation-policy: ") + AnnotationPolicy);
+    }
+    if (!Text.consume_front("cima:")) return std::nullopt;
+    if (std::optional<Policy> P = parsePolicy(Text)) return P;
+    errs() << "CIMA: ignoring unknown policy in annotation \"cima:" << Text << "\" on "
+           << F.getName() << "\n";
+    return std::nullopt;
+}
+
+// The first annotation on F that names a CIMA policy, if any
+static std::optional<StringRef> findAnnotation(const Function& F, Policy Self) {
+    const GlobalVariable* Annotations =
+        F.getParent()->getGlobalVariable("llvm.global.annotations");
+    if (!Annotations || !Annotations->hasInitializer()) return std::nullopt;
+    const auto* Entries = dyn_cast<ConstantArray>(Annotations->getInitializer());
+    if (!Entries) return std::nullopt;
+
+    for (const Use& U : Entries->operands()) {
+        const auto* Entry = dyn_cast<ConstantStruct>(U.get());
+        if (!Entry || Entry->getNumOperands() < 2) continue;
+        if (Entry->getOperand(0)->stripPointerCasts() != &F) continue;
+
+        const auto* Str = dyn_cast<GlobalVariable>(Entry->getOperand(1)->stripPointerCasts());
+        if (!Str || !Str->hasInitializer()) continue;
+        const auto* Data = dyn_cast<ConstantDataArray>(Str->getInitializer());
+        if (!Data || !Data->isCString()) continue;
+
+        StringRef Text = Data->getAsCString();
+        if (parseAnnotation(Text, F, Self)) return Text;
+    }
+    return std::nullopt;
+}
+
+// Policy requested by a "cima"/"cima:<policy>" annotation on F, if any
+static std::optional<Policy> getAnnotatedPolicy(const Function& F, Policy Self) {
+    if (F.hasFnAttribute(PinnedAnnotationAttr)) {
+        return parseAnnotation(F.getFnAttribute(PinnedAnnotationAttr).getValueAsString(), F, Self);
+    }
+    if (std::optional<StringRef> Text = findAnnotation(F, Self)) {
+        return parseAnnotation(*Text, F, Self);
+    }
+    return std::nullopt;
+}
+
+static const SpecialCaseList* getPolicyList() {
+    static std::unique_ptr<SpecialCaseList> List = [] {
+        std::unique_ptr<SpecialCaseList> L;
+        if (!PolicyList.empty()) {
+            L = SpecialCaseList::createOrDie({PolicyList}, *vfs::getRealFileSystem());
+        }
+        return L;
+    }();
+    return List.get();
+}
+
+static std::optional<Policy> getListedPolicy(const Function& F) {
+    const SpecialCaseList* List = getPolicyList();
+    if (!List) return std::nullopt;
+
+    StringRef Source = F.getParent()->getSourceFileName();
+    static const Policy Strongest[] = {Policy::Tainted, Policy::Native, Policy::Nearest,
+                                       Policy::Base,    Policy::Asan,   Policy::None};
+    for (Policy P : Strongest) {
+        StringRef Section = policyName(P);
+        if (List->inSection(Section, "fun", F.getName()) ||
+            List->inSection(Section, "src", Source)) {
+            return P;
+        }
+    }
+    return std::nullopt;
+}
+
+Policy getFunctionPolicy(const Function& F, Policy Self) {
+    // ASan's module constructor/destructor and the check-site profile writers
+    if (F.getName().starts_with("asan.module_") || F.getName().starts_with("__cima_prof")) {
+        return Policy::None;
+    }
+
+    if (F.hasFnAttribute(BudgetPolicyAttr)) {
+        StringRef Name = F.getFnAttribute(BudgetPolicyAttr).getValueAsString();
+        if (std::optional<Policy> P = parsePolicy(Name)) return *P;
+    }
+    if (std::optional<Policy> P = getAnnotatedPolicy(F, Self)) return *P;
+    if (std::optional<Policy> P = getListedPolicy(F)) return *P;
+    if (!DefaultPolicy.empty()) {
+        if (std::optional<Policy> P = parsePolicy(DefaultPolicy)) return *P;
+        report_fatal_error(Twine("unknown -cima-default-policy: ") + DefaultPolicy);
+    }
+    return Self;
+}
+
+namespace {
+struct CIMAPolicyPrepare : public PassInfoMixin<CIMAPolicyPrepare> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+        bool Changed = false;
+        for (Function& F : M) {
+            if (F.isDeclaration() || !F.hasFnAttribute(Attribute::SanitizeAddress)) continue;
+            if (getFunctionPolicy(F, Policy::Base) != Policy::None) continue;
+
+            F.removeFnAttr(Attribute::SanitizeAddress);
+            errs() << "CIMA: " << F.getName() << " left uninstrumented (policy none)\n";
+            Changed = true;
+        }
+        return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    }
+};
+
+struct CIMAPolicyPin : public PassInfoMixin<CIMAPolicyPin> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+        bool Changed = false;
+        for (Function& F : M) {
+            if (F.isDeclaration() || F.hasFnAttribute(PinnedAnnotationAttr)) continue;
+            // The annotation text, not its policy, so -cima-annotation-policy
+            // and each plugin's own variant still decide a bare "cima"
+            if (std::optional<StringRef> Text = findAnnotation(F, Policy::Base)) {
+                F.addFnAttr(PinnedAnnotationAttr, *Text);
+                Changed = true;
+            }
+        }
+        return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+    }
+};
+}  // namespace
+
+void registerPolicyPrepare(PassBuilder& PB) {
+    PB.registerPipelineParsingCallback(
+        [](StringRef Name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+            if (Name == "cima-policy-prepare") {
+                MPM.addPass(CIMAPolicyPrepare());
+                return true;
+            }
+            if (Name == "cima-policy-pin") {
+                MPM.addPass(CIMAPolicyPin());
+                return true;
+            }
+            return false;
+        });
+}
+
+}  // namespace cima
@@ -0,0 +1,48 @@
+#ifndef CIMA_POLICY_H
+#define CIMA_POLICY_H
+
+#include <optional>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Passes/PassBuilder.h"
+
+namespace cima {
+
+// How a function is instrumented, weakest to strongest
+enum class Policy { None, Asan, Base, Nearest, Native, Tainted };
+
+std::optional<Policy> parsePolicy(llvm::StringRef Name);
+llvm::StringRef policyName(Policy P);
+
+// Function attribute the cima-budget pass pins each function's policy in
+inline constexpr const char* BudgetPolicyAttr = "cima-budget-policy";
+
+// Resolve F's policy. Sources, highest precedence first:
+//   0. the policy cima-budget chose to fit -cima-overhead-budget, itself
+//      picked from the sources below
+//   1. __attribute__((annotate("cima"))) or annotate("cima:<policy>"); a
+//      bare "cima" selects -cima-annotation-policy, or else the running
+//      plugin's own variant (Self)
+//   2. the -cima-policy-list special case list, whose sections are policy
+//      names ([tainted], [asan], ...); the strongest matching section wins
+//   3. -cima-default-policy
+//   4. Self, i.e. every function is instrumented as before
+// ASan's own module constructor/destructor and the profile writers of
+// -cima-profile-generate always resolve to None.
+Policy getFunctionPolicy(const llvm::Function& F, Policy Self);
+
+// True when the plugin implementing Self should instrument F
+inline bool shouldInstrument(const llvm::Function& F, Policy Self) {
+    return getFunctionPolicy(F, Self) == Self;
+}
+
+// Register the "cima-policy-prepare" module pass, which must run before
+// ASan: it drops sanitize_address from functions whose policy is None.
+// Also registers "cima-policy-pin", which copies each function's CIMA
+// annotation into a function attribute before a module is split.
+void registerPolicyPrepare(llvm::PassBuilder& PB);
+
+}  // namespace cima
+
+#endif  // CIMA_POLICY_H
@@ -0,0 +1,322 @@
+#include "cima_profile.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include "cima_coalesce.h"
+#include "cima_timing.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#define DEBUG_TYPE "cima-profile"
+
+using namespace llvm;
+
+STATISTIC(NumCountedSites, "Check sites given profile counters");
+STATISTIC(NumProfiledSites, "Check sites with profile counts");
+STATISTIC(NumCheapSites, "Hot check sites that never failed in the profile");
+STATISTIC(NumHotCoalescedFunctions, "Functions whose hot checks were coalesced");
+
+namespace cima {
+
+cl::opt<bool> ProfileGenerate(
+    "cima-profile-generate",
+    cl::desc("Count how often every check site runs and fails; the program appends the "
+             "counts to $CIMA_PROFILE_FILE (default cima.profile)"),
+    cl::init(false));
+
+static cl::opt<std::string> ProfileUse(
+    "cima-profile-use",
+    cl::desc("Check-site profile from a -cima-profile-generate build, used for branch "
+             "weights and to pick each site's recovery"),
+    cl::init(""));
+
+static cl::opt<uint64_t> HotThreshold(
+    "cima-profile-hot-threshold",
+    cl::desc("Runs from which a check that never failed in the profile gets the cheapest "
+             "recovery"),
+    cl::init(1000));
+
+namespace {
+
+struct FunctionRecord {
+    uint64_t Hash;
+    std::vector<SiteCounts> Counts;
+};
+
+// Identifies a function's sites by their number, sizes and kinds, so a
+// profile of differently built IR is not applied by index
+uint64_t siteHash(const CheckSites& Sites) {
+    std::string Shape;
+    raw_string_ostream OS(Shape);
+    for (const CheckSite& Site : Sites.Sites) OS << Site.AccessSize << (Site.IsWrite ? 'w' : 'r');
+    return MD5Hash(OS.str());
+}
+
+// Every run of a profiling build appends one line per function:
+//   <function> <hash> <sites> <count> <failures> <count> <failures> ...
+// Lines with the same function and hash are summed; a new hash means the
+// program was rebuilt, and the later lines replace the earlier ones
+StringMap<FunctionRecord> parseProfile(StringRef Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+        report_fatal_error(Twine("cannot read -cima-profile-use file ") + Path + ": " +
+                           Buffer.getError().message());
+    }
+
+    StringMap<FunctionRecord> Records;
+    for (line_iterator Line(**Buffer, true, '#'); !Line.is_at_eof(); ++Line) {
+        SmallVector<StringRef, 16> Fields;
+        Line->split(Fields, ' ', -1, false);
+
+        uint64_t Hash = 0, NumSites = 0;
+        bool Valid = Fields.size() >= 3 && !Fields[1].getAsInteger(10, Hash) &&
+                     !Fields[2].getAsInteger(10, NumSites) && Fields.size() == 3 + 2 * NumSites;
+        std::vector<SiteCounts> Counts(Valid ? NumSites : 0);
+        for (uint64_t I = 0; Valid && I < NumSites; ++I) {
+            Valid = !Fields[3 + 2 * I].getAsInteger(10, Counts[I].Count) &&
+                    !Fields[4 + 2 * I].getAsInteger(10, Counts[I].Failures);
+        }
+        if (!Valid) {
+            errs() << "CIMA: ignoring malformed line " << Line.line_number() << " of " << Path
+                   << "\n";
+            continue;
+        }
+
+        auto [It, Inserted] = Records.try_emplace(Fields[0], FunctionRecord{Hash, Counts});
+        FunctionRecord& Record = It->second;
+        if (Inserted) continue;
+        if (Record.Hash != Hash) {
+            Record = {Hash, std::move(Counts)};
+            continue;
+        }
+        for (uint64_t I = 0; I < NumSites; ++I) {
+            Record.Counts[I].Count += Counts[I].Count;
+            Record.Counts[I].Failures += Counts[I].Failures;
+        }
+    }
+    return Records;
+}
+
+const StringMap<FunctionRecord>* getProfile() {
+    static std::unique_ptr<StringMap<FunctionRecord>> Profile = [] {
+        std::unique_ptr<StringMap<FunctionRecord>> P;
+        if (!ProfileUse.empty()) {
+            P = std::make_unique<StringMap<FunctionRecord>>(parseProfile(ProfileUse));
+        }
+        return P;
+    }();
+    return Profile.get();
+}
+
+bool matches(const FunctionRecord& Record, const CheckSites& Sites) {
+    return Record.Hash == siteHash(Sites) && Record.Counts.size() == Sites.Sites.size();
+}
+
+bool isHot(const SiteCounts& C) { return C.Failures == 0 && C.Count >= HotThreshold; }
+
+// What markSiteCounters leaves for SiteCountersPass: the function's site
+// hash and number of sites, and on every access (check) the indices (and
+// crash successors) of the sites it belongs to
+constexpr const char* ProfileFunctionMD = "cima.prof";
+constexpr const char* ProfileAccessMD = "cima.prof.access";
+constexpr const char* ProfileCheckMD = "cima.prof.check";
+
+uint64_t getInt(const MDNode* N, unsigned I) {
+    return mdconst::extract<ConstantInt>(N->getOperand(I))->getZExtValue();
+}
+
+void appendOperands(Instruction* I, StringRef Kind, ArrayRef<Metadata*> Ops) {
+    SmallVector<Metadata*, 4> All;
+    if (MDNode* Old = I->getMetadata(Kind)) All.append(Old->op_begin(), Old->op_end());
+    All.append(Ops.begin(), Ops.end());
+    I->setMetadata(Kind, MDNode::get(I->getContext(), All));
+}
+
+// Counters[Index] += Amount, non-atomically like LLVM's own PGO counters
+void emitIncrement(IRBuilder<>& B, GlobalVariable* Counters, unsigned Index, Value* Amount) {
+    Value* Ptr = B.CreateConstInBoundsGEP2_32(Counters->getValueType(), Counters, 0, Index);
+    Value* Old = B.CreateLoad(B.getInt64Ty(), Ptr);
+    B.CreateStore(B.CreateAdd(Old, Amount), Ptr);
+}
+
+void emitSiteCounters(Function& F) {
+    Module& M = *F.getParent();
+    LLVMContext& Ctx = F.getContext();
+    MDNode* Info = F.getMetadata(ProfileFunctionMD);
+    uint64_t Hash = getInt(Info, 0);
+    unsigned NumSites = getInt(Info, 1);
+    F.setMetadata(ProfileFunctionMD, nullptr);
+
+    // Two counters per site: runs of its check without failure, failures
+    auto* CountersTy = ArrayType::get(Type::getInt64Ty(Ctx), 2 * NumSites);
+    auto* Counters =
+        new GlobalVariable(M, CountersTy, false, GlobalValue::PrivateLinkage,
+                           Constant::getNullValue(CountersTy), "__cima_prof." + F.getName());
+
+    std::vector<Instruction*> Tagged;
+    for (Instruction& I : instructions(F)) {
+        if (I.getMetadata(ProfileAccessMD) || I.getMetadata(ProfileCheckMD)) Tagged.push_back(&I);
+    }
+
+    // Runs are counted at the access, which the recovery paths skip;
+    // failures branch-free at the check, whose slow path ASan only takes
+    // for poisoned shadow. Neither changes the recovery code of the passes
+    for (Instruction* I : Tagged) {
+        IRBuilder<> B(I);
+        if (MDNode* Sites = I->getMetadata(ProfileAccessMD)) {
+            for (unsigned Op = 0; Op < Sites->getNumOperands(); ++Op) {
+                emitIncrement(B, Counters, 2 * getInt(Sites, Op), B.getInt64(1));
+            }
+            I->setMetadata(ProfileAccessMD, nullptr);
+        }
+        if (MDNode* Sites = I->getMetadata(ProfileCheckMD)) {
+            Value* Failed = cast<BranchInst>(I)->getCondition();
+            for (unsigned Op = 0; Op + 1 < Sites->getNumOperands(); Op += 2) {
+                Value* SiteFailed = getInt(Sites, Op + 1) == 1 ? B.CreateNot(Failed) : Failed;
+                emitIncrement(B, Counters, 2 * getInt(Sites, Op) + 1,
+                              B.CreateZExt(SiteFailed, B.getInt64Ty()));
+            }
+            I->setMetadata(ProfileCheckMD, nullptr);
+        }
+    }
+
+    // __cima_profile_write(name, hash, sites, counters) from cima_runtime,
+    // called by a module destructor once the program exits
+    Type* PtrTy = PointerType::getUnqual(Ctx);
+    Type* Int64Ty = Type::getInt64Ty(Ctx);
+    FunctionCallee WriteFn = M.getOrInsertFunction(
+        "__cima_profile_write", Type::getVoidTy(Ctx), PtrTy, Int64Ty, Int64Ty, PtrTy);
+    Function* Writer = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                        GlobalValue::InternalLinkage,
+                                        "__cima_prof_write." + F.getName(), M);
+    IRBuilder<> B(BasicBlock::Create(Ctx, "", Writer));
+    B.CreateCall(WriteFn, {B.CreateGlobalString(F.getName()), B.getInt64(Hash),
+                           B.getInt64(NumSites), Counters});
+    B.CreateRetVoid();
+    appendToGlobalDtors(M, Writer, 65535);
+
+    NumCountedSites += NumSites;
+}
+
+}  // namespace
+
+SiteProfile SiteProfile::get(const Function& F, const CheckSites& Sites,
+                             OptimizationRemarkEmitter& ORE, const char* PassName) {
+    SiteProfile Result;
+    const StringMap<FunctionRecord>* Profile = getProfile();
+    if (!Profile || Sites.empty()) return Result;
+
+    auto It = Profile->find(F.getName());
+    if (It == Profile->end()) return Result;
+    const FunctionRecord& Record = It->second;
+    if (!matches(Record, Sites)) {
+        ORE.emit([&] {
+            return OptimizationRemarkMissed(PassName, "StaleProfile", Sites.Sites.front().Report)
+                   << "check-site profile of " << ore::NV("Function", F.getName())
+                   << " does not match its ASan checks; ignoring it";
+        });
+        return Result;
+    }
+
+    Result.Counts = Record.Counts;
+    NumProfiledSites += Result.Counts.size();
+    for (unsigned I = 0; I < Result.Counts.size(); ++I) {
+        if (Result.preferCheapRecovery(I)) ++NumCheapSites;
+    }
+    return Result;
+}
+
+bool SiteProfile::preferCheapRecovery(unsigned I) const {
+    return I < Counts.size() && isHot(Counts[I]);
+}
+
+bool coalesceHotChecks(Function& F, FunctionAnalysisManager& FAM, DominatorTree& DT,
+                       LoopInfo& LI) {
+    const StringMap<FunctionRecord>* Profile = getProfile();
+    if (!Profile) return false;
+    auto It = Profile->find(F.getName());
+    if (It == Profile->end()) return false;
+
+    // A stale profile is left to SiteProfile::get, which remarks on it
+    const CheckSites& Sites = FAM.getResult<CheckSiteAnalysis>(F);
+    const FunctionRecord& Record = It->second;
+    if (!matches(Record, Sites)) return false;
+
+    // An access is only as hot as the coldest of its sites
+    SmallPtrSet<const Instruction*, 16> Hot, Cold;
+    for (unsigned I = 0; I < Sites.Sites.size(); ++I) {
+        (isHot(Record.Counts[I]) ? Hot : Cold).insert(Sites.Sites[I].Access);
+    }
+    for (const Instruction* Access : Cold) Hot.erase(Access);
+    if (Hot.size() < 2) return false;
+
+    bool Changed = coalesceAsanChecks(F, DT, LI, [&](const Instruction& Access) {
+        return Hot.count(&Access) != 0;
+    });
+    if (Changed) ++NumHotCoalescedFunctions;
+    return Changed;
+}
+
+void SiteProfile::setBranchWeights(const CheckSites& Sites) const {
+    for (unsigned I = 0; I < Counts.size(); ++I) {
+        const SiteCounts& C = Counts[I];
+        // Never reached: ASan's static weights are as good a guess as any
+        if (C.Count == 0 && C.Failures == 0) continue;
+
+        const CheckSite& Site = Sites.Sites[I];
+        uint64_t Scale = std::max(C.Count, C.Failures) / std::numeric_limits<uint32_t>::max() + 1;
+        uint32_t Weights[2];
+        Weights[Site.CrashSuccIdx] = C.Failures / Scale;
+        Weights[1 - Site.CrashSuccIdx] = C.Count / Scale;
+        Site.Branch->setMetadata(
+            LLVMContext::MD_prof,
+            MDBuilder(Site.Branch->getContext()).createBranchWeights(Weights[0], Weights[1]));
+    }
+}
+
+void markSiteCounters(Function& F, const CheckSites& Sites) {
+    if (Sites.empty()) return;
+
+    LLVMContext& Ctx = F.getContext();
+    auto Int = [&](uint64_t V) {
+        return ConstantAsMetadata::get(ConstantInt::get(Type::getInt64Ty(Ctx), V));
+    };
+    F.setMetadata(ProfileFunctionMD,
+                  MDNode::get(Ctx, {Int(siteHash(Sites)), Int(Sites.Sites.size())}));
+
+    // One access can own several sites; each gets its own counters
+    for (unsigned I = 0; I < Sites.Sites.size(); ++I) {
+        const CheckSite& Site = Sites.Sites[I];
+        appendOperands(Site.Access, ProfileAccessMD, {Int(I)});
+        appendOperands(Site.Branch, ProfileCheckMD, {Int(I), Int(Site.CrashSuccIdx)});
+    }
+}
+
+PreservedAnalyses SiteCountersPass::run(Module& M, ModuleAnalysisManager&) {
+    std::vector<Function*> Marked;
+    for (Function& F : M) {
+        if (F.getMetadata(ProfileFunctionMD)) Marked.push_back(&F);
+    }
+    if (Marked.empty()) return PreservedAnalyses::all();
+
+    PhaseTimer Timer("profile-counters", "CIMA: emit check-site profile counters");
+    for (Function* F : Marked) emitSiteCounters(*F);
+    return PreservedAnalyses::none();
+}
+
+}  // namespace cima
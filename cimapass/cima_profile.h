@@ -0,0 +1,87 @@
+#ifndef CIMA_PROFILE_H
+#define CIMA_PROFILE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "cima_check_sites.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace cima {
+
+extern llvm::cl::opt<bool> ProfileGenerate;
+
+// How often one check site ran without failing and how often it failed
+struct SiteCounts {
+    uint64_t Count = 0;
+    uint64_t Failures = 0;
+};
+
+// The -cima-profile-use counts of one function's check sites. Sites are
+// matched by their index in CheckSites, so the profile only applies to IR
+// built the same way as the profiling build; a function whose sites no
+// longer hash the same is treated as unprofiled
+class SiteProfile {
+public:
+    // Empty without -cima-profile-use, for functions missing from the
+    // profile and for stale ones, which also get a missed remark
+    static SiteProfile get(const llvm::Function& F, const CheckSites& Sites,
+                           llvm::OptimizationRemarkEmitter& ORE, const char* PassName);
+
+    bool empty() const { return Counts.empty(); }
+
+    // True when site I ran at least -cima-profile-hot-threshold times and
+    // never failed. Such a site may share a coalesced check with its hot
+    // neighbours (coalesceHotChecks) and gets the pass's smallest recovery,
+    // which keeps cold code out of the hot path. Sites that failed, and
+    // unprofiled ones, keep the full recovery
+    bool preferCheapRecovery(unsigned I) const;
+
+    // Replace ASan's branch weights on every profiled check with the
+    // measured ones, so rarely failing checks lay out their recovery
+    // code cold and often failing ones keep it inline
+    void setBranchWeights(const CheckSites& Sites) const;
+
+private:
+    std::vector<SiteCounts> Counts;
+};
+
+// With -cima-profile-use, give the checks of hot sites that never failed a
+// cheaper fast path: groups of adjacent ones share one wide shadow test, as
+// -cima-coalesce-checks does for every check. Call it on F's checks before
+// any recovery; coalescing keeps the sites and their order, so the profile
+// still applies afterwards. Returns true if F changed
+bool coalesceHotChecks(llvm::Function& F, llvm::FunctionAnalysisManager& FAM,
+                       llvm::DominatorTree& DT, llvm::LoopInfo& LI);
+
+// Profiling build (-cima-profile-generate): tag every site of F, once its
+// recovery is in place, so that SiteCountersPass counts the executions of
+// its access and the failures of its check. Only metadata is added; a
+// function pass may not create the counters itself
+void markSiteCounters(llvm::Function& F, const CheckSites& Sites);
+
+// Module pass run after a plugin's function pass: gives every function
+// tagged by markSiteCounters a counter array, the increments at its tagged
+// accesses and checks, and a module destructor that writes the counts to
+// $CIMA_PROFILE_FILE (default cima.profile). The CFG is left alone
+struct SiteCountersPass : public llvm::PassInfoMixin<SiteCountersPass> {
+    llvm::PreservedAnalyses run(llvm::Module& M, llvm::ModuleAnalysisManager&);
+};
+
+// Add the function pass Pass, and SiteCountersPass after it, to MPM: what
+// each plugin's pass name stands for at the top level of a pipeline
+template <typename FunctionPassT>
+void addWithSiteCounters(llvm::ModulePassManager& MPM, FunctionPassT&& Pass) {
+    MPM.addPass(llvm::createModuleToFunctionPassAdaptor(std::forward<FunctionPassT>(Pass)));
+    MPM.addPass(SiteCountersPass());
+}
+
+}  // namespace cima
+
+#endif  // CIMA_PROFILE_H
@@ -0,0 +1,107 @@
+#include "cima_report.h"
+
+#include <string>
+
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace cima {
+
+static cl::opt<std::string> OverheadReportFile(
+    "cima-overhead-report-file",
+    cl::desc("File the cima-overhead-report pass writes its JSON to (default: stdout)"),
+    cl::init("-"));
+
+namespace {
+
+struct FunctionCounts {
+    unsigned Blocks = 0;
+    unsigned Instructions = 0;
+    unsigned Phis = 0;
+    unsigned RuntimeCalls = 0;
+    unsigned ShadowAllocas = 0;
+    unsigned TaintOrs = 0;
+};
+
+// Calls into the ASan or CIMA runtime; intrinsics and program calls don't count
+bool isRuntimeCall(const Instruction& I) {
+    const auto* CB = dyn_cast<CallBase>(&I);
+    if (!CB) return false;
+    const Function* Callee = CB->getCalledFunction();
+    if (!Callee) return false;
+    StringRef Name = Callee->getName();
+    return Name.starts_with("__asan_") || Name.starts_with("__cima_");
+}
+
+FunctionCounts countFunction(const Function& F) {
+    FunctionCounts C;
+    C.Blocks = F.size();
+    for (const Instruction& I : instructions(F)) {
+        ++C.Instructions;
+        if (isa<PHINode>(I)) ++C.Phis;
+        if (isRuntimeCall(I)) ++C.RuntimeCalls;
+        // The tainted pass names each alloca's shadow "<name>.shadow"
+        if (isa<AllocaInst>(I) && I.getName().ends_with(".shadow")) ++C.ShadowAllocas;
+        // Taints are i1; the program itself only produces i1 ORs when
+        // optimized, and those show up in the ASan-only IR as well
+        if (I.getOpcode() == Instruction::Or && I.getType()->isIntegerTy(1)) ++C.TaintOrs;
+    }
+    return C;
+}
+
+struct CIMAOverheadReport : PassInfoMixin<CIMAOverheadReport> {
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager&) {
+        std::error_code EC;
+        raw_fd_ostream OS(OverheadReportFile, EC, sys::fs::OF_Text);
+        if (EC) {
+            errs() << "CIMA: cannot write overhead report to " << OverheadReportFile << ": "
+                   << EC.message() << "\n";
+            return PreservedAnalyses::all();
+        }
+
+        json::OStream J(OS, 2);
+        J.object([&] {
+            J.attribute("module", M.getModuleIdentifier());
+            J.attributeArray("functions", [&] {
+                for (const Function& F : M) {
+                    if (F.isDeclaration()) continue;
+                    FunctionCounts C = countFunction(F);
+                    J.object([&] {
+                        J.attribute("name", F.getName());
+                        J.attribute("blocks", C.Blocks);
+                        J.attribute("instructions", C.Instructions);
+                        J.attribute("phis", C.Phis);
+                        J.attribute("runtime_calls", C.RuntimeCalls);
+                        J.attribute("shadow_allocas", C.ShadowAllocas);
+                        J.attribute("taint_ors", C.TaintOrs);
+                    });
+                }
+            });
+        });
+        OS << "\n";
+        return PreservedAnalyses::all();
+    }
+};
+
+}  // namespace
+
+void registerOverheadReport(PassBuilder& PB) {
+    PB.registerPipelineParsingCallback(
+        [](StringRef Name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+            if (Name == "cima-overhead-report") {
+                MPM.addPass(CIMAOverheadReport());
+                return true;
+            }
+            return false;
+        });
+}
+
+}  // namespace cima
@@ -0,0 +1,17 @@
+#ifndef CIMA_REPORT_H
+#define CIMA_REPORT_H
+
+#include "llvm/Passes/PassBuilder.h"
+
+namespace cima {
+
+// Register the "cima-overhead-report" module pass. It leaves the IR alone
+// and writes one JSON record per defined function (blocks, instructions,
+// PHIs, runtime calls, shadow allocas, taint ORs) to
+// -cima-overhead-report-file. Run it on the ASan-only IR and on a variant's
+// final IR to see what the variant added; bench/overhead_report.py does so.
+void registerOverheadReport(llvm::PassBuilder& PB);
+
+}  // namespace cima
+
+#endif  // CIMA_REPORT_H
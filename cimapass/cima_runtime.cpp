@@ -1,5 +1,8 @@
+#include <cinttypes>
 #include <cstdint>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 
 extern "C" {
 
@@ -25,6 +28,40 @@ static inline bool is_valid_access(uint64_t addr, size_t size) {
     return (offset + size) <= shadow_byte;
 }
 
+// Check every granule touched by an access of 'size' bytes at 'addr'
+static inline bool is_valid_range(uint64_t addr, size_t size) {
+    if (size == 0) return true;
+    uint64_t last = addr + size - 1;
+
+    for (uint64_t granule = addr >> 3; granule <= (last >> 3); granule++) {
+        int8_t shadow_byte = *(volatile int8_t*)(granule + SHADOW_OFFSET);
+        if (shadow_byte == 0) continue;
+        if (shadow_byte < 0) return false;  // Poisoned
+
+        // Partially valid: the bytes touched in this granule must lie in
+        // its addressable prefix
+        uint64_t granule_end = (granule << 3) + 7;
+        uint64_t touched_end = last < granule_end ? last : granule_end;
+        if ((touched_end & 7) >= (uint64_t)shadow_byte) return false;
+    }
+    return true;
+}
+
+// Validity checks replacing ASan's __asan_loadN/__asan_storeN callbacks;
+// the pass reports and recovers when they return false
+#define CIMA_DEFINE_CHECKS(size)                                              \
+    bool __cima_load##size(uint64_t addr) { return is_valid_range(addr, size); } \
+    bool __cima_store##size(uint64_t addr) { return is_valid_range(addr, size); }
+
+CIMA_DEFINE_CHECKS(1)
+CIMA_DEFINE_CHECKS(2)
+CIMA_DEFINE_CHECKS(4)
+CIMA_DEFINE_CHECKS(8)
+CIMA_DEFINE_CHECKS(16)
+
+bool __cima_loadN(uint64_t addr, size_t size) { return is_valid_range(addr, size); }
+bool __cima_storeN(uint64_t addr, size_t size) { return is_valid_range(addr, size); }
+
 // Bidirectional search for nearest valid memory address
 void* __cima_find_nearest_valid(void* invalid_ptr, size_t access_size) {
     uint64_t invalid_addr = (uint64_t)invalid_ptr;
@@ -54,4 +91,29 @@ void* __cima_find_nearest_valid(void* invalid_ptr, size_t access_size) {
     return nullptr;
 }
 
+// Check-site profile of one function, called at exit by the destructors of
+// -cima-profile-generate builds. Appends one line to $CIMA_PROFILE_FILE
+// (default cima.profile) so repeated runs accumulate:
+//   <function> <hash> <sites> <count> <failures> <count> <failures> ...
+void __cima_profile_write(const char* function, uint64_t hash, uint64_t num_sites,
+                          const uint64_t* counters) {
+    static FILE* out = nullptr;
+    static bool failed = false;
+    if (!out && !failed) {
+        const char* path = getenv("CIMA_PROFILE_FILE");
+        if (!path || !*path) path = "cima.profile";
+        out = fopen(path, "a");
+        if (!out) {
+            failed = true;
+            fprintf(stderr, "CIMA: cannot open profile file %s; profile not written\n", path);
+        }
+    }
+    if (!out) return;
+
+    fprintf(out, "%s %" PRIu64 " %" PRIu64, function, hash, num_sites);
+    for (uint64_t i = 0; i < 2 * num_sites; i++) fprintf(out, " %" PRIu64, counters[i]);
+    fputc('\n', out);
+    fflush(out);
+}
+
 }  // extern "C"
@@ -0,0 +1,174 @@
+#include "cima_shadow.h"
+
+#include <limits>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Instrumentation/AddressSanitizerCommon.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+namespace cima {
+
+cl::opt<bool> MaskedVectorRecovery(
+    "cima-masked-vector-recovery",
+    cl::desc("Recover failing vector loads lane by lane with llvm.masked.load"),
+    cl::init(true));
+
+ShadowMapping getShadowMapping(const Module& M) {
+    Triple TargetTriple(M.getTargetTriple());
+    int LongSize = M.getDataLayout().getPointerSizeInBits();
+
+    ShadowMapping Mapping;
+    getAddressSanitizerParams(TargetTriple, LongSize, /*IsKasan=*/false, &Mapping.Offset,
+                              &Mapping.Scale, &Mapping.OrShadowOffset);
+    Mapping.Dynamic = Mapping.Offset == std::numeric_limits<uint64_t>::max();
+    return Mapping;
+}
+
+Value* emitMemToShadow(IRBuilder<>& B, Value* AddrLong, const ShadowMapping& Mapping) {
+    Type* IntptrTy = AddrLong->getType();
+    Value* Shadow = B.CreateLShr(AddrLong, Mapping.Scale);
+    if (Mapping.Offset == 0) return Shadow;
+
+    Value* ShadowBase = nullptr;
+    if (Mapping.Dynamic) {
+        Module* M = B.GetInsertBlock()->getModule();
+        Value* DynamicAddr = M->getOrInsertGlobal("__asan_shadow_memory_dynamic_address",
+                                                  IntptrTy);
+        ShadowBase = B.CreateLoad(IntptrTy->getScalarType(), DynamicAddr, "cima.shadow.base");
+        if (auto* VecTy = dyn_cast<VectorType>(IntptrTy))
+            ShadowBase = B.CreateVectorSplat(VecTy->getElementCount(), ShadowBase);
+    } else {
+        ShadowBase = ConstantInt::get(IntptrTy, Mapping.Offset);
+    }
+
+    if (Mapping.OrShadowOffset) return B.CreateOr(Shadow, ShadowBase);
+    return B.CreateAdd(Shadow, ShadowBase);
+}
+
+Value* emitShadowRangeIsZero(IRBuilder<>& B, Value* AddrLong, unsigned Granules,
+                             const ShadowMapping& Mapping) {
+    // One load covering every shadow byte of the range; odd widths are
+    // legalized into exact-width loads so nothing past the range is read
+    Value* ShadowAddr = emitMemToShadow(B, AddrLong, Mapping);
+    Value* ShadowPtr = B.CreateIntToPtr(ShadowAddr, B.getPtrTy());
+    Type* WideTy = B.getIntNTy(Granules * 8);
+    Value* ShadowBytes = B.CreateAlignedLoad(WideTy, ShadowPtr, Align(1), "cima.shadow.range");
+    return B.CreateIsNull(ShadowBytes, "cima.range.ok");
+}
+
+bool isShadowLoad(const Instruction* I) {
+    auto* Load = dyn_cast<LoadInst>(I);
+    if (!Load) return false;
+    auto* Cast = dyn_cast<IntToPtrInst>(Load->getPointerOperand());
+    if (!Cast) return false;
+
+    Value* Shadow = Cast->getOperand(0);
+    auto Shifted = m_LShr(m_Value(), m_ConstantInt());
+    return match(Shadow, Shifted) || match(Shadow, m_Add(Shifted, m_Value())) ||
+           match(Shadow, m_Or(Shifted, m_Value()));
+}
+
+static bool isReportBlock(BasicBlock* BB) {
+    for (Instruction& I : *BB) {
+        if (auto* CI = dyn_cast<CallInst>(&I)) {
+            Function* Callee = CI->getCalledFunction();
+            if (Callee && Callee->getName().starts_with("__asan_report")) return true;
+        }
+    }
+    return false;
+}
+
+// A failing successor is the report block itself or the partial-granule
+// slow path in front of it
+static bool leadsToReport(BasicBlock* BB) {
+    if (isReportBlock(BB)) return true;
+    auto* BI = dyn_cast<BranchInst>(BB->getTerminator());
+    return BI && BI->isConditional() &&
+           (isReportBlock(BI->getSuccessor(0)) || isReportBlock(BI->getSuccessor(1)));
+}
+
+Instruction* findCheckedAccess(BasicBlock* SafeBB) {
+    SmallPtrSet<BasicBlock*, 4> Visited;
+    for (BasicBlock* BB = SafeBB; BB && Visited.insert(BB).second;) {
+        for (Instruction& I : *BB) {
+            if (isShadowLoad(&I)) continue;
+            if (isa<LoadInst>(&I) || isa<StoreInst>(&I) || isa<AtomicRMWInst>(&I) ||
+                isa<AtomicCmpXchgInst>(&I) || isa<MemIntrinsic>(&I)) {
+                return &I;
+            }
+        }
+
+        auto* BI = dyn_cast<BranchInst>(BB->getTerminator());
+        if (!BI || !BI->isConditional()) return nullptr;
+        if (leadsToReport(BI->getSuccessor(0))) {
+            BB = BI->getSuccessor(1);
+        } else if (leadsToReport(BI->getSuccessor(1))) {
+            BB = BI->getSuccessor(0);
+        } else {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+bool canUseMaskedRecovery(LoadInst* Load, const ShadowMapping& Mapping) {
+    auto* VecTy = dyn_cast<FixedVectorType>(Load->getType());
+    if (!VecTy || !Load->isSimple()) return false;
+    if (Load->getPointerAddressSpace() != 0) return false;
+
+    const DataLayout& DL = Load->getModule()->getDataLayout();
+    uint64_t EltSize = DL.getTypeStoreSize(VecTy->getElementType()).getFixedValue();
+    uint64_t EltAlloc = DL.getTypeAllocSize(VecTy->getElementType()).getFixedValue();
+    // The mask reads one shadow byte per lane, so a lane must not straddle
+    // two granules; under-aligned loads (packed structs, char* casts) can
+    if (Load->getAlign().value() < EltSize) return false;
+    return EltSize == EltAlloc && EltSize <= (1ULL << Mapping.Scale);
+}
+
+Value* emitLaneValidityMask(IRBuilder<>& B, LoadInst* Load, const ShadowMapping& Mapping) {
+    auto* VecTy = cast<FixedVectorType>(Load->getType());
+    const DataLayout& DL = Load->getModule()->getDataLayout();
+    unsigned Lanes = VecTy->getNumElements();
+    uint64_t EltSize = DL.getTypeStoreSize(VecTy->getElementType()).getFixedValue();
+    Type* IntptrTy = DL.getIntPtrType(Load->getContext());
+
+    SmallVector<Constant*, 16> LaneOffsets;
+    for (unsigned Lane = 0; Lane < Lanes; ++Lane) {
+        LaneOffsets.push_back(ConstantInt::get(IntptrTy, Lane * EltSize));
+    }
+
+    Value* Base = B.CreatePtrToInt(Load->getPointerOperand(), IntptrTy);
+    Value* Addrs = B.CreateAdd(B.CreateVectorSplat(Lanes, Base), ConstantVector::get(LaneOffsets),
+                               "cima.lane.addr");
+
+    Value* ShadowAddrs = emitMemToShadow(B, Addrs, Mapping);
+    Value* ShadowPtrs =
+        B.CreateIntToPtr(ShadowAddrs, FixedVectorType::get(B.getPtrTy(), Lanes));
+    auto* ShadowTy = FixedVectorType::get(B.getInt8Ty(), Lanes);
+    Value* Shadow = B.CreateMaskedGather(ShadowTy, ShadowPtrs, Align(1), nullptr, nullptr,
+                                         "cima.lane.shadow");
+
+    // Lane is addressable if its granule is clean or its last byte lies
+    // below the partially addressable prefix
+    uint64_t Granularity = 1ULL << Mapping.Scale;
+    Value* LastByte = B.CreateAdd(B.CreateAnd(Addrs, Granularity - 1),
+                                  ConstantInt::get(Addrs->getType(), EltSize - 1));
+    LastByte = B.CreateTrunc(LastByte, ShadowTy);
+    Value* Clean = B.CreateICmpEQ(Shadow, Constant::getNullValue(ShadowTy));
+    Value* Prefix = B.CreateICmpSLT(LastByte, Shadow);
+    return B.CreateOr(Clean, Prefix, "cima.lane.valid");
+}
+
+Value* emitMaskedRecoveryLoad(IRBuilder<>& B, LoadInst* Load, Value* PassThru,
+                              const ShadowMapping& Mapping) {
+    Value* Mask = emitLaneValidityMask(B, Load, Mapping);
+    return B.CreateMaskedLoad(Load->getType(), Load->getPointerOperand(), Load->getAlign(), Mask,
+                              PassThru, "cima.masked");
+}
+
+}  // namespace cima
@@ -0,0 +1,59 @@
+#ifndef CIMA_SHADOW_H
+#define CIMA_SHADOW_H
+
+#include <cstdint>
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace cima {
+
+extern llvm::cl::opt<bool> MaskedVectorRecovery;
+
+// ASan shadow mapping for the module's target (Shadow = (Addr >> Scale) + Offset)
+struct ShadowMapping {
+    uint64_t Offset;
+    int Scale;
+    bool OrShadowOffset;
+    bool Dynamic;
+};
+
+ShadowMapping getShadowMapping(const llvm::Module& M);
+
+// Emit the shadow address for AddrLong, an integer or a vector of integers
+llvm::Value* emitMemToShadow(llvm::IRBuilder<>& B, llvm::Value* AddrLong,
+                             const ShadowMapping& Mapping);
+
+// Emit an i1 that is true when the Granules shadow bytes starting at the
+// granule of AddrLong are all zero, i.e. the whole range is addressable
+llvm::Value* emitShadowRangeIsZero(llvm::IRBuilder<>& B, llvm::Value* AddrLong,
+                                   unsigned Granules, const ShadowMapping& Mapping);
+
+// True for ASan's own read of a shadow byte (a load through inttoptr of a
+// shifted address)
+bool isShadowLoad(const llvm::Instruction* I);
+
+// Return the memory access guarded by a check whose passing successor is
+// SafeBB. ASan guards unusually sized or aligned accesses with two checks in
+// a row (first and last byte), so further checks are stepped over
+llvm::Instruction* findCheckedAccess(llvm::BasicBlock* SafeBB);
+
+// Vector loads whose lanes each fit in one granule, element-aligned, can be
+// recovered lane by lane
+bool canUseMaskedRecovery(llvm::LoadInst* Load, const ShadowMapping& Mapping);
+
+// Emit a <N x i1> mask that is true for every lane of Load whose bytes are
+// addressable, using the same partial-granule test ASan uses
+llvm::Value* emitLaneValidityMask(llvm::IRBuilder<>& B, llvm::LoadInst* Load,
+                                  const ShadowMapping& Mapping);
+
+// Re-issue Load as llvm.masked.load: addressable lanes read real data and the
+// rest take the matching lane of PassThru
+llvm::Value* emitMaskedRecoveryLoad(llvm::IRBuilder<>& B, llvm::LoadInst* Load,
+                                    llvm::Value* PassThru, const ShadowMapping& Mapping);
+
+}  // namespace cima
+
+#endif  // CIMA_SHADOW_H
@@ -0,0 +1,27 @@
+#ifndef CIMA_TIMING_H
+#define CIMA_TIMING_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+
+namespace cima {
+
+// Times one phase of a CIMA pass for the lifetime of the object: as a timer
+// in the "CIMA phases" group under -time-passes, and as a scope under
+// -ftime-trace (opt -time-trace)
+class PhaseTimer {
+public:
+    PhaseTimer(llvm::StringRef Name, llvm::StringRef Description)
+        : Timer(Name, Description, "cima", "CIMA phases", llvm::TimePassesIsEnabled),
+          Trace(Description) {}
+
+private:
+    llvm::NamedRegionTimer Timer;
+    llvm::TimeTraceScope Trace;
+};
+
+}  // namespace cima
+
+#endif  // CIMA_TIMING_H
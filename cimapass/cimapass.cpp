@@ -1,11 +1,21 @@
 #include <unordered_map>
 #include <unordered_set>
 
-#include "llvm/Analysis/BlockFrequencyInfo.h"
-#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "cima_budget.h"
+#include "cima_callbacks.h"
+#include "cima_check_sites.h"
+#include "cima_coalesce.h"
+#include "cima_policy.h"
+#include "cima_profile.h"
+#include "cima_report.h"
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopIterator.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
@@ -19,112 +29,124 @@
 #include "llvm/Transforms/Utils/LoopUtils.h"
 #include "llvm/Transforms/Utils/SSAUpdater.h"
 
+#define DEBUG_TYPE "cima"
+
 using namespace llvm;
 
+STATISTIC(NumRecovered, "Failing accesses skipped or recovered with undef");
+STATISTIC(NumMaskedRecovered, "Failing vector loads recovered lane by lane");
+
 namespace {
 struct CIMAPass : public PassInfoMixin<CIMAPass> {
     PreservedAnalyses run(Function& F, FunctionAnalysisManager& FAM) {
-        llvm::BlockFrequencyAnalysis::Result& bfi =
-            FAM.getResult<BlockFrequencyAnalysis>(F);
-        llvm::BranchProbabilityAnalysis::Result& bpi =
-            FAM.getResult<BranchProbabilityAnalysis>(F);
+        if (!cima::shouldInstrument(F, cima::Policy::Base)) return PreservedAnalyses::all();
+
         llvm::LoopAnalysis::Result& li = FAM.getResult<LoopAnalysis>(F);
         llvm::DominatorTreeAnalysis::Result& dt = FAM.getResult<DominatorTreeAnalysis>(F);
 
-        std::vector<CallInst*> AsanCalls;
-
-        // Scan for __asan_report_* calls
-        for (auto& BB : F) {
-            for (auto& I : BB) {
-                if (CallInst* CI = dyn_cast<CallInst>(&I)) {
-                    if (Function* CalledF = CI->getCalledFunction()) {
-                        if (CalledF->getName().starts_with("__asan_report")) {
-                            AsanCalls.push_back(CI);
-                        }
-                    }
-                }
-            }
+        // Everything below keeps the dominator tree and loop info up to date
+        PreservedAnalyses PA;
+        PA.preserve<DominatorTreeAnalysis>();
+        PA.preserve<LoopAnalysis>();
+
+        bool Changed = cima::expandAsanCallbacks(F, dt, li);
+        if (cima::CoalesceChecks) Changed |= cima::coalesceAsanChecks(F, dt, li);
+        if (Changed) FAM.invalidate(F, PA);
+        if (!cima::CoalesceChecks && cima::coalesceHotChecks(F, FAM, dt, li)) {
+            Changed = true;
+            FAM.invalidate(F, PA);
         }
 
-        std::unordered_map<Instruction*, BasicBlock*> MemInstToTargetBB;
-
-        // Process each ASan crash report
-        for (CallInst* CI : AsanCalls) {
-            BasicBlock* CrashBB = CI->getParent();
-            std::vector<BasicBlock*> Preds(pred_begin(CrashBB), pred_end(CrashBB));
-
-            for (BasicBlock* CheckBB : Preds) {
-                auto* BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
-
-                if (!BI || !BI->isConditional()) continue;
-                BasicBlock* SafeBB = nullptr;
-                unsigned CrashSuccIdx = 0;
-
-                if (BI->getSuccessor(0) == CrashBB) {
-                    SafeBB = BI->getSuccessor(1);
-                    CrashSuccIdx = 0;
-                } else if (BI->getSuccessor(1) == CrashBB) {
-                    SafeBB = BI->getSuccessor(0);
-                    CrashSuccIdx = 1;
-                } else {
-                    continue;
-                }
+        const cima::CheckSites& Sites = FAM.getResult<cima::CheckSiteAnalysis>(F);
+        OptimizationRemarkEmitter& ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+        cima::remarkUnmatched(ORE, DEBUG_TYPE, Sites);
+        if (Sites.empty()) return Changed ? PA : PreservedAnalyses::all();
 
-                Instruction* MemInst = nullptr;
-                for (auto& I : *SafeBB) {
-                    if (isa<LoadInst>(&I) || isa<StoreInst>(&I) ||
-                        isa<AtomicRMWInst>(&I) || isa<AtomicCmpXchgInst>(&I)) {
-                        MemInst = &I;
-                        break;
-                    }
-                    if (auto* MCI = dyn_cast<MemIntrinsic>(&I)) {
-                        MemInst = &I;
-                        break;
-                    }
-                }
+        cima::SiteProfile Profile = cima::SiteProfile::get(F, Sites, ORE, DEBUG_TYPE);
+        Profile.setBranchWeights(Sites);
 
-                if (!MemInst) continue;
+        cima::PhaseTimer Timer("recover", "CIMA: recover failing accesses");
+        cima::ShadowMapping Mapping = cima::getShadowMapping(*F.getParent());
+        DomTreeUpdater DTU(dt, DomTreeUpdater::UpdateStrategy::Lazy);
 
-                BasicBlock* TargetBB = nullptr;
-
-                if (MemInstToTargetBB.count(MemInst)) {
-                    TargetBB = MemInstToTargetBB[MemInst];
-                } else {
-                    if (MemInst->isTerminator()) continue;
-
-                    TargetBB = SplitBlock(SafeBB, MemInst->getNextNode(), &dt, &li);
-                    MemInstToTargetBB[MemInst] = TargetBB;
+        std::unordered_map<Instruction*, BasicBlock*> MemInstToTargetBB;
 
-                    if (!MemInst->getType()->isVoidTy()) {
-                        PHINode* Phi = PHINode::Create(MemInst->getType(), 0,
-                                                       "cima.skipped", TargetBB->begin());
+        // Process each ASan check
+        for (unsigned I = 0; I < Sites.Sites.size(); ++I) {
+            const cima::CheckSite& Site = Sites.Sites[I];
+            Instruction* MemInst = Site.Access;
+            BasicBlock* TargetBB = nullptr;
+
+            if (MemInstToTargetBB.count(MemInst)) {
+                TargetBB = MemInstToTargetBB[MemInst];
+            } else {
+                BasicBlock* AccessBB = MemInst->getParent();
+                TargetBB = SplitBlock(AccessBB, MemInst->getNextNode(), &DTU, &li);
+                MemInstToTargetBB[MemInst] = TargetBB;
+
+                if (!MemInst->getType()->isVoidTy()) {
+                    PHINode* Phi = PHINode::Create(MemInst->getType(), 0,
+                                                   "cima.skipped", TargetBB->begin());
+
+                    Phi->addIncoming(MemInst, AccessBB);
+                    MemInst->replaceUsesWithIf(Phi, [&](Use& U) {
+                        Instruction* User = cast<Instruction>(U.getUser());
+                        return User != Phi;
+                    });
+                }
+            }
 
-                        Phi->addIncoming(MemInst, SafeBB);
-                        MemInst->replaceUsesWithIf(Phi, [&](Use& U) {
-                            Instruction* User = cast<Instruction>(U.getUser());
-                            return User != Phi;
-                        });
-                    }
+            // Vector loads keep their addressable lanes instead of going
+            // undef as a whole, unless the profile never saw them fail
+            auto* VecLoad = dyn_cast<LoadInst>(MemInst);
+            if (cima::MaskedVectorRecovery && VecLoad && Site.HasShadow &&
+                !Profile.preferCheapRecovery(I) &&
+                cima::canUseMaskedRecovery(VecLoad, Mapping)) {
+                BasicBlock* MaskedBB =
+                    BasicBlock::Create(F.getContext(), "cima.masked", &F, TargetBB);
+                IRBuilder<> MaskedBuilder(MaskedBB);
+                Value* Recovered = cima::emitMaskedRecoveryLoad(
+                    MaskedBuilder, VecLoad, UndefValue::get(VecLoad->getType()), Mapping);
+                MaskedBuilder.CreateBr(TargetBB);
+
+                cima::redirectCrashEdge(Site, MaskedBB, {MaskedBB}, DTU, li);
+
+                if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
+                    Phi->addIncoming(Recovered, MaskedBB);
                 }
+                ++NumMaskedRecovered;
+                cima::remarkRecovered(ORE, DEBUG_TYPE, Site, "addressable lanes");
+                continue;
+            }
 
-                BI->setSuccessor(CrashSuccIdx, TargetBB);
+            BasicBlock* CheckBB = Site.checkBlock();
+            cima::redirectCrashEdge(Site, TargetBB, {}, DTU, li);
 
-                if (TargetBB && !MemInst->getType()->isVoidTy()) {
-                    if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
-                        Phi->addIncoming(UndefValue::get(MemInst->getType()), CheckBB);
-                    }
+            if (!MemInst->getType()->isVoidTy()) {
+                if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
+                    Phi->addIncoming(UndefValue::get(MemInst->getType()), CheckBB);
                 }
             }
+            ++NumRecovered;
+            cima::remarkRecovered(ORE, DEBUG_TYPE, Site,
+                                  MemInst->getType()->isVoidTy() ? "skipped" : "undef");
         }
 
+        if (cima::ProfileGenerate) cima::markSiteCounters(F, Sites);
+
         errs() << "CIMA: Instrumented function " << F.getName() << "\n";
 
-        return PreservedAnalyses::none();
+        return PA;
     }
 };
 }  // namespace
 extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginInfo() {
     return {LLVM_PLUGIN_API_VERSION, "CIMAPass", "v0.1", [](PassBuilder& PB) {
+                cima::registerPolicyPrepare(PB);
+                cima::registerBudget(PB);
+                cima::registerOverheadReport(PB);
+                cima::registerCheckSiteAnalysis(PB);
+
                 PB.registerPipelineParsingCallback(
                     [](StringRef Name, FunctionPassManager& FPM,
                        ArrayRef<PassBuilder::PipelineElement>) {
@@ -134,11 +156,21 @@ extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginIn
                         }
                         return false;
                     });
+                // At the top level the pass also gets its profile counters
+                PB.registerPipelineParsingCallback(
+                    [](StringRef Name, ModulePassManager& MPM,
+                       ArrayRef<PassBuilder::PipelineElement>) {
+                        if (Name == "CIMAPass") {
+                            cima::addWithSiteCounters(MPM, CIMAPass());
+                            return true;
+                        }
+                        return false;
+                    });
 
                 PB.registerOptimizerLastEPCallback([](llvm::ModulePassManager& MPM,
                                                       llvm::OptimizationLevel Level,
                                                       llvm::ThinOrFullLTOPhase Phase) {
-                    MPM.addPass(createModuleToFunctionPassAdaptor(CIMAPass()));
+                    cima::addWithSiteCounters(MPM, CIMAPass());
                 });
             }};
 }
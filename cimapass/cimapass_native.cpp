@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "cima_budget.h"
+#include "cima_policy.h"
+#include "cima_report.h"
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#define DEBUG_TYPE "cima-native"
+
+using namespace llvm;
+
+STATISTIC(NumInstrumented, "Accesses given a recovering check");
+STATISTIC(NumProvablySafe, "Accesses left unchecked as provably in bounds");
+
+// Value a failing load produces instead of reading memory
+enum class NativeRecovery { Undef, Zero, Nearest };
+
+static cl::opt<NativeRecovery> RecoveryMode(
+    "cima-native-recovery", cl::desc("Value produced by a load that fails its check"),
+    cl::values(clEnumValN(NativeRecovery::Undef, "undef", "Undefined value (base CIMA)"),
+               clEnumValN(NativeRecovery::Zero, "zero", "Zero"),
+               clEnumValN(NativeRecovery::Nearest, "nearest",
+                          "Load from the nearest valid address (needs cima_runtime)")),
+    cl::init(NativeRecovery::Undef));
+
+static cl::opt<bool> ReportRecovered(
+    "cima-native-report",
+    cl::desc("Report each recovered access through __asan_report_*_noabort "
+             "(needs ASAN_OPTIONS=halt_on_error=0)"),
+    cl::init(false));
+
+namespace {
+
+// A load or store to instrument
+struct Access {
+    Instruction* I;
+    Value* Ptr;
+    uint64_t Size;
+    Align Alignment;
+    bool IsWrite;
+};
+
+std::optional<Access> getAccess(Instruction& I) {
+    if (I.hasMetadata(LLVMContext::MD_nosanitize)) return std::nullopt;
+
+    Value* Ptr = nullptr;
+    Type* Ty = nullptr;
+    Align Alignment;
+    bool IsWrite = false;
+    if (auto* LI = dyn_cast<LoadInst>(&I)) {
+        Ptr = LI->getPointerOperand();
+        Ty = LI->getType();
+        Alignment = LI->getAlign();
+    } else if (auto* SI = dyn_cast<StoreInst>(&I)) {
+        Ptr = SI->getPointerOperand();
+        Ty = SI->getValueOperand()->getType();
+        Alignment = SI->getAlign();
+        IsWrite = true;
+    } else if (auto* RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        Ptr = RMW->getPointerOperand();
+        Ty = RMW->getValOperand()->getType();
+        Alignment = RMW->getAlign();
+        IsWrite = true;
+    } else if (auto* XCHG = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        Ptr = XCHG->getPointerOperand();
+        Ty = XCHG->getNewValOperand()->getType();
+        Alignment = XCHG->getAlign();
+        IsWrite = true;
+    } else {
+        return std::nullopt;
+    }
+
+    if (Ptr->getType()->getPointerAddressSpace() != 0) return std::nullopt;
+    if (Ptr->isSwiftError()) return std::nullopt;
+
+    TypeSize Size = I.getModule()->getDataLayout().getTypeStoreSize(Ty);
+    if (Size.isScalable() || Size.getFixedValue() == 0) return std::nullopt;
+    return Access{&I, Ptr, Size.getFixedValue(), Alignment, IsWrite};
+}
+
+// ASan skips nosanitize instructions: accesses this pass covers and its own
+// shadow reads are left alone, while functions under another policy still
+// get ASan's checks
+void markNoSanitize(Value* V) {
+    auto* I = cast<Instruction>(V);
+    I->setMetadata(LLVMContext::MD_nosanitize, MDNode::get(I->getContext(), {}));
+}
+
+// Constant in-bounds accesses to a stack slot or global can't fail (ASan
+// skips them too)
+bool isProvablySafe(const Access& A, const DataLayout& DL) {
+    APInt Offset(DL.getIndexTypeSizeInBits(A.Ptr->getType()), 0);
+    const Value* Base = A.Ptr->stripAndAccumulateConstantOffsets(DL, Offset, true);
+
+    uint64_t ObjectSize = 0;
+    if (const auto* AI = dyn_cast<AllocaInst>(Base)) {
+        std::optional<TypeSize> AllocSize = AI->getAllocationSize(DL);
+        if (!AllocSize || AllocSize->isScalable()) return false;
+        ObjectSize = AllocSize->getFixedValue();
+    } else if (const auto* GV = dyn_cast<GlobalVariable>(Base)) {
+        if (!GV->hasInitializer() || GV->isInterposable()) return false;
+        ObjectSize = DL.getTypeAllocSize(GV->getValueType()).getFixedValue();
+    } else {
+        return false;
+    }
+
+    int64_t Off = Offset.getSExtValue();
+    return Off >= 0 && uint64_t(Off) + A.Size <= ObjectSize;
+}
+
+// True when the Size bytes at AddrLong, all within one granule, touch a
+// poisoned byte. ASan's fast and partial-granule tests are folded together
+// so the check ends in a single branch.
+Value* emitGranuleCheck(IRBuilder<>& B, Value* AddrLong, uint64_t Size,
+                        const cima::ShadowMapping& Mapping) {
+    uint64_t Granularity = 1ULL << Mapping.Scale;
+    Type* ShadowTy = B.getIntNTy(std::max<uint64_t>(8, Size * 8 / Granularity));
+    Value* ShadowPtr = B.CreateIntToPtr(cima::emitMemToShadow(B, AddrLong, Mapping), B.getPtrTy());
+    Value* Shadow = B.CreateAlignedLoad(ShadowTy, ShadowPtr, Align(1), "cima.shadow");
+    markNoSanitize(Shadow);
+    Value* Poisoned = B.CreateIsNotNull(Shadow);
+    if (Size >= Granularity) return Poisoned;
+
+    Value* LastByte = B.CreateAnd(AddrLong, Granularity - 1);
+    if (Size > 1) LastByte = B.CreateAdd(LastByte, ConstantInt::get(AddrLong->getType(), Size - 1));
+    LastByte = B.CreateTrunc(LastByte, ShadowTy);
+    return B.CreateAnd(Poisoned, B.CreateICmpSGE(LastByte, Shadow));
+}
+
+// Same access classes as ASan: naturally sized and aligned accesses take one
+// shadow test, everything else checks its first and last byte
+Value* emitAccessCheck(IRBuilder<>& B, Value* AddrLong, const Access& A,
+                       const cima::ShadowMapping& Mapping) {
+    uint64_t Granularity = 1ULL << Mapping.Scale;
+    bool Regular = isPowerOf2_64(A.Size) && A.Size <= 16 &&
+                   (A.Alignment.value() >= Granularity || A.Alignment.value() >= A.Size);
+    if (Regular) return emitGranuleCheck(B, AddrLong, A.Size, Mapping);
+
+    Value* Last = B.CreateAdd(AddrLong, ConstantInt::get(AddrLong->getType(), A.Size - 1));
+    return B.CreateOr(emitGranuleCheck(B, AddrLong, 1, Mapping),
+                      emitGranuleCheck(B, Last, 1, Mapping));
+}
+
+void emitReport(IRBuilder<>& B, Value* AddrLong, const Access& A) {
+    Module& M = *B.GetInsertBlock()->getModule();
+    std::string Name = A.IsWrite ? "__asan_report_store" : "__asan_report_load";
+    SmallVector<Value*, 2> Args = {AddrLong};
+    if (isPowerOf2_64(A.Size) && A.Size <= 16) {
+        Name += std::to_string(A.Size);
+    } else {
+        Name += "_n";
+        Args.push_back(ConstantInt::get(AddrLong->getType(), A.Size));
+    }
+    Name += "_noabort";
+
+    SmallVector<Type*, 2> ArgTys(Args.size(), AddrLong->getType());
+    FunctionCallee ReportFn =
+        M.getOrInsertFunction(Name, FunctionType::get(B.getVoidTy(), ArgTys, false));
+    B.CreateCall(ReportFn, Args);
+}
+
+// Emit the value a failing access yields at the end of the recovery block
+Value* emitRecoveryValue(Instruction* RecoverTerm, const Access& A,
+                         const cima::ShadowMapping& Mapping) {
+    Type* Ty = A.I->getType();
+    if (RecoveryMode == NativeRecovery::Undef) return UndefValue::get(Ty);
+    if (RecoveryMode == NativeRecovery::Zero || !isa<LoadInst>(A.I)) {
+        return Constant::getNullValue(Ty);
+    }
+
+    IRBuilder<> B(RecoverTerm);
+    Module& M = *B.GetInsertBlock()->getModule();
+    FunctionCallee FindNearest = M.getOrInsertFunction(
+        "__cima_find_nearest_valid",
+        FunctionType::get(B.getPtrTy(), {B.getPtrTy(), B.getInt64Ty()}, false));
+    Value* Nearest = B.CreateCall(FindNearest, {A.Ptr, B.getInt64(A.Size)});
+
+    BasicBlock* FindBB = RecoverTerm->getParent();
+    Instruction* LoadTerm =
+        SplitBlockAndInsertIfThen(B.CreateIsNotNull(Nearest), RecoverTerm, false);
+    IRBuilder<> LoadBuilder(LoadTerm);
+    Align NearestAlign = std::min(A.Alignment, Align(1ULL << Mapping.Scale));
+    Value* NearestLoad = LoadBuilder.CreateAlignedLoad(Ty, Nearest, NearestAlign, "nearest.load");
+    markNoSanitize(NearestLoad);
+
+    IRBuilder<> PhiBuilder(RecoverTerm);
+    PHINode* Phi = PhiBuilder.CreatePHI(Ty, 2, "nearest.value");
+    Phi->addIncoming(NearestLoad, LoadTerm->getParent());
+    Phi->addIncoming(Constant::getNullValue(Ty), FindBB);
+    return Phi;
+}
+
+void instrumentAccess(const Access& A, const cima::ShadowMapping& Mapping) {
+    LLVMContext& Ctx = A.I->getContext();
+    IRBuilder<> B(A.I);
+    Type* IntptrTy = A.I->getModule()->getDataLayout().getIntPtrType(Ctx);
+    Value* AddrLong = B.CreatePtrToInt(A.Ptr, IntptrTy);
+    Value* Bad = emitAccessCheck(B, AddrLong, A, Mapping);
+    markNoSanitize(A.I);
+
+    // Stores that just get skipped need no recovery block at all
+    bool HasValue = !A.I->getType()->isVoidTy();
+    if (!HasValue && !ReportRecovered) {
+        Instruction* AccessTerm = SplitBlockAndInsertIfThen(
+            B.CreateNot(Bad), A.I, false, MDBuilder(Ctx).createLikelyBranchWeights());
+        A.I->moveBefore(AccessTerm);
+        return;
+    }
+
+    Instruction* RecoverTerm = nullptr;
+    Instruction* AccessTerm = nullptr;
+    SplitBlockAndInsertIfThenElse(Bad, A.I, &RecoverTerm, &AccessTerm,
+                                  MDBuilder(Ctx).createUnlikelyBranchWeights());
+    A.I->moveBefore(AccessTerm);
+
+    if (ReportRecovered) {
+        IRBuilder<> ReportBuilder(RecoverTerm);
+        emitReport(ReportBuilder, AddrLong, A);
+    }
+    if (!HasValue) return;
+
+    Value* Recovered = emitRecoveryValue(RecoverTerm, A, Mapping);
+    BasicBlock* Tail = AccessTerm->getSuccessor(0);
+    PHINode* Phi = PHINode::Create(A.I->getType(), 2, "cima.value", Tail->begin());
+    A.I->replaceAllUsesWith(Phi);
+    Phi->addIncoming(A.I, A.I->getParent());
+    Phi->addIncoming(Recovered, RecoverTerm->getParent());
+}
+
+struct CIMAPassNative : public PassInfoMixin<CIMAPassNative> {
+    PreservedAnalyses run(Function& F, FunctionAnalysisManager& FAM) {
+        if (F.isDeclaration() || !F.hasFnAttribute(Attribute::SanitizeAddress) ||
+            !cima::shouldInstrument(F, cima::Policy::Native)) {
+            return PreservedAnalyses::all();
+        }
+
+        // ASan's own frame setup and poisoning would be instrumented too
+        if (F.getParent()->getFunction("asan.module_ctor")) {
+            errs() << "CIMA: " << F.getName()
+                   << " is already ASan-instrumented; run CIMAPassNative before ASan\n";
+            return PreservedAnalyses::all();
+        }
+
+        const DataLayout& DL = F.getParent()->getDataLayout();
+        cima::ShadowMapping Mapping = cima::getShadowMapping(*F.getParent());
+        OptimizationRemarkEmitter& ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+        cima::PhaseTimer Timer("native", "CIMA: native instrumentation");
+
+        std::vector<Access> Accesses;
+        for (auto& BB : F) {
+            for (auto& I : BB) {
+                std::optional<Access> A = getAccess(I);
+                if (!A) continue;
+                if (isProvablySafe(*A, DL)) {
+                    ++NumProvablySafe;
+                    ORE.emit([&] {
+                        return OptimizationRemarkAnalysis(DEBUG_TYPE, "ProvablySafe", A->I)
+                               << "access needs no check: provably in bounds";
+                    });
+                    continue;
+                }
+                Accesses.push_back(*A);
+                ORE.emit([&] {
+                    return OptimizationRemark(DEBUG_TYPE, "Instrumented", A->I)
+                           << "recovering check on " << ore::NV("Size", A->Size) << "-byte "
+                           << (A->IsWrite ? "write" : "read");
+                });
+            }
+        }
+
+        // Back to front, so each split only moves the code up to the next access
+        for (const Access& A : llvm::reverse(Accesses)) {
+            instrumentAccess(A, Mapping);
+        }
+        NumInstrumented += Accesses.size();
+
+        errs() << "CIMA: Instrumented function " << F.getName() << "\n";
+
+        return Accesses.empty() ? PreservedAnalyses::all() : PreservedAnalyses::none();
+    }
+};
+}  // namespace
+extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginInfo() {
+    return {LLVM_PLUGIN_API_VERSION, "CIMAPassNative", "v0.1", [](PassBuilder& PB) {
+                cima::registerPolicyPrepare(PB);
+                cima::registerBudget(PB);
+                cima::registerOverheadReport(PB);
+
+                PB.registerPipelineParsingCallback(
+                    [](StringRef Name, FunctionPassManager& FPM,
+                       ArrayRef<PassBuilder::PipelineElement>) {
+                        if (Name == "CIMAPassNative") {
+                            FPM.addPass(CIMAPassNative());
+                            return true;
+                        }
+                        return false;
+                    });
+
+                // Must run ahead of ASan, which then skips the accesses
+                // marked nosanitize here and only lays out redzones for them
+                PB.registerOptimizerEarlyEPCallback(
+                    [](llvm::ModulePassManager& MPM, llvm::OptimizationLevel Level,
+                       llvm::ThinOrFullLTOPhase Phase) {
+                        MPM.addPass(createModuleToFunctionPassAdaptor(CIMAPassNative()));
+                    });
+            }};
+}
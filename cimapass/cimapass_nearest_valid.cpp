@@ -3,11 +3,21 @@
 #include <unordered_map>
 #include <unordered_set>
 
-#include "llvm/Analysis/BlockFrequencyInfo.h"
-#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "cima_budget.h"
+#include "cima_callbacks.h"
+#include "cima_check_sites.h"
+#include "cima_coalesce.h"
+#include "cima_policy.h"
+#include "cima_profile.h"
+#include "cima_report.h"
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopIterator.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
@@ -22,34 +32,30 @@
 #include "llvm/Transforms/Utils/LoopUtils.h"
 #include "llvm/Transforms/Utils/SSAUpdater.h"
 
+#define DEBUG_TYPE "cima-nearest"
+
 using namespace llvm;
 
+STATISTIC(NumRecovered, "Failing accesses skipped or recovered with undef");
+STATISTIC(NumNearestValid, "Failing loads recovered from the nearest valid address");
+STATISTIC(NumMaskedRecovered, "Failing vector loads recovered lane by lane");
+
 // CLI option to enable nearest valid memory feature
 static cl::opt<bool> UseNearestValid(
     "cima-use-nearest-valid",
     cl::desc("Load from nearest valid memory address instead of undef value"),
     cl::init(false));
 
-// Extract access size from __asan_report_* function name
-static unsigned getAccessSizeFromAsanReport(StringRef FuncName) {
-    if (FuncName.contains("1")) return 1;
-    if (FuncName.contains("2")) return 2;
-    if (FuncName.contains("4")) return 4;
-    if (FuncName.contains("8")) return 8;
-    if (FuncName.contains("16")) return 16;
-    return 8;  // Default for _n variants
-}
-
 // Result structure for nearest valid load generation
 struct NearestValidResult {
     Value* value;
     BasicBlock* entryBlock;
     BasicBlock* exitBlock;
+    SmallVector<BasicBlock*, 4> blocks;
 };
 
 // Generate IR code to find and load from nearest valid address
-static NearestValidResult generateNearestValidLoad(CallInst* AsanReportCall,
-                                                   Instruction* MemInst, Function& F) {
+static NearestValidResult generateNearestValidLoad(const cima::CheckSite& Site, Function& F) {
     LLVMContext& Ctx = F.getContext();
 
     BasicBlock* EntryBB = BasicBlock::Create(Ctx, "nearest_entry", &F);
@@ -58,9 +64,7 @@ static NearestValidResult generateNearestValidLoad(CallInst* AsanReportCall,
     BasicBlock* ExitBB = BasicBlock::Create(Ctx, "nearest_exit", &F);
 
     IRBuilder<> EntryBuilder(EntryBB);
-    Value* InvalidAddr = AsanReportCall->getArgOperand(0);  // i64
-    unsigned AccessSize =
-        getAccessSizeFromAsanReport(AsanReportCall->getCalledFunction()->getName());
+    Value* InvalidAddr = Site.Report->getArgOperand(0);  // i64
 
     Type* VoidPtrTy = PointerType::getUnqual(Ctx);
     FunctionType* HelperTy =
@@ -69,14 +73,14 @@ static NearestValidResult generateNearestValidLoad(CallInst* AsanReportCall,
         F.getParent()->getOrInsertFunction("__cima_find_nearest_valid", HelperTy);
 
     Value* InvalidPtr = EntryBuilder.CreateIntToPtr(InvalidAddr, VoidPtrTy);
-    Value* NearestPtr = EntryBuilder.CreateCall(
-        HelperFn, {InvalidPtr, EntryBuilder.getInt64(AccessSize)});
+    Value* NearestPtr =
+        EntryBuilder.CreateCall(HelperFn, {InvalidPtr, Site.getAccessSize(EntryBuilder)});
 
     Value* IsNull = EntryBuilder.CreateIsNull(NearestPtr);
     EntryBuilder.CreateCondBr(IsNull, NotFoundBB, FoundBB);
 
     IRBuilder<> FoundBuilder(FoundBB);
-    Type* LoadType = MemInst->getType();
+    Type* LoadType = Site.Access->getType();
     Type* LoadPtrTy = PointerType::getUnqual(Ctx);
     Value* CastPtr = FoundBuilder.CreateBitCast(NearestPtr, LoadPtrTy);
     Value* LoadedValue = FoundBuilder.CreateLoad(LoadType, CastPtr, "nearest.load");
@@ -91,127 +95,146 @@ static NearestValidResult generateNearestValidLoad(CallInst* AsanReportCall,
     ResultPhi->addIncoming(LoadedValue, FoundBB);
     ResultPhi->addIncoming(ZeroValue, NotFoundBB);
 
-    return {ResultPhi, EntryBB, ExitBB};
+    return {ResultPhi, EntryBB, ExitBB, {EntryBB, FoundBB, NotFoundBB, ExitBB}};
 }
 
 namespace {
 struct CIMAPass : public PassInfoMixin<CIMAPass> {
     PreservedAnalyses run(Function& F, FunctionAnalysisManager& FAM) {
-        llvm::BlockFrequencyAnalysis::Result& bfi =
-            FAM.getResult<BlockFrequencyAnalysis>(F);
-        llvm::BranchProbabilityAnalysis::Result& bpi =
-            FAM.getResult<BranchProbabilityAnalysis>(F);
+        if (!cima::shouldInstrument(F, cima::Policy::Nearest)) return PreservedAnalyses::all();
+
         llvm::LoopAnalysis::Result& li = FAM.getResult<LoopAnalysis>(F);
         llvm::DominatorTreeAnalysis::Result& dt = FAM.getResult<DominatorTreeAnalysis>(F);
 
-        std::vector<CallInst*> AsanCalls;
-        for (auto& BB : F) {
-            for (auto& I : BB) {
-                if (CallInst* CI = dyn_cast<CallInst>(&I)) {
-                    if (Function* CalledF = CI->getCalledFunction()) {
-                        if (CalledF->getName().starts_with("__asan_report")) {
-                            AsanCalls.push_back(CI);
-                        }
-                    }
-                }
-            }
+        // Everything below keeps the dominator tree and loop info up to date
+        PreservedAnalyses PA;
+        PA.preserve<DominatorTreeAnalysis>();
+        PA.preserve<LoopAnalysis>();
+
+        bool Changed = cima::expandAsanCallbacks(F, dt, li);
+        if (cima::CoalesceChecks) Changed |= cima::coalesceAsanChecks(F, dt, li);
+        if (Changed) FAM.invalidate(F, PA);
+        if (!cima::CoalesceChecks && cima::coalesceHotChecks(F, FAM, dt, li)) {
+            Changed = true;
+            FAM.invalidate(F, PA);
         }
 
-        std::unordered_map<Instruction*, BasicBlock*> MemInstToTargetBB;
+        const cima::CheckSites& Sites = FAM.getResult<cima::CheckSiteAnalysis>(F);
+        OptimizationRemarkEmitter& ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+        cima::remarkUnmatched(ORE, DEBUG_TYPE, Sites);
+        if (Sites.empty()) return Changed ? PA : PreservedAnalyses::all();
 
-        for (CallInst* CI : AsanCalls) {
-            BasicBlock* CrashBB = CI->getParent();
-            std::vector<BasicBlock*> Preds(pred_begin(CrashBB), pred_end(CrashBB));
-
-            for (BasicBlock* CheckBB : Preds) {
-                auto* BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
-
-                if (!BI || !BI->isConditional()) continue;
-                BasicBlock* SafeBB = nullptr;
-                unsigned CrashSuccIdx = 0;
-
-                if (BI->getSuccessor(0) == CrashBB) {
-                    SafeBB = BI->getSuccessor(1);
-                    CrashSuccIdx = 0;
-                } else if (BI->getSuccessor(1) == CrashBB) {
-                    SafeBB = BI->getSuccessor(0);
-                    CrashSuccIdx = 1;
-                } else {
-                    continue;
-                }
+        cima::SiteProfile Profile = cima::SiteProfile::get(F, Sites, ORE, DEBUG_TYPE);
+        Profile.setBranchWeights(Sites);
 
-                Instruction* MemInst = nullptr;
-                for (auto& I : *SafeBB) {
-                    if (isa<LoadInst>(&I) || isa<StoreInst>(&I) ||
-                        isa<AtomicRMWInst>(&I) || isa<AtomicCmpXchgInst>(&I)) {
-                        MemInst = &I;
-                        break;
-                    }
-                    if (auto* MCI = dyn_cast<MemIntrinsic>(&I)) {
-                        MemInst = &I;
-                        break;
-                    }
-                }
+        cima::PhaseTimer Timer("recover", "CIMA: recover failing accesses");
+        cima::ShadowMapping Mapping = cima::getShadowMapping(*F.getParent());
+        DomTreeUpdater DTU(dt, DomTreeUpdater::UpdateStrategy::Lazy);
 
-                if (!MemInst) continue;
+        std::unordered_map<Instruction*, BasicBlock*> MemInstToTargetBB;
 
-                BasicBlock* TargetBB = nullptr;
+        for (unsigned I = 0; I < Sites.Sites.size(); ++I) {
+            const cima::CheckSite& Site = Sites.Sites[I];
+            Instruction* MemInst = Site.Access;
+            BasicBlock* TargetBB = nullptr;
 
-                if (MemInstToTargetBB.count(MemInst)) {
-                    TargetBB = MemInstToTargetBB[MemInst];
-                } else {
-                    if (MemInst->isTerminator()) continue;
+            if (MemInstToTargetBB.count(MemInst)) {
+                TargetBB = MemInstToTargetBB[MemInst];
+            } else {
+                BasicBlock* AccessBB = MemInst->getParent();
+                TargetBB = SplitBlock(AccessBB, MemInst->getNextNode(), &DTU, &li);
+                MemInstToTargetBB[MemInst] = TargetBB;
 
-                    TargetBB = SplitBlock(SafeBB, MemInst->getNextNode(), &dt, &li);
-                    MemInstToTargetBB[MemInst] = TargetBB;
+                if (!MemInst->getType()->isVoidTy()) {
+                    PHINode* Phi = PHINode::Create(MemInst->getType(), 0,
+                                                   "cima.skipped", TargetBB->begin());
 
-                    if (!MemInst->getType()->isVoidTy()) {
-                        PHINode* Phi = PHINode::Create(MemInst->getType(), 0,
-                                                       "cima.skipped", TargetBB->begin());
+                    Phi->addIncoming(MemInst, AccessBB);
 
-                        Phi->addIncoming(MemInst, SafeBB);
+                    MemInst->replaceUsesWithIf(Phi, [&](Use& U) {
+                        Instruction* User = cast<Instruction>(U.getUser());
+                        return User != Phi;
+                    });
+                }
+            }
 
-                        MemInst->replaceUsesWithIf(Phi, [&](Use& U) {
-                            Instruction* User = cast<Instruction>(U.getUser());
-                            return User != Phi;
-                        });
-                    }
+            // Vector loads keep their addressable lanes; only the bad
+            // lanes take the recovery value. Checks that never failed in the
+            // profile skip both that and the nearest-valid search, and
+            // UBSan's checks, without ASan shadow, can use neither
+            bool Cheap = Profile.preferCheapRecovery(I) || !Site.HasShadow;
+            auto* VecLoad = dyn_cast<LoadInst>(MemInst);
+            if (!cima::MaskedVectorRecovery || !VecLoad || Cheap ||
+                !cima::canUseMaskedRecovery(VecLoad, Mapping)) {
+                VecLoad = nullptr;
+            }
+
+            if (UseNearestValid && !Cheap && !MemInst->getType()->isVoidTy() &&
+                isa<LoadInst>(MemInst)) {
+                auto Result = generateNearestValidLoad(Site, F);
+
+                IRBuilder<> ExitBuilder(Result.exitBlock);
+                Value* Recovered = Result.value;
+                if (VecLoad) {
+                    Recovered = cima::emitMaskedRecoveryLoad(ExitBuilder, VecLoad, Recovered,
+                                                             Mapping);
                 }
+                ExitBuilder.CreateBr(TargetBB);
 
-                if (UseNearestValid && !MemInst->getType()->isVoidTy() &&
-                    isa<LoadInst>(MemInst)) {
-                    auto Result = generateNearestValidLoad(CI, MemInst, F);
+                cima::redirectCrashEdge(Site, Result.entryBlock, Result.blocks, DTU, li);
 
-                    BI->setSuccessor(CrashSuccIdx, Result.entryBlock);
+                if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
+                    Phi->addIncoming(Recovered, Result.exitBlock);
+                }
+                ++NumNearestValid;
+                cima::remarkRecovered(ORE, DEBUG_TYPE, Site, "nearest valid");
 
-                    IRBuilder<> ExitBuilder(Result.exitBlock);
-                    ExitBuilder.CreateBr(TargetBB);
+            } else if (VecLoad) {
+                BasicBlock* MaskedBB =
+                    BasicBlock::Create(F.getContext(), "cima.masked", &F, TargetBB);
+                IRBuilder<> MaskedBuilder(MaskedBB);
+                Value* Recovered = cima::emitMaskedRecoveryLoad(
+                    MaskedBuilder, VecLoad, UndefValue::get(VecLoad->getType()), Mapping);
+                MaskedBuilder.CreateBr(TargetBB);
 
-                    if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
-                        Phi->addIncoming(Result.value, Result.exitBlock);
-                    }
+                cima::redirectCrashEdge(Site, MaskedBB, {MaskedBB}, DTU, li);
 
-                } else {
-                    BI->setSuccessor(CrashSuccIdx, TargetBB);
+                if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
+                    Phi->addIncoming(Recovered, MaskedBB);
+                }
+                ++NumMaskedRecovered;
+                cima::remarkRecovered(ORE, DEBUG_TYPE, Site, "addressable lanes");
 
-                    if (TargetBB && !MemInst->getType()->isVoidTy()) {
-                        if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
-                            Phi->addIncoming(UndefValue::get(MemInst->getType()),
-                                             CheckBB);
-                        }
+            } else {
+                BasicBlock* CheckBB = Site.checkBlock();
+                cima::redirectCrashEdge(Site, TargetBB, {}, DTU, li);
+
+                if (!MemInst->getType()->isVoidTy()) {
+                    if (PHINode* Phi = dyn_cast<PHINode>(&TargetBB->front())) {
+                        Phi->addIncoming(UndefValue::get(MemInst->getType()), CheckBB);
                     }
                 }
+                ++NumRecovered;
+                cima::remarkRecovered(ORE, DEBUG_TYPE, Site,
+                                      MemInst->getType()->isVoidTy() ? "skipped" : "undef");
             }
         }
 
+        if (cima::ProfileGenerate) cima::markSiteCounters(F, Sites);
+
         errs() << "CIMA: Instrumented function " << F.getName() << "\n";
 
-        return PreservedAnalyses::none();
+        return PA;
     }
 };
 }  // namespace
 extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginInfo() {
     return {LLVM_PLUGIN_API_VERSION, "CIMAPassNearestValid", "v0.1", [](PassBuilder& PB) {
+                cima::registerPolicyPrepare(PB);
+                cima::registerBudget(PB);
+                cima::registerOverheadReport(PB);
+                cima::registerCheckSiteAnalysis(PB);
+
                 PB.registerPipelineParsingCallback(
                     [](StringRef Name, FunctionPassManager& FPM,
                        ArrayRef<PassBuilder::PipelineElement>) {
@@ -221,11 +244,21 @@ extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginIn
                         }
                         return false;
                     });
+                // At the top level the pass also gets its profile counters
+                PB.registerPipelineParsingCallback(
+                    [](StringRef Name, ModulePassManager& MPM,
+                       ArrayRef<PassBuilder::PipelineElement>) {
+                        if (Name == "CIMAPassNearestValid") {
+                            cima::addWithSiteCounters(MPM, CIMAPass());
+                            return true;
+                        }
+                        return false;
+                    });
 
                 PB.registerOptimizerLastEPCallback([](llvm::ModulePassManager& MPM,
                                                       llvm::OptimizationLevel Level,
                                                       llvm::ThinOrFullLTOPhase Phase) {
-                    MPM.addPass(createModuleToFunctionPassAdaptor(CIMAPass()));
+                    cima::addWithSiteCounters(MPM, CIMAPass());
                 });
             }};
 }
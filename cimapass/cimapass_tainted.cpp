@@ -1,8 +1,17 @@
-#include "llvm/Analysis/BlockFrequencyInfo.h"
-#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "cima_budget.h"
+#include "cima_callbacks.h"
+#include "cima_check_sites.h"
+#include "cima_coalesce.h"
+#include "cima_policy.h"
+#include "cima_profile.h"
+#include "cima_report.h"
+#include "cima_shadow.h"
+#include "cima_timing.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopIterator.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Instructions.h"
@@ -17,14 +26,23 @@
 #include "llvm/Transforms/Utils/LoopUtils.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/raw_ostream.h" 
 #include "llvm/Support/CommandLine.h" 
 
 #include <unordered_set>
 #include <vector>
 
+#define DEBUG_TYPE "cima-tainted"
+
 using namespace llvm;
 
+STATISTIC(NumShadowAllocas, "Shadow allocas created for stack variables");
+STATISTIC(NumTaintedLoads, "Loads reading a taint from the shadow stack");
+STATISTIC(NumRecovered, "Failing accesses skipped or recovered with a tainted undef");
+STATISTIC(NumMaskedRecovered, "Failing vector loads recovered lane by lane");
+STATISTIC(NumGuardedStores, "Stores guarded by their taint");
+
 // Define the command line flag "-cima-debug"
 static cl::opt<bool> CIMADebug("cima-debug", 
                                cl::desc("Enable CIMA Pass debug logging and runtime printing"), 
@@ -103,6 +121,7 @@ namespace {
     // PHASE 1: Allocas
     void createShadowAllocas(Function &F) {
       log("[CIMA] Phase 1: Allocating Shadow Stack\n");
+      cima::PhaseTimer Timer("tainted-allocas", "CIMA tainted: allocate shadow stack");
       BasicBlock &EntryBB = F.getEntryBlock();
       IRBuilder<> EntryBuilder(&*EntryBB.begin());
       
@@ -113,6 +132,7 @@ namespace {
                                                                AI->getName() + ".shadow");
               ShadowAI->setAlignment(Align(1));
               PtrToShadowPtr[AI] = ShadowAI;
+              ++NumShadowAllocas;
           }
       }
     }
@@ -120,6 +140,7 @@ namespace {
     // PHASE 1.5: GEPs
     void propagateShadowPointers(Function &F) {
       log("[CIMA] Phase 1.5: Propagating Shadow Pointers\n");
+      cima::PhaseTimer Timer("tainted-pointers", "CIMA tainted: propagate shadow pointers");
       const DataLayout &DL = F.getParent()->getDataLayout();
       Type *IntPtrTy = DL.getIntPtrType(F.getContext());
 
@@ -149,6 +170,7 @@ namespace {
     // PHASE 2: Load
     void instrumentLoads(Function &F) {
       log("[CIMA] Phase 2: Instrumenting Loads\n");
+      cima::PhaseTimer Timer("tainted-loads", "CIMA tainted: instrument loads");
       for (auto &BB : F) {
           for (auto &I : BB) {
               if (auto *LI = dyn_cast<LoadInst>(&I)) {
@@ -158,6 +180,7 @@ namespace {
                       Value *ShadowLoad = B.CreateLoad(B.getInt8Ty(), PtrToShadowPtr[Ptr], "load.taint");
                       Value *IsTainted = B.CreateTrunc(ShadowLoad, B.getInt1Ty());
                       ValTaintMap[LI] = IsTainted;
+                      ++NumTaintedLoads;
                   }
               }
           }
@@ -165,84 +188,84 @@ namespace {
     }
 
     // PHASE 3: Recovery
-    void injectRecovery(Function &F, DominatorTreeAnalysis::Result &dt, LoopAnalysis::Result &li) {
+    void injectRecovery(Function &F, const cima::CheckSites &Sites, const cima::SiteProfile &Profile,
+                        DomTreeUpdater &DTU, LoopAnalysis::Result &li, OptimizationRemarkEmitter &ORE) {
       log("[CIMA] Phase 3: Injecting Recovery Logic\n");
-      std::vector<CallInst*> AsanCalls;
-      for (auto &BB : F) {
-        for (auto &I : BB) {
-          if (CallInst *CI = dyn_cast<CallInst>(&I)) {
-            if (Function *C = CI->getCalledFunction()) {
-              if (C->getName().starts_with("__asan_report")) AsanCalls.push_back(CI);
-            }
-          }
-        }
-      }
-
+      cima::PhaseTimer Timer("tainted-recovery", "CIMA tainted: inject recovery");
       std::unordered_map<Instruction*, BasicBlock*> MemInstToTargetBB;
+      cima::ShadowMapping Mapping = cima::getShadowMapping(*F.getParent());
 
-      for (CallInst *CI : AsanCalls) {
-          BasicBlock *CrashBB = CI->getParent();
-          BasicBlock *CheckBB = CrashBB->getSinglePredecessor();
-          if (!CheckBB) continue;
-
-          auto *BI = dyn_cast<BranchInst>(CheckBB->getTerminator());
-          if (!BI || !BI->isConditional()) continue;
-
-          BasicBlock *SafeBB = (BI->getSuccessor(0) == CrashBB) ? BI->getSuccessor(1) : BI->getSuccessor(0);
-          unsigned CrashIdx = (BI->getSuccessor(0) == CrashBB) ? 0 : 1;
-
-          Instruction *MemInst = nullptr;
-          for (auto &I : *SafeBB) {
-               if (isa<LoadInst>(&I) || isa<StoreInst>(&I) || isa<MemIntrinsic>(&I)) {
-                   MemInst = &I; break;
-               }
-          }
-          if (!MemInst) continue;
+      for (unsigned I = 0; I < Sites.Sites.size(); ++I) {
+          const cima::CheckSite &Site = Sites.Sites[I];
+          Instruction *MemInst = Site.Access;
+          BasicBlock *CheckBB = Site.checkBlock();
 
           BasicBlock *TargetBB = nullptr;
           if (MemInstToTargetBB.count(MemInst)) {
               TargetBB = MemInstToTargetBB[MemInst];
           } else {
-              TargetBB = SplitBlock(SafeBB, MemInst->getNextNode(), &dt, &li);
+              BasicBlock *AccessBB = MemInst->getParent();
+              TargetBB = SplitBlock(AccessBB, MemInst->getNextNode(), &DTU, &li);
               MemInstToTargetBB[MemInst] = TargetBB;
 
               if (!MemInst->getType()->isVoidTy()) {
                   IRBuilder<> B(&*TargetBB->begin());
                   PHINode *ValPhi = B.CreatePHI(MemInst->getType(), 2, "cima.val");
-                  ValPhi->addIncoming(MemInst, SafeBB);
-                  ValPhi->addIncoming(UndefValue::get(MemInst->getType()), CheckBB);
+                  ValPhi->addIncoming(MemInst, AccessBB);
 
                   PHINode *TaintPhi = B.CreatePHI(B.getInt1Ty(), 2, "cima.taint");
                   
                   Value *ExistingTaint = B.getFalse();
                   if (ValTaintMap.count(MemInst)) ExistingTaint = ValTaintMap[MemInst];
 
-                  TaintPhi->addIncoming(ExistingTaint, SafeBB); 
-                  TaintPhi->addIncoming(B.getTrue(), CheckBB); 
+                  TaintPhi->addIncoming(ExistingTaint, AccessBB); 
 
                   ValTaintMap[ValPhi] = TaintPhi;
                   
                   MemInst->replaceUsesWithIf(ValPhi, [&](Use &U) { return U.getUser() != ValPhi; });
               }
           }
-          BI->setSuccessor(CrashIdx, TargetBB);
+          // Vector loads recover lane by lane, unless the profile never saw
+          // them fail; the value is still tainted
+          BasicBlock *RecoverBB = CheckBB;
+          Value *Recovered = nullptr;
+          auto *VecLoad = dyn_cast<LoadInst>(MemInst);
+          if (cima::MaskedVectorRecovery && VecLoad && Site.HasShadow && !Profile.preferCheapRecovery(I) &&
+              cima::canUseMaskedRecovery(VecLoad, Mapping)) {
+              RecoverBB = BasicBlock::Create(F.getContext(), "cima.masked", &F, TargetBB);
+              IRBuilder<> MB(RecoverBB);
+              Recovered = cima::emitMaskedRecoveryLoad(MB, VecLoad, UndefValue::get(VecLoad->getType()), Mapping);
+              MB.CreateBr(TargetBB);
+          }
+          if (RecoverBB == CheckBB) cima::redirectCrashEdge(Site, TargetBB, {}, DTU, li);
+          else cima::redirectCrashEdge(Site, RecoverBB, {RecoverBB}, DTU, li);
           
-          if (TargetBB) {
-              for (PHINode &Phi : TargetBB->phis()) {
-                  if (Phi.getBasicBlockIndex(CheckBB) == -1) {
-                      if (Phi.getName().starts_with("cima.taint")) 
-                          Phi.addIncoming(ConstantInt::getTrue(Phi.getContext()), CheckBB);
-                      else 
-                          Phi.addIncoming(UndefValue::get(MemInst->getType()), CheckBB);
-                  }
+          for (PHINode &Phi : TargetBB->phis()) {
+              if (Phi.getBasicBlockIndex(RecoverBB) == -1) {
+                  if (Phi.getName().starts_with("cima.taint")) 
+                      Phi.addIncoming(ConstantInt::getTrue(Phi.getContext()), RecoverBB);
+                  else if (Recovered)
+                      Phi.addIncoming(Recovered, RecoverBB);
+                  else 
+                      Phi.addIncoming(UndefValue::get(MemInst->getType()), RecoverBB);
               }
           }
+
+          StringRef How = MemInst->getType()->isVoidTy() ? "skipped" : "tainted undef";
+          if (Recovered) {
+              How = "tainted addressable lanes";
+              ++NumMaskedRecovered;
+          } else {
+              ++NumRecovered;
+          }
+          cima::remarkRecovered(ORE, DEBUG_TYPE, Site, How);
       }
     }
 
     // PHASE 4: SSA PROPAGATION
     void propagateSSA(Function &F) {
         log("[CIMA] Phase 4: Propagating Taint via SSA (Data + Control)\n");
+        cima::PhaseTimer Timer("tainted-ssa", "CIMA tainted: propagate taint through SSA");
         BlockExecTaintMap.clear();
 
         for (auto &BB : F) {
@@ -356,8 +379,9 @@ namespace {
     }
 
     // PHASE 5: Store
-    void instrumentStores(Function &F, DominatorTreeAnalysis::Result &dt, LoopAnalysis::Result &li) {
+    void instrumentStores(Function &F, DomTreeUpdater &DTU, LoopAnalysis::Result &li) {
       log("[CIMA] Phase 5: Instrumenting Stores\n");
+      cima::PhaseTimer Timer("tainted-stores", "CIMA tainted: instrument stores");
       struct StoreInfo { StoreInst *SI; Value *IsTainted; };
       std::vector<StoreInfo> StoresToInstrument;
 
@@ -393,12 +417,13 @@ namespace {
           }
       }
 
-      for (auto &Item : StoresToInstrument) {
+      // Back to front, so each split only moves the code up to the next store
+      for (auto &Item : llvm::reverse(StoresToInstrument)) {
           StoreInst *SI = Item.SI;
           if (SI->isTerminator()) continue; 
           BasicBlock *OrigBB = SI->getParent();
-          BasicBlock *ExecBB = SplitBlock(OrigBB, SI, &dt, &li);
-          BasicBlock *ContBB = SplitBlock(ExecBB, SI->getNextNode(), &dt, &li);
+          BasicBlock *ExecBB = SplitBlock(OrigBB, SI, &DTU, &li);
+          BasicBlock *ContBB = SplitBlock(ExecBB, SI->getNextNode(), &DTU, &li);
           Instruction *Term = OrigBB->getTerminator();
 
           if (CIMADebug) {
@@ -428,26 +453,51 @@ namespace {
           }
           BranchInst *NewBr = BranchInst::Create(ContBB, ExecBB, Item.IsTainted);
           ReplaceInstWithInst(Term, NewBr);
+          ++NumGuardedStores;
+          DTU.applyUpdates({{DominatorTree::Insert, OrigBB, ContBB}});
       }
     }
 
     PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM) {
+      if (!cima::shouldInstrument(F, cima::Policy::Tainted)) return PreservedAnalyses::all();
+
       if (!PrintfFormatStr && CIMADebug) setupRuntimeLogging(*F.getParent());
 
       llvm::DominatorTreeAnalysis::Result &dt = FAM.getResult<DominatorTreeAnalysis>(F);
       llvm::LoopAnalysis::Result &li = FAM.getResult<LoopAnalysis>(F);
 
+      // Every phase keeps the dominator tree and loop info up to date
+      PreservedAnalyses PA;
+      PA.preserve<DominatorTreeAnalysis>();
+      PA.preserve<LoopAnalysis>();
+
+      bool Changed = cima::expandAsanCallbacks(F, dt, li);
+      if (cima::CoalesceChecks) Changed |= cima::coalesceAsanChecks(F, dt, li);
+      if (Changed) FAM.invalidate(F, PA);
+      if (!cima::CoalesceChecks && cima::coalesceHotChecks(F, FAM, dt, li)) {
+        Changed = true;
+        FAM.invalidate(F, PA);
+      }
+
+      const cima::CheckSites &Sites = FAM.getResult<cima::CheckSiteAnalysis>(F);
+      OptimizationRemarkEmitter &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+      cima::remarkUnmatched(ORE, DEBUG_TYPE, Sites);
+      cima::SiteProfile Profile = cima::SiteProfile::get(F, Sites, ORE, DEBUG_TYPE);
+      Profile.setBranchWeights(Sites);
+      DomTreeUpdater DTU(dt, DomTreeUpdater::UpdateStrategy::Lazy);
+
       ValTaintMap.clear();
       PtrToShadowPtr.clear();
 
       createShadowAllocas(F);
       propagateShadowPointers(F);
       instrumentLoads(F);
-      injectRecovery(F, dt, li);
+      injectRecovery(F, Sites, Profile, DTU, li, ORE);
       propagateSSA(F); 
-      instrumentStores(F, dt, li);
+      instrumentStores(F, DTU, li);
+      if (cima::ProfileGenerate) cima::markSiteCounters(F, Sites);
 
-      return PreservedAnalyses::none();
+      return PA;
     }
   };
 }
@@ -456,15 +506,26 @@ extern "C" ::llvm::PassPluginLibraryInfo LLVM_ATTRIBUTE_WEAK llvmGetPassPluginIn
   return {
     LLVM_PLUGIN_API_VERSION, "CIMAPassTainted", "v0.1",
     [](PassBuilder &PB) {
+      cima::registerPolicyPrepare(PB);
+      cima::registerBudget(PB);
+      cima::registerOverheadReport(PB);
+      cima::registerCheckSiteAnalysis(PB);
       PB.registerPipelineParsingCallback(
         [](StringRef Name, FunctionPassManager &FPM, ArrayRef<PassBuilder::PipelineElement>) {
              if (Name == "CIMAPassTainted") { FPM.addPass(CIMAPass()); return true; }
              return false;
         }
       );
+      // At the top level the pass also gets its profile counters
+      PB.registerPipelineParsingCallback(
+        [](StringRef Name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>) {
+             if (Name == "CIMAPassTainted") { cima::addWithSiteCounters(MPM, CIMAPass()); return true; }
+             return false;
+        }
+      );
       PB.registerOptimizerLastEPCallback(
         [](llvm::ModulePassManager &MPM, llvm::OptimizationLevel Level, llvm::ThinOrFullLTOPhase Phase) {
-             MPM.addPass(createModuleToFunctionPassAdaptor(CIMAPass()));
+             cima::addWithSiteCounters(MPM, CIMAPass());
         }
       );
     }
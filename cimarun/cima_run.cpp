@@ -0,0 +1,220 @@
+// cima-run - instrument a module in memory and run it under ORC LLJIT
+//
+// Loads the IR clang emits for a source file (-emit-llvm -fsanitize=address
+// -Xclang -disable-llvm-passes), runs the policy pass, ASan and the selected
+// CIMA plugin on it the way tests/pipeline_unified.sh does, and calls main in
+// the JIT. The ASan runtime and cima_runtime are linked into cima-run itself,
+// so the JIT-compiled code resolves __asan_* and __cima_* to this process.
+// Nothing is written to disk, which keeps an edit-instrument-run iteration
+// well under a second.
+//
+// Linking the ASan runtime in means even --pass=none runs with its allocator
+// and interceptors, so --time-phases timings are only comparable between
+// cima-run variants, not with the pipeline's binaries.
+//
+// Plugin options (-cima-*) and LLVM options (-asan-*) are accepted as with
+// opt; arguments after the input file are passed to the program.
+//
+// Usage: cima-run --pass=VARIANT [options] <input.bc|input.ll> [program args]
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> PassVariant(
+    "pass", cl::desc("Pass variant: base, nearest, tainted, native, asan or none"),
+    cl::value_desc("variant"), cl::Required);
+
+static cl::opt<std::string> PluginDir(
+    "plugin-dir", cl::desc("Directory with the CIMA plugins (default: " CIMA_PLUGIN_DIR ")"),
+    cl::init(CIMA_PLUGIN_DIR));
+
+static cl::opt<unsigned> OptLevel(
+    "O", cl::desc("Optimize at this level before ASan, like pipeline_unified.sh --opt"),
+    cl::Prefix, cl::init(0));
+
+static cl::opt<bool> TimePhases(
+    "time-phases", cl::desc("Time parsing, instrumentation, JIT compilation and the run"));
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::desc("<input bitcode or IR>"),
+                                      cl::Required);
+
+static cl::list<std::string> ProgramArgs(cl::ConsumeAfter, cl::desc("<program arguments>..."));
+
+// The JIT and LLVM keep their allocations until exit; LeakSanitizer would
+// report them along with the program's own leaks. ASAN_OPTIONS overrides.
+extern "C" const char* __asan_default_options() { return "detect_leaks=0"; }
+
+namespace {
+
+struct Variant {
+    const char* Name;
+    const char* Plugin;    // nullptr: no CIMA plugin
+    const char* Pipeline;  // run after the optional default<On>
+};
+
+// Same order of passes as tests/pipeline_unified.sh. The recovery passes
+// are named at the top level, where -cima-profile-generate also gets the
+// module pass that creates its counters
+const Variant Variants[] = {
+    {"none", nullptr, ""},
+    {"asan", nullptr, "asan"},
+    {"base", "CIMAPass.so", "cima-policy-prepare,asan,CIMAPass"},
+    {"nearest", "CIMAPassNearestValid.so", "cima-policy-prepare,asan,CIMAPassNearestValid"},
+    {"tainted", "CIMAPassTainted.so", "cima-policy-prepare,asan,CIMAPassTainted"},
+    {"native", "CIMAPassNative.so", "cima-policy-prepare,function(CIMAPassNative),asan"},
+};
+
+const Variant* findVariant(StringRef Name) {
+    for (const Variant& V : Variants) {
+        if (Name == V.Name) return &V;
+    }
+    return nullptr;
+}
+
+// The value of --NAME=VALUE or -NAME=VALUE in argv, if given
+std::optional<StringRef> findArg(int argc, char** argv, StringRef Name) {
+    for (int I = 1; I < argc; ++I) {
+        StringRef Arg = argv[I];
+        if (!Arg.consume_front("-")) continue;
+        Arg.consume_front("-");
+        if (Arg.consume_front(Name) && Arg.consume_front("=")) return Arg;
+    }
+    return std::nullopt;
+}
+
+// Option defaults the pipeline applies that differ from LLVM's and the
+// plugins', unless given on the command line
+void setDefaultOptions(const Variant& V) {
+    StringMap<cl::Option*>& Options = cl::getRegisteredOptions();
+    auto setDefault = [&](StringRef Name, bool Value) {
+        auto* Opt = static_cast<cl::opt<bool>*>(Options.lookup(Name));
+        if (Opt && Opt->getNumOccurrences() == 0) Opt->setValue(Value);
+    };
+    // The JIT defines no __start_/__stop_ section symbols, so ASan must
+    // register globals from its metadata array instead of a section
+    setDefault("asan-globals-live-support", false);
+    // pipeline_unified.sh --pass=nearest enables the nearest-valid search
+    if (StringRef(V.Name) == "nearest") setDefault("cima-use-nearest-valid", true);
+}
+
+Error instrument(Module& M, const Variant& V, std::optional<PassPlugin>& Plugin) {
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+
+    PassBuilder PB;
+    if (Plugin) Plugin->registerPassBuilderCallbacks(PB);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    std::string Pipeline = V.Pipeline;
+    if (OptLevel > 0) {
+        std::string Default = "default<O" + std::to_string(OptLevel) + ">";
+        Pipeline = Pipeline.empty() ? Default : Default + "," + Pipeline;
+    }
+    if (Pipeline.empty()) return Error::success();
+
+    ModulePassManager MPM;
+    if (Error Err = PB.parsePassPipeline(MPM, Pipeline)) return Err;
+    MPM.addPass(VerifierPass());
+    MPM.run(M, MAM);
+    return Error::success();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    InitLLVM X(argc, argv);
+    ExitOnError ExitOnErr("cima-run: ");
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    // Load the plugin before parsing the command line so its -cima-*
+    // options are known, as opt does for -load-pass-plugin
+    std::optional<StringRef> VariantName = findArg(argc, argv, "pass");
+    const Variant* V = VariantName ? findVariant(*VariantName) : nullptr;
+    std::optional<PassPlugin> Plugin;
+    if (V && V->Plugin) {
+        std::string Dir = findArg(argc, argv, "plugin-dir").value_or(CIMA_PLUGIN_DIR).str();
+        Plugin = ExitOnErr(PassPlugin::Load(Dir + "/" + V->Plugin));
+    }
+
+    cl::ParseCommandLineOptions(argc, argv, "CIMA instrument-and-run JIT\n");
+    if (!V) {
+        errs() << "cima-run: unknown pass variant '" << PassVariant
+               << "'; use --pass=base|nearest|tainted|native|asan|none\n";
+        return 1;
+    }
+    setDefaultOptions(*V);
+
+    auto Context = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> M;
+    {
+        NamedRegionTimer T("parse", "Parse IR", "cima-run", "cima-run phases", TimePhases);
+        SMDiagnostic Diag;
+        M = parseIRFile(InputFile, Diag, *Context);
+        if (!M) {
+            Diag.print(argv[0], errs());
+            return 1;
+        }
+    }
+
+    {
+        NamedRegionTimer T("instrument", "Instrument", "cima-run", "cima-run phases",
+                           TimePhases);
+        ExitOnErr(instrument(*M, *V, Plugin));
+    }
+
+    std::unique_ptr<orc::LLJIT> J;
+    int (*Main)(int, char**) = nullptr;
+    {
+        NamedRegionTimer T("jit", "JIT compile and initialize", "cima-run", "cima-run phases",
+                           TimePhases);
+        J = ExitOnErr(orc::LLJITBuilder().create());
+        orc::JITDylib& JD = J->getMainJITDylib();
+        // libc, the ASan runtime and cima_runtime, all in this process
+        JD.addGenerator(ExitOnErr(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            J->getDataLayout().getGlobalPrefix())));
+        ExitOnErr(J->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Context))));
+        // Runs llvm.global_ctors, which include ASan's module constructor
+        ExitOnErr(J->initialize(JD));
+        Main = ExitOnErr(J->lookup("main")).toPtr<int (*)(int, char**)>();
+    }
+
+    int Result;
+    {
+        NamedRegionTimer T("run", "Run main", "cima-run", "cima-run phases", TimePhases);
+        std::vector<std::string> Args(ProgramArgs.begin(), ProgramArgs.end());
+        Result = orc::runAsMain(Main, Args, StringRef(InputFile));
+    }
+    ExitOnErr(J->deinitialize(J->getMainJITDylib()));
+    return Result;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+    double current_speed;
+    int last_pwm;
+    int consecutive_zeros;
+} fan_state_t;
+
+// Field-by-field copy: three adjacent accesses per side, one coalesced check each
+void copy_state(fan_state_t *dst, const fan_state_t *src) {
+    dst->current_speed = src->current_speed;
+    dst->last_pwm = src->last_pwm;
+    dst->consecutive_zeros = src->consecutive_zeros;
+}
+
+// Manually unrolled window read; the last window runs past the buffer
+int sum4(const int *buf, int start) {
+    const int *w = buf + start;
+    return w[0] + w[1] + w[2] + w[3];
+}
+
+int main() {
+    fan_state_t *a = (fan_state_t *)malloc(sizeof(fan_state_t));
+    fan_state_t b;
+    a->current_speed = 42.0;
+    a->last_pwm = 70;
+    a->consecutive_zeros = 1;
+
+    copy_state(&b, a);
+    printf("copy: speed=%.1f pwm=%d zeros=%d\n", b.current_speed, b.last_pwm,
+           b.consecutive_zeros);
+
+    int *samples = (int *)malloc(8 * sizeof(int));
+    for (int i = 0; i < 8; i++) {
+        samples[i] = i + 1;
+    }
+
+    // Fast path: the whole window is addressable
+    printf("sum4(0) = %d\n", sum4(samples, 0));
+    // Slow path: the group check fails and per-access recovery takes over
+    printf("sum4(6) = %d\n", sum4(samples, 6));
+
+    free(samples);
+    free(a);
+    return 0;
+}
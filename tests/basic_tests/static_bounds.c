@@ -0,0 +1,31 @@
+// Out-of-bounds indexing of statically sized arrays, the case the bounds
+// variant recovers from without ASan:
+//   ./pipeline_unified.sh basic_tests/static_bounds.c --pass=bounds
+#include <stdio.h>
+
+#define N_OUTPUTS 4
+
+int control_array[N_OUTPUTS];
+int guard[N_OUTPUTS] = {7, 7, 7, 7};
+
+int read_output(int i) { return control_array[i]; }
+
+void set_output(int i, int value) { control_array[i] = value; }
+
+void bump_output(int i) { control_array[i]++; }
+
+int main(void) {
+    double fill_table[6] = {0.0, 0.9, 1.8, 2.7, 3.6, 4.5};
+    volatile int idx = 8;
+
+    set_output(1, 42);
+    set_output(N_OUTPUTS + 1, 999);  // would overwrite guard[1]
+    bump_output(N_OUTPUTS);          // would increment guard[0]
+    int out = read_output(N_OUTPUTS + 2);
+    double fill = fill_table[idx];
+
+    printf("out=%d fill=%.1f control[1]=%d guard=%d,%d\n", out, fill, control_array[1],
+           guard[0], guard[1]);
+    printf("Execution continued past the violations\n");
+    return 0;
+}
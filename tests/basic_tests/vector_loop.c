@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// Vectorizes at -O2; the reads of the last vector run past the buffer when n
+// is larger than the allocation
+int sum(const int *buf, int n) {
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += buf[i];
+    }
+    return total;
+}
+
+// A packed frame leaves values[] at offset 1: the vector loads are
+// under-aligned and their lanes straddle shadow granules
+struct __attribute__((packed)) frame {
+    char tag;
+    int values[14];
+};
+
+int sum_packed(const struct frame *f, int n) {
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        total += f->values[i];
+    }
+    return total;
+}
+
+int main() {
+    int *samples = (int *)malloc(14 * sizeof(int));
+    for (int i = 0; i < 14; i++) {
+        samples[i] = 1;
+    }
+
+    printf("sum(12) = %d\n", sum(samples, 12));
+    // Overflow by two elements: the in-bounds lanes of the last vector are kept
+    printf("sum(16) = %d\n", sum(samples, 16));
+
+    struct frame *f = (struct frame *)malloc(sizeof(struct frame));
+    for (int i = 0; i < 14; i++) {
+        f->values[i] = 1;
+    }
+    printf("sum_packed(12) = %d\n", sum_packed(f, 12));
+    // The last vector straddles into the redzone and must not be masked
+    printf("sum_packed(16) = %d\n", sum_packed(f, 16));
+
+    free(f);
+    free(samples);
+    return 0;
+}
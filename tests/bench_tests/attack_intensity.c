@@ -0,0 +1,175 @@
+// Attack-intensity benchmark: recovery-path throughput
+//
+// Every other benchmark only measures in-bounds execution, but under attack
+// the recovery path is what a CIMA-protected controller runs. This program
+// indexes heap, stack and global tables with an index stream in which a
+// given fraction of indices points past the end of the table, and reports
+// throughput and per-access latency for each combination of
+//
+//   object     heap | stack | global
+//   distance   how far past the end (in elements) bad indices land; the
+//              defaults stay inside ASan's smallest right redzone (32 bytes)
+//   rate       fraction of out-of-bounds accesses (0%, 0.1%, 1%, 10%, 100%)
+//
+// Build every variant and compare them:
+//   ./pipeline_unified.sh bench_tests/attack_intensity.c --pass=all
+// or one at a time, each under its own --output name so they do not
+// overwrite each other:
+//   ./pipeline_unified.sh bench_tests/attack_intensity.c --pass=base --output=ai_base_final
+// Each row is labelled with the variant the pipeline built (CIMA_VARIANT).
+//
+// Only loads go out of bounds, so the none and asan builds are meaningful
+// at rate 0 only (asan stops at the first bad access). A bad index that
+// skips the redzone reads a neighbouring object through a passing check,
+// which is fast-path, not recovery, throughput; the Redzone column says
+// whether bad indices land in poisoned memory ("n/a" without ASan).
+//
+// Optional arguments: [accesses] [rate,...] [distance,...]
+//   e.g. attack_intensity_base_final 1000000 0,0.01,1 1,4
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cima_variant.h"
+
+#ifndef TABLE_SIZE
+#define TABLE_SIZE 64  // elements per table (256 bytes)
+#endif
+
+#ifndef DEFAULT_ACCESSES
+#define DEFAULT_ACCESSES 1000000
+#endif
+
+#define MAX_PARAMS 16
+
+static const double default_rates[] = {0.0, 0.001, 0.01, 0.1, 1.0};
+static const long default_distances[] = {0, 2, 4, 7};
+
+int global_table[TABLE_SIZE];
+volatile long sink;
+
+// Weak so the none and bounds builds, which link no ASan runtime, still link
+int __asan_address_is_poisoned(void const volatile* addr) __attribute__((weak));
+
+// Whether index TABLE_SIZE + distance of table falls in a redzone, so that
+// its check fails and the variant's recovery runs
+static const char* redzone_hit(const int* table, long distance) {
+    if (!__asan_address_is_poisoned) return "n/a";
+    return __asan_address_is_poisoned(table + TABLE_SIZE + distance) ? "yes" : "no";
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Deterministic index stream: every access in bounds except a `rate`
+// fraction, which land `distance` elements past the end of the table
+static void fill_indices(long* idx, long n, double rate, long distance) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    uint64_t threshold = (uint64_t)(rate * 4294967296.0);
+    for (long i = 0; i < n; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t r = (uint32_t)(state >> 32);
+        if (rate >= 1.0 || r < threshold) {
+            idx[i] = TABLE_SIZE + distance;
+        } else {
+            idx[i] = r % TABLE_SIZE;
+        }
+    }
+}
+
+// The measured loops. One check per access; with rate > 0 a share of the
+// checks fail and go through the variant's recovery path.
+static long sum_table(int* table, const long* idx, long n) {
+    long sum = 0;
+    for (long i = 0; i < n; i++) {
+        sum += table[idx[i]];
+    }
+    return sum;
+}
+
+static long sum_stack(const long* idx, long n, long distance, const char** redzone) {
+    int stack_table[TABLE_SIZE];
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        stack_table[i] = i;
+    }
+    *redzone = redzone_hit(stack_table, distance);
+    return sum_table(stack_table, idx, n);
+}
+
+static void report(const char* variant, const char* object, long distance, const char* redzone, double rate,
+                   long n, double ns) {
+    printf("%-8s  %-6s  %8ld  %7s  %7.3f%%  %10.2f  %10.3f\n", variant, object, distance, redzone,
+           rate * 100.0, n / (ns / 1e3), ns / n);
+}
+
+static int parse_list(const char* text, double* out) {
+    int count = 0;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", text);
+    for (char* tok = strtok(buf, ","); tok && count < MAX_PARAMS; tok = strtok(NULL, ",")) {
+        out[count++] = atof(tok);
+    }
+    return count;
+}
+
+int main(int argc, char** argv) {
+    long n = DEFAULT_ACCESSES;
+    double rates[MAX_PARAMS];
+    double distances[MAX_PARAMS];
+    int n_rates = sizeof(default_rates) / sizeof(default_rates[0]);
+    int n_distances = sizeof(default_distances) / sizeof(default_distances[0]);
+    for (int i = 0; i < n_rates; i++) rates[i] = default_rates[i];
+    for (int i = 0; i < n_distances; i++) distances[i] = default_distances[i];
+
+    if (argc > 1) n = atol(argv[1]);
+    if (argc > 2) n_rates = parse_list(argv[2], rates);
+    if (argc > 3) n_distances = parse_list(argv[3], distances);
+    if (n <= 0 || n_rates == 0 || n_distances == 0) {
+        fprintf(stderr, "Usage: %s [accesses] [rate,...] [distance,...]\n", argv[0]);
+        return 1;
+    }
+
+    const char* variant = CIMA_VARIANT;
+
+    long* idx = malloc(n * sizeof(long));
+    int* heap_table = malloc(TABLE_SIZE * sizeof(int));
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        heap_table[i] = i;
+        global_table[i] = i;
+    }
+
+    printf("Attack intensity: %ld accesses per configuration, table of %d ints\n", n, TABLE_SIZE);
+    printf("%-8s  %-6s  %8s  %7s  %8s  %10s  %10s\n", "Variant", "Object", "Distance", "Redzone", "OOB rate",
+           "Macc/s", "ns/access");
+
+    for (int d = 0; d < n_distances; d++) {
+        long distance = (long)distances[d];
+        for (int r = 0; r < n_rates; r++) {
+            fill_indices(idx, n, rates[r], distance);
+
+            const char* redzone;
+            double t = now_ns();
+            sink = sum_table(heap_table, idx, n);
+            report(variant, "heap", distance, redzone_hit(heap_table, distance), rates[r], n, now_ns() - t);
+
+            t = now_ns();
+            sink = sum_stack(idx, n, distance, &redzone);
+            report(variant, "stack", distance, redzone, rates[r], n, now_ns() - t);
+
+            t = now_ns();
+            sink = sum_table(global_table, idx, n);
+            report(variant, "global", distance, redzone_hit(global_table, distance), rates[r], n,
+                   now_ns() - t);
+        }
+    }
+
+    free(heap_table);
+    free(idx);
+    return 0;
+}
@@ -0,0 +1,77 @@
+// CPS benchmark: ADC-driven fan controller
+//
+// The controller from nearest_valid_tests/adc_nearest_valid.c run as a
+// fixed-rate loop. Each cycle reads an ADC channel from the trace, maps it
+// through control_array to a PWM duty and updates the fan model. During the
+// attack phase the ADC alternates between 4 and 11; 11 indexes two
+// elements past the end of the 10-entry control_array.
+
+#include "cps_bench.h"
+
+#define ARRAY_SIZE 10
+
+typedef struct {
+    double current_speed;
+    int last_pwm;
+    int consecutive_zeros;
+} fan_state_t;
+
+int* control_array;
+fan_state_t fan;
+
+static int32_t synthesize(uint64_t cycle, int attack) {
+    int is_high_cycle = cycle % 2 == 1;
+    if (attack) return is_high_cycle ? 11 : 4;
+    return is_high_cycle ? 9 : 2;
+}
+
+static void fan_speed(fan_state_t* state, int pwm_value) {
+    int logical_value = pwm_value >= 60;
+
+    if (logical_value == 1) {
+        state->current_speed += 15.0;
+        if (state->current_speed > 100.0) {
+            state->current_speed = 100.0;
+        }
+        state->consecutive_zeros = 0;
+    } else {
+        state->consecutive_zeros++;
+        if (state->consecutive_zeros > 2) {
+            state->current_speed -= 8.0;
+            if (state->current_speed < 0.0) {
+                state->current_speed = 0.0;
+            }
+        }
+    }
+    state->last_pwm = pwm_value;
+}
+
+static void control_step(int32_t reading) {
+    // BUG: the ADC value is used as an index without a bounds check
+    int control_value = control_array[reading];
+    fan_speed(&fan, control_value);
+}
+
+int main(int argc, char** argv) {
+    control_array = (int*)malloc(ARRAY_SIZE * sizeof(int));
+    for (int i = 0; i < 5; i++) {
+        control_array[i] = 10 + (i * 5);
+    }
+    for (int i = 5; i < 10; i++) {
+        control_array[i] = 70 + ((i - 5) * 5);
+    }
+
+    struct cps_benchmark bench = {
+        .name = "adc_fan",
+        .n_samples = 10000,
+        .attack_start = 5000,
+        .attack_end = 10000,
+        .synthesize = synthesize,
+        .step = control_step,
+    };
+    int ret = cps_run(&bench, argc, argv);
+    printf("Final fan speed %.1f%%\n", fan.current_speed);
+
+    free(control_array);
+    return ret;
+}
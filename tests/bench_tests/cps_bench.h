@@ -0,0 +1,230 @@
+// cps_bench.h - fixed-rate control loop harness for the CPS benchmarks
+//
+// Header-only so every benchmark stays a single translation unit for
+// pipeline_unified.sh. A benchmark supplies a control step and a synthetic
+// sensor model; the harness replays a sensor trace from a memory-mapped
+// file at a fixed period and records, per phase (normal / attack):
+//   - response time: release of the cycle to completion of the step
+//   - deadline misses: steps completing after the end of their period
+// and prints p50/p99/p99.9/max plus a log2 latency histogram.
+//
+// Trace file format (little endian):
+//   struct cps_trace_header, then n_samples int32_t sensor readings.
+//   Samples in [attack_start, attack_end) form the attack phase.
+// Without a trace argument the benchmark's synthetic trace is written to a
+// temporary file and replayed from there, so both paths use the mapping.
+//
+// Usage: <benchmark> [trace-file|-] [period-us]
+
+#ifndef CPS_BENCH_H
+#define CPS_BENCH_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cima_variant.h"
+
+#define CPS_TRACE_MAGIC 0x53504343u  // "CCPS"
+#define CPS_HIST_BUCKETS 24          // log2 buckets of microseconds
+
+#ifndef CPS_DEFAULT_PERIOD_US
+#define CPS_DEFAULT_PERIOD_US 200
+#endif
+
+struct cps_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t n_samples;
+    uint64_t attack_start;
+    uint64_t attack_end;
+};
+
+struct cps_benchmark {
+    const char* name;
+    uint64_t n_samples;     // synthetic trace length
+    uint64_t attack_start;  // synthetic attack window
+    uint64_t attack_end;
+    int32_t (*synthesize)(uint64_t cycle, int attack);
+    void (*step)(int32_t reading);
+};
+
+struct cps_phase_stats {
+    const char* name;
+    uint64_t cycles;
+    uint64_t misses;
+    uint64_t* response_ns;
+    uint64_t hist[CPS_HIST_BUCKETS];
+};
+
+static uint64_t cps_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void cps_sleep_until(uint64_t deadline_ns) {
+    struct timespec ts = {(time_t)(deadline_ns / 1000000000ULL), (long)(deadline_ns % 1000000000ULL)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static int cps_write_synthetic(const struct cps_benchmark* bench, char* path, size_t size) {
+    snprintf(path, size, "/tmp/cps_trace_%s_XXXXXX", bench->name);
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+
+    struct cps_trace_header header = {CPS_TRACE_MAGIC, 1, bench->n_samples, bench->attack_start,
+                                      bench->attack_end};
+    FILE* out = fdopen(fd, "wb");
+    if (!out) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    for (uint64_t i = 0; i < bench->n_samples; i++) {
+        int attack = i >= bench->attack_start && i < bench->attack_end;
+        int32_t reading = bench->synthesize(i, attack);
+        fwrite(&reading, sizeof(reading), 1, out);
+    }
+    fclose(out);
+    return 0;
+}
+
+// Map a trace file; returns the header (samples follow it) or NULL
+static const struct cps_trace_header* cps_map_trace(const char* path, size_t* mapped) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct cps_trace_header)) {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    const struct cps_trace_header* header = data;
+    if (header->magic != CPS_TRACE_MAGIC ||
+        sizeof(*header) + header->n_samples * sizeof(int32_t) > (size_t)st.st_size) {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    *mapped = st.st_size;
+    return header;
+}
+
+static int cps_compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double cps_percentile_us(const uint64_t* sorted, uint64_t n, double p) {
+    if (n == 0) return 0.0;
+    uint64_t i = (uint64_t)(p * (n - 1) + 0.5);
+    return sorted[i] / 1e3;
+}
+
+static void cps_record(struct cps_phase_stats* phase, uint64_t response, int missed) {
+    phase->response_ns[phase->cycles++] = response;
+    phase->misses += missed;
+
+    uint64_t us = response / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < CPS_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    phase->hist[bucket]++;
+}
+
+static void cps_report(const char* variant, struct cps_phase_stats* phase) {
+    if (phase->cycles == 0) return;
+    qsort(phase->response_ns, phase->cycles, sizeof(uint64_t), cps_compare_u64);
+    printf("%-8s  %-6s  %7llu  %8.2f  %8.2f  %8.2f  %8.2f  %7llu (%.3f%%)\n", variant, phase->name,
+           (unsigned long long)phase->cycles, cps_percentile_us(phase->response_ns, phase->cycles, 0.5),
+           cps_percentile_us(phase->response_ns, phase->cycles, 0.99),
+           cps_percentile_us(phase->response_ns, phase->cycles, 0.999),
+           phase->response_ns[phase->cycles - 1] / 1e3, (unsigned long long)phase->misses,
+           100.0 * phase->misses / phase->cycles);
+}
+
+static void cps_print_histogram(const char* variant, const struct cps_phase_stats* phase) {
+    if (phase->cycles == 0) return;
+    printf("%s %s response histogram (us):\n", variant, phase->name);
+    for (int b = 0; b < CPS_HIST_BUCKETS; b++) {
+        if (!phase->hist[b]) continue;
+        uint64_t lo = b == 0 ? 0 : 1ULL << (b - 1);
+        uint64_t hi = (1ULL << b) - 1;
+        printf("  [%6llu, %6llu]  %8llu\n", (unsigned long long)lo, (unsigned long long)hi,
+               (unsigned long long)phase->hist[b]);
+    }
+}
+
+static int cps_run(const struct cps_benchmark* bench, int argc, char** argv) {
+    const char* trace_path = argc > 1 && strcmp(argv[1], "-") != 0 ? argv[1] : NULL;
+    uint64_t period_ns = (argc > 2 ? strtoull(argv[2], NULL, 10) : CPS_DEFAULT_PERIOD_US) * 1000ULL;
+    if (period_ns == 0) {
+        fprintf(stderr, "Usage: %s [trace-file|-] [period-us]\n", argv[0]);
+        return 1;
+    }
+
+    char synthetic[64] = "";
+    if (!trace_path) {
+        if (cps_write_synthetic(bench, synthetic, sizeof(synthetic)) != 0) {
+            perror("cps: cannot write synthetic trace");
+            return 1;
+        }
+        trace_path = synthetic;
+    }
+
+    size_t mapped = 0;
+    const struct cps_trace_header* trace = cps_map_trace(trace_path, &mapped);
+    if (synthetic[0]) unlink(synthetic);
+    if (!trace) {
+        fprintf(stderr, "cps: cannot map trace %s\n", trace_path);
+        return 1;
+    }
+    const int32_t* samples = (const int32_t*)(trace + 1);
+
+    const char* variant = CIMA_VARIANT;
+
+    struct cps_phase_stats phases[2] = {{.name = "normal"}, {.name = "attack"}};
+    for (int p = 0; p < 2; p++) {
+        phases[p].response_ns = malloc(trace->n_samples * sizeof(uint64_t));
+    }
+
+    // Fixed-rate schedule: cycle i is released at start + i * period and
+    // must complete by the next release. Overruns are not compensated, so
+    // a late cycle shortens the slack of the ones after it.
+    uint64_t release = cps_now_ns() + period_ns;
+    for (uint64_t i = 0; i < trace->n_samples; i++, release += period_ns) {
+        cps_sleep_until(release);
+        bench->step(samples[i]);
+        uint64_t done = cps_now_ns();
+
+        int attack = i >= trace->attack_start && i < trace->attack_end;
+        cps_record(&phases[attack], done - release, done > release + period_ns);
+    }
+
+    printf("%s: %llu cycles at %llu us period (%s trace)\n", bench->name,
+           (unsigned long long)trace->n_samples, (unsigned long long)(period_ns / 1000),
+           synthetic[0] ? "synthetic" : trace_path);
+    printf("%-8s  %-6s  %7s  %8s  %8s  %8s  %8s  %s\n", "Variant", "Phase", "Cycles", "p50(us)", "p99(us)",
+           "p99.9(us)", "max(us)", "Deadline misses");
+    for (int p = 0; p < 2; p++) cps_report(variant, &phases[p]);
+    for (int p = 0; p < 2; p++) cps_print_histogram(variant, &phases[p]);
+
+    for (int p = 0; p < 2; p++) free(phases[p].response_ns);
+    munmap((void*)trace, mapped);
+    return 0;
+}
+
+#endif  // CPS_BENCH_H
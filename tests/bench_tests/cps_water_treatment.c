@@ -0,0 +1,60 @@
+// CPS benchmark: water-treatment tank level controller
+//
+// The controller from taint_tests/water_treatment_level_*.c run as a
+// fixed-rate loop. Each cycle reads a level sensor (millimetres) from the
+// trace, looks up the fill valve setting for the deficit, and advances the
+// tank model. During the attack phase the sensor reports a drained tank,
+// driving the table index past the end of fill_table.
+
+#include "cps_bench.h"
+
+#define TARGET_LEVEL 5.0
+#define MAX_LEVEL    6.0
+#define DRAIN_RATE   0.1
+#define DT           1.0
+
+double fill_table[6] = {0.0, 0.9, 1.8, 2.7, 3.6, 4.5};
+double level = 0.0;
+double fill = 0.0;
+int above_max_cycles = 0;
+
+// Sensor in millimetres: noise around the true level, or a spoofed
+// reading far below target during the attack
+static int32_t synthesize(uint64_t cycle, int attack) {
+    if (attack) return -8000 - (int32_t)(cycle % 4) * 1000;
+    return 5000 + (int32_t)(cycle * 7919 % 400) - 200;
+}
+
+static void control_step(int32_t reading) {
+    double sensor = TARGET_LEVEL - reading / 1000.0;
+    int idx = (int)sensor;
+    if (idx < 0) {
+        idx = 0;
+    }
+
+    // BUG: no upper bound check, as in the original controller
+    fill = fill_table[idx];
+
+    level -= DRAIN_RATE;
+    level += fill * DT;
+    if (level < 0) {
+        level = 0;
+    }
+    if (level > MAX_LEVEL) {
+        above_max_cycles++;
+    }
+}
+
+int main(int argc, char** argv) {
+    struct cps_benchmark bench = {
+        .name = "water_treatment",
+        .n_samples = 10000,
+        .attack_start = 5000,
+        .attack_end = 10000,
+        .synthesize = synthesize,
+        .step = control_step,
+    };
+    int ret = cps_run(&bench, argc, argv);
+    printf("Final level %.2f, %d cycles above MAX_LEVEL\n", level, above_max_cycles);
+    return ret;
+}
@@ -0,0 +1,332 @@
+// Multi-threaded scaling benchmark
+//
+// Every other benchmark is single-threaded, so it cannot show whether a
+// variant's shadow traffic, runtime calls or recovery path scale across
+// cores. This program runs three phases at 1, 2, 4, ... up to N threads:
+//
+//   stream     STREAM triad over shared heap arrays, split between threads
+//              (fixed total work: memory-bandwidth bound)
+//   pipeline   producer/consumer sensor pipeline: pairs of threads linked by
+//              a lock-free ring, consumers calibrate samples through a
+//              shared lookup table (fixed work per pair)
+//   recover    every thread indexes the same shared heap and global tables
+//              with 1% of the indices past the end, so recoveries happen
+//              concurrently on shared objects (fixed work per thread)
+//
+// Each row reports aggregate and per-thread throughput and the scaling
+// efficiency: per-thread throughput relative to the phase's first row.
+//
+// Build it for each variant and compare:
+//   ./pipeline_unified.sh bench_tests/thread_scaling.c --pass=all
+//
+// The recover phase reads out of bounds on purpose, so it is meaningful
+// for the CIMA variants only (asan stops at the first bad access); select
+// phases to skip it for none and asan.
+//
+// Optional arguments: [max-threads] [phase,...]
+//   e.g. thread_scaling_base_final 8 stream,recover
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cima_variant.h"
+
+#ifndef STREAM_ELEMENTS
+#define STREAM_ELEMENTS (2 * 1024 * 1024)  // per array (16 MiB of doubles)
+#endif
+#define STREAM_REPEATS 5
+
+#define RING_SIZE 1024  // samples per ring, a power of two
+#define PIPELINE_SAMPLES 500000
+#define CHANNELS 16
+
+#define TABLE_SIZE 64
+#define RECOVER_ACCESSES 2000000
+#define RECOVER_RATE 0.01
+#define RECOVER_DISTANCE 8
+
+#define MAX_THREADS 256
+
+// stream: shared arrays
+double* stream_a;
+double* stream_b;
+double* stream_c;
+
+// pipeline: shared read-only calibration table (channel x 16 ranges)
+int32_t calibration[CHANNELS][16];
+
+// recover: shared tables every thread reads past the end of
+int global_table[TABLE_SIZE];
+int* heap_table;
+
+volatile long sink;
+
+typedef struct {
+    uint32_t seq;
+    int16_t channel;
+    int16_t raw;  // 12-bit ADC reading
+} sensor_sample_t;
+
+// Single-producer single-consumer ring
+typedef struct {
+    _Atomic uint32_t head;
+    char pad0[60];
+    _Atomic uint32_t tail;
+    char pad1[60];
+    sensor_sample_t samples[RING_SIZE];
+} ring_t;
+
+typedef struct {
+    int id;
+    int threads;
+    pthread_barrier_t* barrier;
+    ring_t* ring;
+    long* indices;
+    long ops;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    long result;
+} worker_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t lcg(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+}
+
+// STREAM triad on this thread's share of the arrays
+static void* stream_worker(void* arg) {
+    worker_t* w = arg;
+    long chunk = STREAM_ELEMENTS / w->threads;
+    long lo = w->id * chunk;
+    long hi = w->id == w->threads - 1 ? STREAM_ELEMENTS : lo + chunk;
+    double scalar = 3.0;
+
+    pthread_barrier_wait(w->barrier);
+    w->start_ns = now_ns();
+    for (int r = 0; r < STREAM_REPEATS; r++) {
+        for (long i = lo; i < hi; i++) {
+            stream_a[i] = stream_b[i] + scalar * stream_c[i];
+        }
+    }
+    w->end_ns = now_ns();
+    w->ops = (hi - lo) * STREAM_REPEATS;
+    return NULL;
+}
+
+static void* producer_worker(void* arg) {
+    worker_t* w = arg;
+    ring_t* ring = w->ring;
+    uint32_t state = 0x5E45u + w->id;
+
+    pthread_barrier_wait(w->barrier);
+    w->start_ns = now_ns();
+    for (uint32_t seq = 0; seq < PIPELINE_SAMPLES; seq++) {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == RING_SIZE) {
+            sched_yield();
+        }
+        uint32_t r = lcg(&state);
+        sensor_sample_t* s = &ring->samples[head & (RING_SIZE - 1)];
+        s->seq = seq;
+        s->channel = (int16_t)(r >> 28);
+        s->raw = (int16_t)((r >> 8) & 0xFFF);
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    }
+    w->end_ns = now_ns();
+    w->ops = PIPELINE_SAMPLES;
+    return NULL;
+}
+
+// Calibrate every sample and keep a moving average per channel; count
+// readings above the alarm threshold
+static void* consumer_worker(void* arg) {
+    worker_t* w = arg;
+    ring_t* ring = w->ring;
+    int32_t average[CHANNELS] = {0};
+    long alarms = 0;
+
+    pthread_barrier_wait(w->barrier);
+    w->start_ns = now_ns();
+    for (uint32_t n = 0; n < PIPELINE_SAMPLES; n++) {
+        uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+            sched_yield();
+        }
+        sensor_sample_t s = ring->samples[tail & (RING_SIZE - 1)];
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+        int32_t value = s.raw * calibration[s.channel][s.raw >> 8] >> 4;
+        average[s.channel] += (value - average[s.channel]) >> 3;
+        alarms += average[s.channel] > 3000;
+    }
+    w->end_ns = now_ns();
+    w->ops = PIPELINE_SAMPLES;
+    w->result = alarms;
+    return NULL;
+}
+
+// Shared-table lookups with a share of out-of-bounds indices
+static void* recover_worker(void* arg) {
+    worker_t* w = arg;
+    long sum = 0;
+
+    pthread_barrier_wait(w->barrier);
+    w->start_ns = now_ns();
+    for (long i = 0; i < RECOVER_ACCESSES; i++) {
+        long idx = w->indices[i];
+        sum += heap_table[idx] + global_table[idx];
+    }
+    w->end_ns = now_ns();
+    w->ops = RECOVER_ACCESSES;
+    w->result = sum;
+    return NULL;
+}
+
+static long* make_indices(int id) {
+    long* idx = malloc(RECOVER_ACCESSES * sizeof(long));
+    uint32_t state = 0x9E37u + id;
+    uint32_t threshold = (uint32_t)(RECOVER_RATE * 4294967295.0);
+    for (long i = 0; i < RECOVER_ACCESSES; i++) {
+        uint32_t r = lcg(&state);
+        idx[i] = r < threshold ? TABLE_SIZE + RECOVER_DISTANCE : r % TABLE_SIZE;
+    }
+    return idx;
+}
+
+// Run one phase with the given number of threads; returns aggregate
+// operations per second over the span from the first start to the last end
+static double run_phase(const char* phase, int threads) {
+    pthread_t tid[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    ring_t* rings = NULL;
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, threads);
+
+    int is_pipeline = strcmp(phase, "pipeline") == 0;
+    if (is_pipeline) {
+        rings = aligned_alloc(64, (threads / 2) * sizeof(ring_t));
+        memset(rings, 0, (threads / 2) * sizeof(ring_t));
+    }
+
+    for (int t = 0; t < threads; t++) {
+        worker_t* w = &workers[t];
+        memset(w, 0, sizeof(*w));
+        w->id = t;
+        w->threads = threads;
+        w->barrier = &barrier;
+        void* (*fn)(void*) = stream_worker;
+        if (is_pipeline) {
+            w->ring = &rings[t / 2];
+            fn = t % 2 == 0 ? producer_worker : consumer_worker;
+        } else if (strcmp(phase, "recover") == 0) {
+            w->indices = make_indices(t);
+            fn = recover_worker;
+        }
+        int err = pthread_create(&tid[t], NULL, fn, w);
+        if (err != 0) {
+            // The threads already started would wait at the barrier forever
+            fprintf(stderr, "thread_scaling: cannot start thread %d of %d: %s\n", t + 1, threads,
+                    strerror(err));
+            exit(1);
+        }
+    }
+
+    uint64_t start = UINT64_MAX, end = 0;
+    long ops = 0, result = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tid[t], NULL);
+        if (workers[t].start_ns < start) start = workers[t].start_ns;
+        if (workers[t].end_ns > end) end = workers[t].end_ns;
+        // A pipeline sample is one operation, not one per stage
+        if (!is_pipeline || t % 2 == 1) ops += workers[t].ops;
+        result += workers[t].result;
+        free(workers[t].indices);
+    }
+    sink = result;
+
+    free(rings);
+    pthread_barrier_destroy(&barrier);
+    return ops / ((end - start) / 1e9);
+}
+
+// 1, 2, 4, ... and finally max_threads itself; with pairs, whole pairs
+// only. Returns 0 after the last count.
+static int next_thread_count(int threads, int max_threads, int pairs) {
+    int next = threads * 2 <= max_threads ? threads * 2 : max_threads;
+    if (pairs) next &= ~1;
+    return next > threads ? next : 0;
+}
+
+int main(int argc, char** argv) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)(online > 0 ? online : 1);
+    const char* phases = argc > 2 ? argv[2] : "stream,pipeline,recover";
+    if (max_threads <= 0 || max_threads > MAX_THREADS) {
+        fprintf(stderr, "Usage: %s [max-threads (1-%d)] [stream,pipeline,recover]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    const char* variant = CIMA_VARIANT;
+
+    stream_a = malloc(STREAM_ELEMENTS * sizeof(double));
+    stream_b = malloc(STREAM_ELEMENTS * sizeof(double));
+    stream_c = malloc(STREAM_ELEMENTS * sizeof(double));
+    for (long i = 0; i < STREAM_ELEMENTS; i++) {
+        stream_a[i] = 1.0;
+        stream_b[i] = 2.0;
+        stream_c[i] = 0.0;
+    }
+    for (int c = 0; c < CHANNELS; c++) {
+        for (int r = 0; r < 16; r++) {
+            calibration[c][r] = 14 + (c * 3 + r) % 5;
+        }
+    }
+    heap_table = malloc(TABLE_SIZE * sizeof(int));
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        heap_table[i] = i;
+        global_table[i] = i;
+    }
+
+    printf("Thread scaling: up to %d threads (%ld online)\n", max_threads, online);
+    printf("%-8s  %-8s  %7s  %12s  %12s  %10s\n", "Variant", "Phase", "Threads", "Mops/s", "Mops/s/thr",
+           "Efficiency");
+
+    char list[256];
+    snprintf(list, sizeof(list), "%s", phases);
+    for (char* phase = strtok(list, ","); phase; phase = strtok(NULL, ",")) {
+        if (strcmp(phase, "stream") != 0 && strcmp(phase, "pipeline") != 0 && strcmp(phase, "recover") != 0) {
+            fprintf(stderr, "Unknown phase: %s\n", phase);
+            return 1;
+        }
+        // The pipeline needs a producer and a consumer per pair
+        int pairs = strcmp(phase, "pipeline") == 0;
+        if (pairs && max_threads < 2) continue;
+        double base_per_thread = 0.0;
+        for (int threads = pairs ? 2 : 1; threads; threads = next_thread_count(threads, max_threads, pairs)) {
+            double per_thread = run_phase(phase, threads) / threads;
+            if (base_per_thread == 0.0) base_per_thread = per_thread;
+            printf("%-8s  %-8s  %7d  %12.2f  %12.2f  %9.1f%%\n", variant, phase, threads, per_thread * threads / 1e6,
+                   per_thread / 1e6, 100.0 * per_thread / base_per_thread);
+            fflush(stdout);
+        }
+    }
+
+    free(heap_table);
+    free(stream_a);
+    free(stream_b);
+    free(stream_c);
+    return 0;
+}
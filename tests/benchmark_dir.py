@@ -7,6 +7,9 @@ import statistics
 import re
 import shlex
 
+# Native hardware-counter runner (bench/cima_bench.cpp), built by build.sh
+CIMA_BENCH = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'build', 'bench', 'cima_bench')
+
 def is_executable(filepath):
     """Checks if a file exists, is a file (not dir), and is executable."""
     return (os.path.isfile(filepath) and 
@@ -88,7 +91,20 @@ if __name__ == "__main__":
     parser = argparse.ArgumentParser(description="Benchmark executables in a directory using bash time builtin.")
     parser.add_argument("directory", help="Directory containing executables")
     parser.add_argument("runs", nargs="?", type=int, default=100, help="Number of runs per executable (default: 100)")
+    parser.add_argument("--bash-time", action="store_true",
+                        help="Use the legacy bash 'time' sampling instead of cima_bench")
+    parser.add_argument("--json", help="Write cima_bench results as JSON to this file")
     
     args = parser.parse_args()
     
+    # bash 'time' only resolves milliseconds, below the runtime of most
+    # tests; prefer the perf_event_open based runner when it is built
+    if not args.bash_time and os.access(CIMA_BENCH, os.X_OK):
+        cmd = [CIMA_BENCH, args.directory, f"--runs={args.runs}"]
+        if args.json:
+            cmd.append(f"--json={args.json}")
+        sys.exit(subprocess.run(cmd).returncode)
+
+    if not args.bash_time:
+        print(f"Note: {CIMA_BENCH} not built; falling back to bash 'time'")
     run_benchmark(args.directory, args.runs)
\ No newline at end of file
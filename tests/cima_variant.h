@@ -0,0 +1,15 @@
+// cima_variant.h - the variant label benchmarks print with their results
+//
+// pipeline_unified.sh compiles every test with -DCIMA_VARIANT="<variant>",
+// the --pass it is building, whatever the binary ends up being named.
+// A test compiled by hand reports "default", as cima_bench does for
+// binaries it cannot attribute to a variant.
+
+#ifndef CIMA_VARIANT_H
+#define CIMA_VARIANT_H
+
+#ifndef CIMA_VARIANT
+#define CIMA_VARIANT "default"
+#endif
+
+#endif  // CIMA_VARIANT_H
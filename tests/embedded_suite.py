@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Build and compare the embedded kernel suite across pass variants.
+
+Builds every kernel in tests/embedded_tests/ with pipeline_unified.sh for
+each requested variant, runs every binary several times and prints, per
+kernel, the best ns/iteration of each variant and its throughput overhead
+relative to the none variant. Kernels print a checksum of their output;
+a variant whose checksum differs from none changed in-bounds results and
+is flagged.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+KERNEL_DIR = os.path.join(SCRIPT_DIR, "embedded_tests")
+OUTPUT_DIR = os.path.join(SCRIPT_DIR, "build_tests")
+VARIANTS = ["none", "asan", "base", "nearest", "tainted", "native", "bounds"]
+
+
+def kernels():
+    return sorted(f[:-2] for f in os.listdir(KERNEL_DIR) if f.endswith(".c"))
+
+
+def build(kernel, variant, pipeline_args):
+    """Build one kernel for one variant; returns the binary path or None."""
+    output = f"{kernel}_{variant}_final"
+    cmd = [os.path.join(SCRIPT_DIR, "pipeline_unified.sh"), os.path.join(KERNEL_DIR, f"{kernel}.c"),
+           f"--pass={variant}", f"--output={output}", "--run-args=1"] + pipeline_args
+    # The pipeline locates plugins and writes build_tests/ relative to tests/
+    result = subprocess.run(cmd, cwd=SCRIPT_DIR, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    binary = os.path.join(OUTPUT_DIR, output)
+    if result.returncode != 0 or not os.access(binary, os.X_OK):
+        print(f"Build failed: {kernel} ({variant})\n{result.stdout}", file=sys.stderr)
+        return None
+    return binary
+
+
+def run(binary, iterations):
+    """One run; returns (ns_per_iter, checksum) from the kernel line, or None."""
+    cmd = [binary] + ([str(iterations)] if iterations else [])
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True,
+                            env=dict(os.environ, ASAN_OPTIONS="detect_leaks=0:detect_stack_use_after_return=0"))
+    for line in result.stdout.splitlines():
+        if line.startswith("kernel,"):
+            fields = line.split(",")
+            return float(fields[4]), fields[5]
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build and compare the embedded kernel suite across variants.")
+    parser.add_argument("--variants", default=",".join(VARIANTS),
+                        help="Comma-separated variants to build and run (default: %(default)s)")
+    parser.add_argument("--kernels", help="Comma-separated subset of kernels (default: all)")
+    parser.add_argument("--runs", type=int, default=5, help="Runs per binary; the best is kept (default: 5)")
+    parser.add_argument("--iterations", type=int, help="Iterations per run (default: each kernel's own)")
+    parser.add_argument("--no-build", action="store_true", help="Use binaries already in build_tests/")
+    parser.add_argument("--pipeline-args", default="",
+                        help="Extra pipeline_unified.sh options, e.g. \"--opt=2 --coalesce\"")
+    parser.add_argument("--json", help="Write the results to this file")
+    args = parser.parse_args()
+
+    variants = args.variants.split(",")
+    selected = args.kernels.split(",") if args.kernels else kernels()
+
+    results = {}
+    for kernel in selected:
+        for variant in variants:
+            binary = os.path.join(OUTPUT_DIR, f"{kernel}_{variant}_final")
+            if not args.no_build:
+                print(f"Building {kernel} ({variant}) ...", file=sys.stderr)
+                binary = build(kernel, variant, args.pipeline_args.split())
+            if not binary or not os.access(binary, os.X_OK):
+                continue
+            samples = [s for s in (run(binary, args.iterations) for _ in range(args.runs)) if s]
+            if samples:
+                results.setdefault(kernel, {})[variant] = {
+                    "ns_per_iter": min(s[0] for s in samples),
+                    "checksum": samples[0][1],
+                }
+
+    if not results:
+        print("No kernel results")
+        sys.exit(1)
+
+    header = f"{'Kernel':<10}"
+    for v in variants:
+        header += f" | {v + ' ns/it':>14} {'ovh %':>7}"
+    print(header)
+    print("-" * len(header))
+
+    mismatches = []
+    for kernel in selected:
+        per_variant = results.get(kernel, {})
+        baseline = per_variant.get("none")
+        line = f"{kernel:<10}"
+        for v in variants:
+            r = per_variant.get(v)
+            if not r:
+                line += f" | {'-':>14} {'-':>7}"
+                continue
+            r["overhead_pct"] = None
+            if baseline and baseline["ns_per_iter"] > 0:
+                r["overhead_pct"] = (r["ns_per_iter"] / baseline["ns_per_iter"] - 1) * 100
+                if r["checksum"] != baseline["checksum"]:
+                    mismatches.append(f"{kernel} ({v}): checksum {r['checksum']}, none {baseline['checksum']}")
+            line += f" | {r['ns_per_iter']:>14.1f} "
+            line += f"{r['overhead_pct']:>7.1f}" if r["overhead_pct"] is not None else f"{'-':>7}"
+        print(line)
+
+    for m in mismatches:
+        print(f"Checksum mismatch: {m}")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"kernels": results}, f, indent=2)
+        print(f"JSON written to {args.json}")
+
+    sys.exit(1 if mismatches else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+// embedded_bench.h - throughput harness for the embedded kernel suite
+//
+// Header-only so every kernel stays a single translation unit for
+// pipeline_unified.sh. A kernel supplies one deterministic iteration that
+// returns a 32-bit digest of its output; the harness runs a warmup, times
+// the requested number of iterations and prints
+//
+//   kernel,<name>,<variant>,<iterations>,<ns_per_iter>,<checksum>
+//
+// where <variant> is the CIMA_VARIANT the pipeline compiled the kernel with.
+// The checksum folds every iteration's digest, so it must be identical for
+// all variants: instrumentation that changes an in-bounds result is a bug,
+// not a slowdown. tests/embedded_suite.py builds and compares the suite.
+// Kernels that export cima_bench_entry through emb_entry() can also be timed
+// in-process with cima_bench --entry.
+//
+// Usage: <kernel> [iterations]
+
+#ifndef EMBEDDED_BENCH_H
+#define EMBEDDED_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cima_variant.h"
+
+#define EMB_WARMUP_DIVISOR 10  // warmup runs iterations / 10
+
+struct emb_kernel {
+    const char* name;
+    long default_iterations;
+    void (*setup)(void);
+    uint32_t (*iterate)(long i);
+};
+
+// Deterministic input data: the same LCG everywhere so runs never depend
+// on libc's rand()
+static uint32_t emb_rng_state = 0x2545F491u;
+
+static inline void emb_seed(uint32_t seed) { emb_rng_state = seed; }
+
+static inline uint32_t emb_rand(void) {
+    emb_rng_state = emb_rng_state * 1664525u + 1013904223u;
+    return emb_rng_state;
+}
+
+static inline uint32_t emb_mix(uint32_t hash, uint32_t value) {
+    hash ^= value;
+    hash *= 0x01000193u;  // FNV-1a prime
+    return hash;
+}
+
+static uint64_t emb_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int emb_run(const struct emb_kernel* kernel, int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : kernel->default_iterations;
+    if (iterations <= 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    // Warmup on its own input so the timed run starts from the same state
+    kernel->setup();
+    volatile uint32_t discard = 0;
+    for (long i = 0; i < iterations / EMB_WARMUP_DIVISOR; i++) {
+        discard ^= kernel->iterate(i);
+    }
+
+    kernel->setup();
+    uint32_t checksum = 0x811C9DC5u;  // FNV-1a offset basis
+    uint64_t start = emb_now_ns();
+    for (long i = 0; i < iterations; i++) {
+        checksum = emb_mix(checksum, kernel->iterate(i));
+    }
+    uint64_t elapsed = emb_now_ns() - start;
+
+    printf("kernel,%s,%s,%ld,%.2f,0x%08x\n", kernel->name, CIMA_VARIANT, iterations,
+           (double)elapsed / iterations, checksum);
+    return 0;
+}
+
+// One call of cima_bench --entry: the default number of iterations on fresh
+// input, timed by the fork server instead of printed. A kernel exports it as
+// int cima_bench_entry(void) { return emb_entry(&kernel); }
+static inline int emb_entry(const struct emb_kernel* kernel) {
+    kernel->setup();
+    volatile uint32_t checksum = 0x811C9DC5u;
+    for (long i = 0; i < kernel->default_iterations; i++) {
+        checksum = emb_mix(checksum, kernel->iterate(i));
+    }
+    return 0;
+}
+
+#endif  // EMBEDDED_BENCH_H
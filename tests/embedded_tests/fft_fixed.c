@@ -0,0 +1,102 @@
+// Embedded kernel: 256-point radix-2 fixed-point FFT (Q15)
+//
+// Vibration and power-quality monitoring on RTUs without an FPU. One
+// iteration transforms a block of samples in place: a bit-reversal
+// permutation, then log2(N) butterfly stages with per-stage scaling and
+// twiddle factors from a Q15 table.
+
+#include "embedded_bench.h"
+
+#define FFT_LOG2 8
+#define FFT_SIZE (1 << FFT_LOG2)
+
+int16_t twiddle_cos[FFT_SIZE / 2];
+int16_t twiddle_sin[FFT_SIZE / 2];
+int16_t input[FFT_SIZE];
+int16_t re[FFT_SIZE];
+int16_t im[FFT_SIZE];
+
+// Twiddles by rotating a unit vector, which keeps the benchmark free of
+// libm; the step's sine and cosine come from their Taylor series
+static void setup(void) {
+    double theta = 2.0 * 3.14159265358979323846 / FFT_SIZE;
+    double step_cos = 1.0 - theta * theta / 2 + theta * theta * theta * theta / 24;
+    double step_sin = theta - theta * theta * theta / 6 + theta * theta * theta * theta * theta / 120;
+    double c = 1.0, s = 0.0;
+    for (int k = 0; k < FFT_SIZE / 2; k++) {
+        twiddle_cos[k] = (int16_t)(c * 32767.0);
+        twiddle_sin[k] = (int16_t)(s * 32767.0);
+        double next_c = c * step_cos - s * step_sin;
+        s = s * step_cos + c * step_sin;
+        c = next_c;
+    }
+
+    // Two tones plus noise
+    emb_seed(0xFF7u);
+    for (int n = 0; n < FFT_SIZE; n++) {
+        int noise = (int)(emb_rand() >> 22) - 512;
+        input[n] = (int16_t)(twiddle_sin[(n * 5) % (FFT_SIZE / 2)] / 4 +
+                             twiddle_cos[(n * 17) % (FFT_SIZE / 2)] / 8 + noise);
+    }
+}
+
+static int bit_reverse(int x) {
+    int r = 0;
+    for (int b = 0; b < FFT_LOG2; b++) {
+        r = (r << 1) | (x & 1);
+        x >>= 1;
+    }
+    return r;
+}
+
+static void fft(void) {
+    for (int i = 0; i < FFT_SIZE; i++) {
+        int j = bit_reverse(i);
+        if (j > i) {
+            int16_t t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (int size = 2; size <= FFT_SIZE; size <<= 1) {
+        int half = size / 2;
+        int step = FFT_SIZE / size;
+        for (int start = 0; start < FFT_SIZE; start += size) {
+            for (int k = 0; k < half; k++) {
+                int32_t wr = twiddle_cos[k * step];
+                int32_t wi = -twiddle_sin[k * step];
+                int a = start + k, b = a + half;
+                int32_t tr = (wr * re[b] - wi * im[b]) >> 15;
+                int32_t ti = (wr * im[b] + wi * re[b]) >> 15;
+                // Halve every stage so the output stays in Q15
+                re[b] = (int16_t)((re[a] - tr) >> 1);
+                im[b] = (int16_t)((im[a] - ti) >> 1);
+                re[a] = (int16_t)((re[a] + tr) >> 1);
+                im[a] = (int16_t)((im[a] + ti) >> 1);
+            }
+        }
+    }
+}
+
+static uint32_t iterate(long i) {
+    for (int n = 0; n < FFT_SIZE; n++) {
+        re[n] = input[(n + i) % FFT_SIZE];
+        im[n] = 0;
+    }
+    fft();
+
+    uint32_t digest = 0;
+    for (int n = 0; n < FFT_SIZE; n++) {
+        digest = emb_mix(digest, (uint16_t)re[n] | (uint32_t)(uint16_t)im[n] << 16);
+    }
+    return digest;
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"fft_fixed", 20000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
@@ -0,0 +1,82 @@
+// Embedded kernel: constant-velocity Kalman filter
+//
+// Sensor fusion for position and flow estimates. One iteration filters 128
+// noisy position measurements with a 2-state (position, velocity) filter:
+// predict with the transition matrix, then update with the scalar
+// measurement. Matrices are stored as arrays and indexed as such, the way
+// generated controller code does it.
+
+#include "embedded_bench.h"
+
+#define MEASUREMENTS 128
+#define DT 0.01f
+
+typedef struct {
+    float x[2];     // state estimate
+    float P[2][2];  // estimate covariance
+} kalman_t;
+
+static const float F[2][2] = {{1.0f, DT}, {0.0f, 1.0f}};
+static const float Qn[2][2] = {{1e-5f, 0.0f}, {0.0f, 1e-3f}};
+static const float R = 0.04f;
+
+float measurements[MEASUREMENTS * 4];
+kalman_t filter;
+
+static void setup(void) {
+    emb_seed(0x4A1Au);
+    float position = 0.0f, velocity = 1.5f;
+    for (int k = 0; k < MEASUREMENTS * 4; k++) {
+        position += velocity * DT;
+        if (k % 97 == 0) velocity = -velocity;
+        // Sum of uniforms: roughly Gaussian noise with sigma 0.2
+        float noise = 0.0f;
+        for (int u = 0; u < 4; u++) {
+            noise += (float)(emb_rand() >> 8) / 16777216.0f - 0.5f;
+        }
+        measurements[k] = position + noise * 0.35f;
+    }
+    memset(&filter, 0, sizeof(filter));
+    filter.P[0][0] = filter.P[1][1] = 1.0f;
+}
+
+static void kalman_step(kalman_t* k, float z) {
+    // Predict: x = F x, P = F P F^T + Q
+    float x[2], FP[2][2], P[2][2];
+    for (int r = 0; r < 2; r++) {
+        x[r] = F[r][0] * k->x[0] + F[r][1] * k->x[1];
+        for (int c = 0; c < 2; c++) {
+            FP[r][c] = F[r][0] * k->P[0][c] + F[r][1] * k->P[1][c];
+        }
+    }
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            P[r][c] = FP[r][0] * F[c][0] + FP[r][1] * F[c][1] + Qn[r][c];
+        }
+    }
+
+    // Update with H = [1 0]
+    float S = P[0][0] + R;
+    float K[2] = {P[0][0] / S, P[1][0] / S};
+    float y = z - x[0];
+    for (int r = 0; r < 2; r++) {
+        k->x[r] = x[r] + K[r] * y;
+        for (int c = 0; c < 2; c++) {
+            k->P[r][c] = P[r][c] - K[r] * P[0][c];
+        }
+    }
+}
+
+static uint32_t iterate(long i) {
+    const float* z = &measurements[(i % 4) * MEASUREMENTS];
+    for (int m = 0; m < MEASUREMENTS; m++) {
+        kalman_step(&filter, z[m]);
+    }
+    // Quantize so the digest is stable against last-bit differences
+    return emb_mix((uint32_t)(int32_t)(filter.x[0] * 65536.0f), (uint32_t)(int32_t)(filter.x[1] * 65536.0f));
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"kalman", 20000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
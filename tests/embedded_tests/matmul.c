@@ -0,0 +1,59 @@
+// Embedded kernel: small fixed-point matrix multiply (Q16, 12x12)
+//
+// State-space controllers and coordinate transforms multiply small dense
+// matrices every cycle. One iteration computes C = A * B with 64-bit
+// accumulation and feeds the result back into B, so the work cannot be
+// hoisted out of the loop.
+
+#include "embedded_bench.h"
+
+#define N 12
+#define Q 16
+
+int32_t A[N][N];
+int32_t B[N][N];
+int32_t C[N][N];
+
+static void setup(void) {
+    emb_seed(0x3A7u);
+    for (int r = 0; r < N; r++) {
+        for (int c = 0; c < N; c++) {
+            // Entries in [-0.125, 0.125) keep repeated products bounded
+            A[r][c] = (int32_t)(emb_rand() >> 16) - 32768;
+            A[r][c] /= 4;
+            B[r][c] = r == c ? 1 << Q : 0;
+        }
+    }
+}
+
+static void multiply(void) {
+    for (int r = 0; r < N; r++) {
+        for (int c = 0; c < N; c++) {
+            int64_t acc = 0;
+            for (int k = 0; k < N; k++) {
+                acc += (int64_t)A[r][k] * B[k][c];
+            }
+            C[r][c] = (int32_t)(acc >> Q);
+        }
+    }
+}
+
+static uint32_t iterate(long i) {
+    multiply();
+
+    uint32_t digest = 0;
+    for (int r = 0; r < N; r++) {
+        for (int c = 0; c < N; c++) {
+            digest = emb_mix(digest, (uint32_t)C[r][c]);
+            // Next input: the product plus identity, so it neither vanishes
+            // nor grows without bound
+            B[r][c] = C[r][c] + (r == c ? 1 << Q : 0) + (int32_t)(i & 0xF);
+        }
+    }
+    return digest;
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"matmul", 50000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
@@ -0,0 +1,205 @@
+// Embedded kernel: Modbus RTU frame parser
+//
+// The request handler of a Modbus slave. One iteration parses a batch of
+// pre-built RTU frames (read holding registers, write single register,
+// write multiple registers, plus corrupted and out-of-range requests):
+// check the slave address and CRC-16, decode the PDU, validate the
+// register range and apply it to the register map, building a response.
+
+#include "embedded_bench.h"
+
+#define SLAVE_ADDRESS 17
+#define NUM_REGISTERS 128
+#define NUM_FRAMES 64
+#define MAX_FRAME 64
+
+#define FC_READ_HOLDING 0x03
+#define FC_WRITE_SINGLE 0x06
+#define FC_WRITE_MULTIPLE 0x10
+
+#define EX_ILLEGAL_FUNCTION 0x01
+#define EX_ILLEGAL_ADDRESS 0x02
+#define EX_ILLEGAL_VALUE 0x03
+
+typedef struct {
+    uint8_t data[MAX_FRAME];
+    int length;
+} frame_t;
+
+uint16_t registers[NUM_REGISTERS];
+frame_t requests[NUM_FRAMES];
+frame_t response;
+
+static uint16_t crc16(const uint8_t* data, int len) {
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static void append_crc(frame_t* f) {
+    uint16_t crc = crc16(f->data, f->length);
+    f->data[f->length++] = crc & 0xFF;
+    f->data[f->length++] = crc >> 8;
+}
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static uint16_t get16(const uint8_t* p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static void build_request(frame_t* f, int kind) {
+    uint16_t address = (uint16_t)(emb_rand() >> 25);  // 0..127
+    uint16_t count = (uint16_t)(1 + (emb_rand() >> 28));  // 1..16
+    if (address + count > NUM_REGISTERS) count = NUM_REGISTERS - address;
+
+    f->data[0] = SLAVE_ADDRESS;
+    switch (kind) {
+        case 0:
+        case 1:
+            f->data[1] = FC_READ_HOLDING;
+            put16(&f->data[2], address);
+            put16(&f->data[4], count);
+            f->length = 6;
+            break;
+        case 2:
+            f->data[1] = FC_WRITE_SINGLE;
+            put16(&f->data[2], address);
+            put16(&f->data[4], (uint16_t)emb_rand());
+            f->length = 6;
+            break;
+        case 3:
+            f->data[1] = FC_WRITE_MULTIPLE;
+            put16(&f->data[2], address);
+            put16(&f->data[4], count);
+            f->data[6] = (uint8_t)(count * 2);
+            for (int r = 0; r < count; r++) {
+                put16(&f->data[7 + 2 * r], (uint16_t)emb_rand());
+            }
+            f->length = 7 + 2 * count;
+            break;
+        case 4:
+            // Register range past the end of the map: exception response
+            f->data[1] = FC_READ_HOLDING;
+            put16(&f->data[2], NUM_REGISTERS - 2);
+            put16(&f->data[4], 8);
+            f->length = 6;
+            break;
+        default:
+            // Unsupported function code
+            f->data[1] = 0x2B;
+            f->length = 2;
+            break;
+    }
+    append_crc(f);
+    // Every 13th frame is corrupted on the wire and must be dropped
+    if (emb_rand() % 13 == 0) f->data[2] ^= 0x40;
+}
+
+static void setup(void) {
+    emb_seed(0x0DB5u);
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        registers[r] = (uint16_t)(r * 7);
+    }
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        build_request(&requests[f], (int)(emb_rand() % 6));
+    }
+}
+
+static void exception(uint8_t function, uint8_t code) {
+    response.data[0] = SLAVE_ADDRESS;
+    response.data[1] = function | 0x80;
+    response.data[2] = code;
+    response.length = 3;
+}
+
+// Returns 0 if the frame is dropped (wrong slave or bad CRC), 1 otherwise
+static int handle_frame(const frame_t* f) {
+    if (f->length < 4 || f->data[0] != SLAVE_ADDRESS) return 0;
+    uint16_t crc = (uint16_t)(f->data[f->length - 2] | f->data[f->length - 1] << 8);
+    if (crc16(f->data, f->length - 2) != crc) return 0;
+
+    const uint8_t* pdu = &f->data[1];
+    int pdu_length = f->length - 3;
+    uint8_t function = pdu[0];
+    response.data[0] = SLAVE_ADDRESS;
+    response.data[1] = function;
+
+    switch (function) {
+        case FC_READ_HOLDING: {
+            if (pdu_length != 5) {
+                exception(function, EX_ILLEGAL_VALUE);
+                break;
+            }
+            uint16_t address = get16(&pdu[1]), count = get16(&pdu[3]);
+            if (count == 0 || count > 125) {
+                exception(function, EX_ILLEGAL_VALUE);
+                break;
+            }
+            if (address + count > NUM_REGISTERS) {
+                exception(function, EX_ILLEGAL_ADDRESS);
+                break;
+            }
+            response.data[2] = (uint8_t)(count * 2);
+            for (int r = 0; r < count; r++) {
+                put16(&response.data[3 + 2 * r], registers[address + r]);
+            }
+            response.length = 3 + 2 * count;
+            break;
+        }
+        case FC_WRITE_SINGLE: {
+            uint16_t address = get16(&pdu[1]);
+            if (address >= NUM_REGISTERS) {
+                exception(function, EX_ILLEGAL_ADDRESS);
+                break;
+            }
+            registers[address] = get16(&pdu[3]);
+            memcpy(&response.data[2], &pdu[1], 4);
+            response.length = 6;
+            break;
+        }
+        case FC_WRITE_MULTIPLE: {
+            uint16_t address = get16(&pdu[1]), count = get16(&pdu[3]);
+            if (count == 0 || pdu[5] != count * 2 || pdu_length != 6 + count * 2) {
+                exception(function, EX_ILLEGAL_VALUE);
+                break;
+            }
+            if (address + count > NUM_REGISTERS) {
+                exception(function, EX_ILLEGAL_ADDRESS);
+                break;
+            }
+            for (int r = 0; r < count; r++) {
+                registers[address + r] = get16(&pdu[6 + 2 * r]);
+            }
+            memcpy(&response.data[2], &pdu[1], 4);
+            response.length = 6;
+            break;
+        }
+        default:
+            exception(function, EX_ILLEGAL_FUNCTION);
+            break;
+    }
+    append_crc(&response);
+    return 1;
+}
+
+static uint32_t iterate(long i) {
+    uint32_t digest = 0;
+    for (int f = 0; f < NUM_FRAMES; f++) {
+        if (handle_frame(&requests[(f + i) % NUM_FRAMES])) {
+            digest = emb_mix(digest, get16(&response.data[response.length - 2]));
+        }
+    }
+    return digest;
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"modbus", 5000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
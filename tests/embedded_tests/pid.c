@@ -0,0 +1,77 @@
+// Embedded kernel: fixed-point PID loop with a simulated plant
+//
+// The inner loop of most PLC programs. One iteration runs 256 control
+// steps of a Q12 PID controller (derivative on measurement, clamped
+// integrator, saturated output) against a first-order plant with transport
+// delay, following a setpoint schedule from a lookup table.
+
+#include "embedded_bench.h"
+
+#define STEPS 256
+#define Q 12
+#define DELAY 8  // plant transport delay in steps
+#define OUT_MAX (100 << Q)
+#define OUT_MIN 0
+
+typedef struct {
+    int32_t kp, ki, kd;
+    int32_t integral;
+    int32_t last_measurement;
+} pid_ctrl_t;
+
+typedef struct {
+    int32_t value;
+    int32_t pending[DELAY];
+    int head;
+} plant_t;
+
+int32_t setpoints[16];
+pid_ctrl_t pid;
+plant_t plant;
+
+static void setup(void) {
+    for (int k = 0; k < 16; k++) {
+        setpoints[k] = ((20 + (k * 37) % 60) << Q);
+    }
+    memset(&pid, 0, sizeof(pid));
+    pid.kp = (int32_t)(0.8 * (1 << Q));
+    pid.ki = (int32_t)(0.05 * (1 << Q));
+    pid.kd = (int32_t)(0.3 * (1 << Q));
+    memset(&plant, 0, sizeof(plant));
+}
+
+static int32_t clamp(int32_t v, int32_t lo, int32_t hi) { return v < lo ? lo : v > hi ? hi : v; }
+
+static int32_t pid_step(pid_ctrl_t* c, int32_t setpoint, int32_t measurement) {
+    int32_t error = setpoint - measurement;
+    c->integral = clamp(c->integral + (int32_t)(((int64_t)c->ki * error) >> Q), OUT_MIN, OUT_MAX);
+    int32_t derivative = (int32_t)(((int64_t)c->kd * (measurement - c->last_measurement)) >> Q);
+    c->last_measurement = measurement;
+    int32_t out = (int32_t)(((int64_t)c->kp * error) >> Q) + c->integral - derivative;
+    return clamp(out, OUT_MIN, OUT_MAX);
+}
+
+// First-order lag: value += (input - value) / 8, with the input delayed
+static int32_t plant_step(plant_t* p, int32_t input) {
+    int32_t delayed = p->pending[p->head];
+    p->pending[p->head] = input;
+    p->head = (p->head + 1) % DELAY;
+    p->value += (delayed - p->value) >> 3;
+    return p->value;
+}
+
+static uint32_t iterate(long i) {
+    uint32_t digest = 0;
+    for (int s = 0; s < STEPS; s++) {
+        int32_t setpoint = setpoints[((i * STEPS + s) >> 9) & 15];
+        int32_t out = pid_step(&pid, setpoint, plant.value);
+        int32_t measurement = plant_step(&plant, out);
+        digest = emb_mix(digest, (uint32_t)measurement);
+    }
+    return digest;
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"pid", 50000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
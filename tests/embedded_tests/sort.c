@@ -0,0 +1,91 @@
+// Embedded kernel: insertion sort and quicksort
+//
+// Median filters sort a handful of samples per channel; alarm and event
+// logs sort a few hundred records. One iteration insertion-sorts 16 short
+// windows of 32 readings and quicksorts a 512-element log, both refilled
+// from the same deterministic stream every time.
+
+#include "embedded_bench.h"
+
+#define WINDOWS 16
+#define WINDOW_SIZE 32
+#define LOG_SIZE 512
+
+int32_t windows[WINDOWS][WINDOW_SIZE];
+int32_t event_log[LOG_SIZE];
+
+static void setup(void) { emb_seed(0x5027u); }
+
+static void insertion_sort(int32_t* a, int n) {
+    for (int i = 1; i < n; i++) {
+        int32_t key = a[i];
+        int j = i - 1;
+        while (j >= 0 && a[j] > key) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = key;
+    }
+}
+
+// Lomuto partition with a median-of-three pivot; small ranges fall back to
+// insertion sort as firmware implementations usually do
+static void quick_sort(int32_t* a, int lo, int hi) {
+    while (hi - lo > 8) {
+        int mid = lo + (hi - lo) / 2;
+        if (a[mid] < a[lo]) { int32_t t = a[mid]; a[mid] = a[lo]; a[lo] = t; }
+        if (a[hi] < a[lo]) { int32_t t = a[hi]; a[hi] = a[lo]; a[lo] = t; }
+        if (a[mid] < a[hi]) { int32_t t = a[mid]; a[mid] = a[hi]; a[hi] = t; }
+
+        int32_t pivot = a[hi];
+        int p = lo;
+        for (int j = lo; j < hi; j++) {
+            if (a[j] < pivot) {
+                int32_t t = a[j];
+                a[j] = a[p];
+                a[p] = t;
+                p++;
+            }
+        }
+        int32_t t = a[p];
+        a[p] = a[hi];
+        a[hi] = t;
+
+        // Recurse into the smaller side to bound the stack depth
+        if (p - lo < hi - p) {
+            quick_sort(a, lo, p - 1);
+            lo = p + 1;
+        } else {
+            quick_sort(a, p + 1, hi);
+            hi = p - 1;
+        }
+    }
+    insertion_sort(a + lo, hi - lo + 1);
+}
+
+static uint32_t iterate(long i) {
+    (void)i;
+    uint32_t digest = 0;
+
+    for (int w = 0; w < WINDOWS; w++) {
+        for (int k = 0; k < WINDOW_SIZE; k++) {
+            windows[w][k] = (int32_t)(emb_rand() >> 20);
+        }
+        insertion_sort(windows[w], WINDOW_SIZE);
+        digest = emb_mix(digest, (uint32_t)windows[w][WINDOW_SIZE / 2]);
+    }
+
+    for (int k = 0; k < LOG_SIZE; k++) {
+        event_log[k] = (int32_t)emb_rand();
+    }
+    quick_sort(event_log, 0, LOG_SIZE - 1);
+    for (int k = 0; k < LOG_SIZE; k += 32) {
+        digest = emb_mix(digest, (uint32_t)event_log[k]);
+    }
+    return digest;
+}
+
+int main(int argc, char** argv) {
+    static const struct emb_kernel kernel = {"sort", 5000, setup, iterate};
+    return emb_run(&kernel, argc, argv);
+}
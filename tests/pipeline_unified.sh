@@ -12,9 +12,26 @@ PASS_VARIANT=""
 CFG_MODE=""
 DEBUG_FLAG=""
 NEAREST_VALID_FLAG=""
+COALESCE_FLAG=""
+NATIVE_RECOVERY=""
+NATIVE_REPORT_FLAG=""
+POLICY_LIST=""
+DEFAULT_POLICY=""
+OPT_LEVEL=""
+ASAN_PASS_OPTS=""
+FORKSERVER=false
+RUN_ARGS=""
 KEEP_IR=false
 OUTPUT_NAME=""
+OUTPUT_DIR="build_tests"
 VALIDATE_MODE=false
+STATS_FLAGS=""
+REMARKS=false
+CACHE_DIR="${CIMA_CACHE_DIR:-}"
+JOBS=1
+PROFILE_GENERATE=false
+PROFILE_USE=""
+OVERHEAD_BUDGET=""
 
 # Show usage information
 show_usage() {
@@ -22,10 +39,17 @@ show_usage() {
 Usage: ./pipeline_unified.sh <source.c> --pass=VARIANT [OPTIONS]
 
 Pass Selection (REQUIRED):
-  --pass=base|nearest|tainted|all|asan|none    Select CIMA pass variant (required)
+  --pass=base|nearest|tainted|native|mixed|bounds|all|asan|none
+                                 Select CIMA pass variant (required)
       base     - Base CIMA pass (returns undef values)
       nearest  - CIMA with nearest valid memory search
       tainted  - CIMA with dynamic taint tracking
+      native   - CIMA emits its own recovering checks; ASan only adds redzones
+      mixed    - Per-function policies: runs every CIMA pass, each on the
+                 functions selected for it (unlisted functions: asan)
+      bounds   - Base CIMA recovery from UBSan array-bounds checks (and
+                 object-size checks with --opt) instead of ASan: no shadow
+                 memory, redzones or malloc interception
       all      - Compile separately with each pass variant
       asan     - Skip CIMA pass (ASan only)
       none     - Skip both CIMA and ASan (raw compilation)
@@ -34,19 +58,79 @@ Configuration:
   --cfg[=all|final]              Generate CFG PDFs (default: final stage only)
   --debug                        Enable debug output (tainted pass only)
   --nearest-valid                Enable nearest-valid flag (nearest pass only)
+  --coalesce                     Coalesce ASan checks of adjacent accesses into
+                                 one wide shadow check (CIMA passes only)
+  --native-recovery=undef|zero|nearest
+                                 Value failing loads produce (native pass only,
+                                 default: undef)
+  --native-report                Report recovered accesses and keep running
+                                 (native pass only)
+  --policy-list=FILE             Special case list mapping functions (fun:) and
+                                 sources (src:) to policies in [none], [asan],
+                                 [base], [nearest], [native], [tainted] sections
+  --default-policy=POLICY        Policy for functions without annotation or list
+                                 entry; annotate("cima:<policy>") overrides both
+  --overhead-budget=PCT          Downgrade functions (tainted > nearest > base
+                                 > asan) until the predicted program overhead
+                                 fits PCT percent; report in
+                                 <binary>_budget.json (mixed pass only)
+  --opt=1|2|3                    Optimize at -O<N> before ASan (vectorized loops
+                                 get lane-wise masked-load recovery) and link
+                                 at -O<N> (default: unoptimized -O0 IR)
+  --jobs=N                       Split the module into N partitions and run
+                                 each CIMA plugin on them in parallel
+                                 (0: one per CPU; default: 1, no split)
+  --profile-generate             Count runs and failures of every check site;
+                                 running the binary appends them to
+                                 $CIMA_PROFILE_FILE (default: <binary>.profile)
+  --profile-use=FILE             Use such a profile for check branch weights
+                                 and to give hot checks that never failed the
+                                 cheapest recovery (base, nearest, tainted)
+  --asan-call-threshold=N        Have ASan use out-of-line __asan_load/store
+                                 callbacks in functions with more than N
+                                 accesses (CIMA recovers from both forms)
+  --forkserver                   Link the benchmark fork server, letting
+                                 cima_bench --forkserver fork measured runs
+                                 from a process parked before main
   --validate                     Run validation tests (nearest pass only)
                                  Compares base vs nearest, verifies IR generation
 
 Output:
-  --keep-ir                      Keep intermediate .ll files
+  --run-args="ARGS"              Arguments for the built binary when it is run
+                                 (e.g. --run-args=--sweep for tests/stream.c)
+  --keep-ir                      Keep intermediate IR as .ll files
   --output=NAME                  Specify output binary name
+  --output-dir=DIR               Directory for binaries and IR (default: build_tests)
+  --stats                        Print CIMA statistics and per-phase timings of
+                                 every CIMA opt step (-stats needs an LLVM
+                                 built with assertions or LLVM_ENABLE_STATS)
+  --remarks                      Write per-site CIMA optimization remarks,
+                                 including checks left aborting, to
+                                 <binary>_<pass>.remarks.yaml
+
+Caching:
+  --cache[=DIR]                  Reuse the results of stages whose inputs did
+                                 not change: raw IR, ASan, each CIMA plugin
+                                 and the link (default DIR: ~/.cache/cima)
+
+Environment:
+  CIMA_BUILD_ROOT                CMake build directory holding cimapass/ and
+                                 bench/ (default: ../build)
+  CIMA_CACHE_DIR                 Same as --cache=DIR
 
 Examples:
   ./pipeline_unified.sh test.c --pass=base
   ./pipeline_unified.sh test.c --pass=nearest --nearest-valid
   ./pipeline_unified.sh test.c --pass=nearest --nearest-valid --validate
   ./pipeline_unified.sh test.c --pass=tainted --debug
+  ./pipeline_unified.sh test.c --pass=base --opt=2
+  ./pipeline_unified.sh test.c --pass=native --native-recovery=nearest
+  ./pipeline_unified.sh test.c --pass=mixed --policy-list=policy.txt
+  ./pipeline_unified.sh test.c --pass=mixed --default-policy=tainted --overhead-budget=50
+  ./pipeline_unified.sh test.c --pass=nearest --profile-generate
+  ./pipeline_unified.sh test.c --pass=nearest --profile-use=build_tests/test_final.profile
   ./pipeline_unified.sh test.c --pass=all --cfg=all
+  ./pipeline_unified.sh test.c --pass=bounds
   ./pipeline_unified.sh test.c --pass=asan
   ./pipeline_unified.sh test.c --pass=none
 EOF
@@ -76,6 +160,58 @@ while [[ $# -gt 0 ]]; do
             NEAREST_VALID_FLAG="-cima-use-nearest-valid"
             shift
             ;;
+        --coalesce)
+            COALESCE_FLAG="-cima-coalesce-checks"
+            shift
+            ;;
+        --native-recovery=*)
+            NATIVE_RECOVERY="${1#*=}"
+            shift
+            ;;
+        --native-report)
+            NATIVE_REPORT_FLAG="-cima-native-report"
+            shift
+            ;;
+        --policy-list=*)
+            POLICY_LIST="${1#*=}"
+            shift
+            ;;
+        --default-policy=*)
+            DEFAULT_POLICY="${1#*=}"
+            shift
+            ;;
+        --opt=*)
+            OPT_LEVEL="${1#*=}"
+            shift
+            ;;
+        --jobs=*)
+            JOBS="${1#*=}"
+            shift
+            ;;
+        --overhead-budget=*)
+            OVERHEAD_BUDGET="${1#*=}"
+            shift
+            ;;
+        --profile-generate)
+            PROFILE_GENERATE=true
+            shift
+            ;;
+        --profile-use=*)
+            PROFILE_USE="${1#*=}"
+            shift
+            ;;
+        --asan-call-threshold=*)
+            ASAN_PASS_OPTS="-asan-instrumentation-with-call-threshold=${1#*=}"
+            shift
+            ;;
+        --forkserver)
+            FORKSERVER=true
+            shift
+            ;;
+        --run-args=*)
+            RUN_ARGS="${1#*=}"
+            shift
+            ;;
         --keep-ir)
             KEEP_IR=true
             shift
@@ -88,6 +224,26 @@ while [[ $# -gt 0 ]]; do
             OUTPUT_NAME="${1#*=}"
             shift
             ;;
+        --output-dir=*)
+            OUTPUT_DIR="${1#*=}"
+            shift
+            ;;
+        --stats)
+            STATS_FLAGS="-stats -time-passes"
+            shift
+            ;;
+        --remarks)
+            REMARKS=true
+            shift
+            ;;
+        --cache)
+            CACHE_DIR="${XDG_CACHE_HOME:-$HOME/.cache}/cima"
+            shift
+            ;;
+        --cache=*)
+            CACHE_DIR="${1#*=}"
+            shift
+            ;;
         -h|--help)
             show_usage
             exit 0
@@ -131,11 +287,11 @@ fi
 
 # Validate pass variant
 case $PASS_VARIANT in
-    base|nearest|tainted|all|asan|none)
+    base|nearest|tainted|native|mixed|bounds|all|asan|none)
         ;;
     *)
         echo "Error: Invalid pass variant: $PASS_VARIANT"
-        echo "Must be one of: base, nearest, tainted, all, asan, none"
+        echo "Must be one of: base, nearest, tainted, native, mixed, bounds, all, asan, none"
         exit 1
         ;;
 esac
@@ -153,6 +309,55 @@ if [ -n "$CFG_MODE" ]; then
     esac
 fi
 
+# Validate native recovery mode if specified
+if [ -n "$NATIVE_RECOVERY" ]; then
+    case $NATIVE_RECOVERY in
+        undef|zero|nearest)
+            ;;
+        *)
+            echo "Error: Invalid native recovery mode: $NATIVE_RECOVERY"
+            echo "Must be one of: undef, zero, nearest"
+            exit 1
+            ;;
+    esac
+fi
+
+# Validate policy options if specified
+if [ -n "$POLICY_LIST" ] && [ ! -f "$POLICY_LIST" ]; then
+    echo "Error: Policy list not found: $POLICY_LIST"
+    exit 1
+fi
+
+if [ -n "$DEFAULT_POLICY" ]; then
+    case $DEFAULT_POLICY in
+        none|asan|base|nearest|native|tainted)
+            ;;
+        *)
+            echo "Error: Invalid default policy: $DEFAULT_POLICY"
+            echo "Must be one of: none, asan, base, nearest, native, tainted"
+            exit 1
+            ;;
+    esac
+fi
+
+# Mixed mode only instruments what annotations or the list select
+if [ "$PASS_VARIANT" == "mixed" ] && [ -z "$DEFAULT_POLICY" ]; then
+    DEFAULT_POLICY="asan"
+fi
+
+# Validate optimization level if specified
+if [ -n "$OPT_LEVEL" ]; then
+    case $OPT_LEVEL in
+        1|2|3)
+            ;;
+        *)
+            echo "Error: Invalid optimization level: $OPT_LEVEL"
+            echo "Must be one of: 1, 2, 3"
+            exit 1
+            ;;
+    esac
+fi
+
 # Auto-enable nearest-valid for nearest pass variant
 if [ "$PASS_VARIANT" == "nearest" ]; then
     NEAREST_VALID_FLAG="-cima-use-nearest-valid"
@@ -167,10 +372,112 @@ if [ "$PASS_VARIANT" != "nearest" ] && [ -n "$NEAREST_VALID_FLAG" ]; then
     echo "Warning: --nearest-valid flag only applies to nearest pass variant"
 fi
 
+if [ "$PASS_VARIANT" != "native" ] && [ "$PASS_VARIANT" != "all" ] && \
+   { [ -n "$NATIVE_RECOVERY" ] || [ -n "$NATIVE_REPORT_FLAG" ]; }; then
+    echo "Warning: --native-recovery and --native-report only apply to native pass variant"
+fi
+
+if ! [[ "$JOBS" =~ ^[0-9]+$ ]]; then
+    echo "Error: --jobs needs a number, got: $JOBS"
+    exit 1
+fi
+if [ "$JOBS" -eq 0 ]; then
+    JOBS=$(nproc)
+fi
+
+# The budget moves functions between variants, which only mixed runs all of
+if [ -n "$OVERHEAD_BUDGET" ]; then
+    if ! [[ "$OVERHEAD_BUDGET" =~ ^[0-9]+(\.[0-9]+)?$ ]]; then
+        echo "Error: --overhead-budget needs a percentage, got: $OVERHEAD_BUDGET"
+        exit 1
+    fi
+    if [ "$PASS_VARIANT" != "mixed" ]; then
+        echo "Error: --overhead-budget needs --pass=mixed"
+        exit 1
+    fi
+fi
+
+if [ "$PROFILE_GENERATE" = true ] && [ -n "$PROFILE_USE" ]; then
+    echo "Error: --profile-generate and --profile-use are exclusive"
+    exit 1
+fi
+if [ -n "$PROFILE_USE" ] && [ ! -f "$PROFILE_USE" ]; then
+    echo "Error: Profile not found: $PROFILE_USE"
+    exit 1
+fi
+if [ "$PASS_VARIANT" == "native" ] && { [ "$PROFILE_GENERATE" = true ] || [ -n "$PROFILE_USE" ]; }; then
+    echo "Warning: --profile-generate and --profile-use do not apply to the native pass variant"
+fi
+
 # Setup variables
 BASENAME=$(basename "$INPUT_FILE" .c)
-BUILD_DIR="../build/cimapass"
-OUTPUT_DIR="build_tests"
+BUILD_ROOT="${CIMA_BUILD_ROOT:-../build}"
+BUILD_DIR="$BUILD_ROOT/cimapass"
+BENCH_BUILD_DIR="$BUILD_ROOT/bench"
+
+# Policy options shared by every CIMA plugin
+POLICY_OPTS=""
+if [ -n "$POLICY_LIST" ]; then
+    POLICY_OPTS="-cima-policy-list=$POLICY_LIST"
+fi
+if [ -n "$DEFAULT_POLICY" ]; then
+    POLICY_OPTS="$POLICY_OPTS -cima-default-policy=$DEFAULT_POLICY"
+fi
+# Every plugin sees the whole module in mixed mode, so a bare "cima"
+# annotation must name one variant rather than each plugin's own
+if [ "$PASS_VARIANT" == "mixed" ]; then
+    POLICY_OPTS="$POLICY_OPTS -cima-annotation-policy=base"
+fi
+
+# Native pass options
+NATIVE_OPTS="$NATIVE_REPORT_FLAG"
+if [ -n "$NATIVE_RECOVERY" ]; then
+    NATIVE_OPTS="$NATIVE_OPTS -cima-native-recovery=$NATIVE_RECOVERY"
+fi
+
+# Check-site profile options of the post-ASan plugins
+PROFILE_OPTS=""
+if [ "$PROFILE_GENERATE" = true ]; then
+    PROFILE_OPTS="-cima-profile-generate"
+elif [ -n "$PROFILE_USE" ]; then
+    PROFILE_OPTS="-cima-profile-use=$PROFILE_USE"
+fi
+
+# Fork server object linked into every binary for cima_bench --forkserver
+FORKSERVER_OBJ=""
+if [ "$FORKSERVER" = true ]; then
+    FORKSERVER_OBJ="$BENCH_BUILD_DIR/cima_forkserver.o"
+    if [ ! -f "$FORKSERVER_OBJ" ]; then
+        echo "Error: Fork server object not found: $FORKSERVER_OBJ"
+        echo "Please run ./build.sh first"
+        exit 1
+    fi
+fi
+
+# Frontend and link flags for the requested optimization level
+FRONTEND_OPT_FLAGS="-O0 -Xclang -disable-O0-optnone"
+LINK_OPT_FLAGS=""
+if [ -n "$OPT_LEVEL" ]; then
+    FRONTEND_OPT_FLAGS="-O$OPT_LEVEL"
+    LINK_OPT_FLAGS="-O$OPT_LEVEL"
+fi
+
+# Record each function's stack frame size in a .stack_sizes section, which
+# cima_bench reports per variant (tainted doubles frames with .shadow allocas)
+CODEGEN_FLAGS="-fstack-size-section"
+
+# Stage cache. --pass=all shares the raw and ASan IR between its variants
+# even without --cache, through a cache that only lives for this run.
+TOOLS_ID=""
+if [ -z "$CACHE_DIR" ] && [ "$PASS_VARIANT" == "all" ]; then
+    CACHE_DIR=$(mktemp -d)
+    trap 'rm -rf "$CACHE_DIR"' EXIT
+fi
+if [ -n "$CACHE_DIR" ]; then
+    mkdir -p "$CACHE_DIR"
+    # Part of every key: the tools and this script decide what stages produce
+    TOOLS_ID=$( { clang --version; opt --version; cat "${BASH_SOURCE[0]}"; } 2>&1 | sha256sum | cut -d' ' -f1)
+fi
 
 # Create output directory if it doesn't exist
 mkdir -p "$OUTPUT_DIR"
@@ -195,6 +502,170 @@ generate_cfg() {
     fi
 }
 
+# Exit unless the given plugin has been built
+require_plugin() {
+    if [ ! -f "$BUILD_DIR/$1" ]; then
+        echo "Error: Plugin not found: $BUILD_DIR/$1"
+        echo "Please run ./build.sh first"
+        exit 1
+    fi
+}
+
+# Statistics and remark options for one CIMA opt step. The remark file is
+# named after the binary plus the pass, so mixed-mode stages don't collide.
+cima_report_opts() {
+    local remarks_base="$1"
+    local pass_name="$2"
+
+    echo -n "$STATS_FLAGS"
+    if [ "$REMARKS" = true ]; then
+        echo -n " -pass-remarks-output=${remarks_base}_${pass_name}.remarks.yaml"
+        echo -n " -pass-remarks-filter=cima"
+    fi
+}
+
+file_hash() {
+    sha256sum "$1" | cut -d' ' -f1
+}
+
+# Cache key of a stage from everything its output depends on
+stage_key() {
+    printf '%s\n' "$TOOLS_ID" "$@" | sha256sum | cut -d' ' -f1
+}
+
+# Key of a plugin stage: its input, the plugin binary and its options.
+# Empty (uncached) without a cache.
+plugin_key() {
+    [ -n "$CACHE_DIR" ] || return 0
+    local stage="$1" input="$2" plugin="$3"
+    shift 3
+    stage_key "$stage" "$(file_hash "$input")" "$(file_hash "$BUILD_DIR/$plugin")" "$@"
+}
+
+# Hash of the preprocessed source, as ccache's preprocessor mode does, so
+# header changes invalidate the raw IR too
+source_hash() {
+    clang -E $FRONTEND_OPT_FLAGS "$@" "$INPUT_FILE" | sha256sum | cut -d' ' -f1
+}
+
+policy_list_hash() {
+    if [ -n "$POLICY_LIST" ]; then
+        file_hash "$POLICY_LIST"
+    fi
+}
+
+profile_hash() {
+    if [ -n "$PROFILE_USE" ]; then
+        file_hash "$PROFILE_USE"
+    fi
+}
+
+# cached KEY OUTPUT COMMAND...: copy OUTPUT from the cache entry KEY, or
+# run COMMAND, which writes OUTPUT, and store the result under KEY. An
+# empty KEY just runs COMMAND.
+cached() {
+    local key="$1" output="$2"
+    shift 2
+    if [ -z "$key" ]; then
+        "$@"
+        return
+    fi
+
+    local entry="$CACHE_DIR/${key:0:2}/$key"
+    if [ -f "$entry" ]; then
+        echo "  Reusing cached result ${key:0:12}"
+        cp "$entry" "$output"
+        return
+    fi
+
+    "$@" || return
+    mkdir -p "${entry%/*}"
+    cp "$output" "$entry.tmp.$$" && mv "$entry.tmp.$$" "$entry"
+}
+
+# run_plugin PLUGIN PASS INPUT OUTPUT OPTIONS...: run one CIMA plugin pass.
+# With --jobs=N the module is first split into N partitions by llvm-split,
+# keeping local symbols with their users and balancing partitions by size.
+# N opt processes instrument the partitions in parallel, and llvm-link joins
+# them. The CIMA passes only look at one function at a time, so the result
+# matches a single opt run up to the order of functions.
+run_plugin() {
+    local plugin="$1" pass="$2" input="$3" output="$4"
+    shift 4
+    if [ "$JOBS" -le 1 ]; then
+        opt -load-pass-plugin="$BUILD_DIR/$plugin" -passes="$pass" "$@" "$input" -o "$output"
+        return
+    fi
+
+    local dir
+    dir=$(mktemp -d "$OUTPUT_DIR/.split.XXXXXX")
+    # llvm.global.annotations ends up in a single partition; pin each
+    # function's annotation to the function first
+    if ! opt -load-pass-plugin="$BUILD_DIR/$plugin" -passes=cima-policy-pin \
+             "$input" -o "$dir/pinned.bc" ||
+       ! llvm-split -j "$JOBS" -preserve-locals "$dir/pinned.bc" -o "$dir/part"; then
+        rm -rf "$dir"
+        return 1
+    fi
+
+    # Each partition writes its own remarks; they are concatenated below
+    local remarks="" arg
+    for arg in "$@"; do
+        if [[ "$arg" == -pass-remarks-output=* ]]; then
+            remarks="${arg#*=}"
+        fi
+    done
+
+    local i pid status=0
+    local pids=() parts=()
+    for ((i = 0; i < JOBS; i++)); do
+        local args=()
+        for arg in "$@"; do
+            if [ -n "$remarks" ] && [ "$arg" == "-pass-remarks-output=$remarks" ]; then
+                arg="-pass-remarks-output=$dir/remarks$i.yaml"
+            fi
+            args+=("$arg")
+        done
+        opt -load-pass-plugin="$BUILD_DIR/$plugin" -passes="$pass" "${args[@]}" \
+            "$dir/part$i" -o "$dir/part$i.out" &
+        pids+=($!)
+        parts+=("$dir/part$i.out")
+    done
+    for pid in "${pids[@]}"; do
+        wait "$pid" || status=1
+    done
+
+    if [ "$status" -eq 0 ]; then
+        llvm-link "${parts[@]}" -o "$output" || status=1
+    fi
+    if [ -n "$remarks" ]; then
+        cat "$dir"/remarks*.yaml > "$remarks" 2>/dev/null || true
+    fi
+    rm -rf "$dir"
+    return "$status"
+}
+
+# Step 1 proper: C to bitcode, optimized (and vectorized) before ASan as
+# clang itself would when --opt is given
+compile_raw() {
+    local sanitize="$1" output="$2"
+    clang -c -emit-llvm $FRONTEND_OPT_FLAGS $sanitize $VARIANT_DEFINE \
+        -Xclang -disable-llvm-passes \
+        "$INPUT_FILE" -o "$output" || return
+
+    if [ -n "$OPT_LEVEL" ]; then
+        echo "Step 1b: Optimizing LLVM IR at -O$OPT_LEVEL..."
+        opt -passes="default<O$OPT_LEVEL>" "$output" -o "$output"
+    fi
+}
+
+# Replace a kept bitcode file by its text IR (foo.bc -> foo.ll)
+keep_as_text() {
+    if [ -f "$1" ]; then
+        llvm-dis "$1" -o "${1%.bc}.ll" && rm -f "$1"
+    fi
+}
+
 # Function to compile with a specific pass variant
 compile_with_pass() {
     local variant="$1"
@@ -213,25 +684,38 @@ compile_with_pass() {
         base)
             PLUGIN="CIMAPass.so"
             PASS_NAME="CIMAPass"
-            PASS_OPTS=""
-            RUNTIME_OBJ=""
+            PASS_OPTS="$COALESCE_FLAG $POLICY_OPTS $PROFILE_OPTS"
+            RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
             ;;
         nearest)
             PLUGIN="CIMAPassNearestValid.so"
             PASS_NAME="CIMAPassNearestValid"
-            PASS_OPTS="$NEAREST_VALID_FLAG"
+            PASS_OPTS="$NEAREST_VALID_FLAG $COALESCE_FLAG $POLICY_OPTS $PROFILE_OPTS"
             RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
-            if [ -n "$NEAREST_VALID_FLAG" ] && [ ! -f "$RUNTIME_OBJ" ]; then
-                echo "Error: Runtime object not found: $RUNTIME_OBJ"
-                echo "Please run ./build.sh first"
-                exit 1
-            fi
             ;;
         tainted)
             PLUGIN="CIMAPassTainted.so"
             PASS_NAME="CIMAPassTainted"
-            PASS_OPTS="$DEBUG_FLAG"
-            RUNTIME_OBJ=""
+            PASS_OPTS="$DEBUG_FLAG $COALESCE_FLAG $POLICY_OPTS $PROFILE_OPTS"
+            RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
+            ;;
+        native)
+            PLUGIN="CIMAPassNative.so"
+            PASS_NAME="CIMAPassNative"
+            PASS_OPTS="$NATIVE_OPTS $POLICY_OPTS"
+            RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
+            ;;
+        mixed)
+            PLUGIN=""
+            PASS_NAME=""
+            PASS_OPTS=""
+            RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
+            ;;
+        bounds)
+            PLUGIN="CIMAPass.so"
+            PASS_NAME="CIMAPass"
+            PASS_OPTS="$POLICY_OPTS $PROFILE_OPTS"
+            RUNTIME_OBJ="$BUILD_DIR/cima_runtime.o"
             ;;
         asan)
             PLUGIN=""
@@ -247,93 +731,191 @@ compile_with_pass() {
             ;;
     esac
 
-    # Output file names
-    local RAW_LL="$OUTPUT_DIR/${BASENAME}.ll"
-    local ASAN_LL="$OUTPUT_DIR/${BASENAME}${suffix}_asan.ll"
-    local FINAL_LL="$OUTPUT_DIR/${BASENAME}${suffix}_final.ll"
+    # Every CIMA variant links the runtime: nearest-valid search and the
+    # validity checks that replace ASan's callbacks live there
+    if [ -n "$RUNTIME_OBJ" ] && [ ! -f "$RUNTIME_OBJ" ]; then
+        echo "Error: Runtime object not found: $RUNTIME_OBJ"
+        echo "Please run ./build.sh first"
+        exit 1
+    fi
+
+    # Output file names. Stages pass bitcode; --keep-ir disassembles it
+    local RAW_BC="$OUTPUT_DIR/${BASENAME}.bc"
+    local ASAN_BC="$OUTPUT_DIR/${BASENAME}${suffix}_asan.bc"
+    local FINAL_BC="$OUTPUT_DIR/${BASENAME}${suffix}_final.bc"
     local BINARY="$OUTPUT_DIR/${BASENAME}${suffix}_final"
 
     if [ -n "$OUTPUT_NAME" ] && [ "$variant" != "all" ]; then
         BINARY="$OUTPUT_DIR/$OUTPUT_NAME"
     fi
 
-    # Step 1: Compile C to LLVM IR (only if not already done for 'all' variant)
-    # For 'none' variant, always regenerate raw IR without ASan
-    if [ "$variant" == "none" ] || [ "$variant" == "all" ] || [ ! -f "$RAW_LL" ]; then
-        if [ "$variant" == "none" ]; then
-            echo "Step 1: Compiling C to LLVM IR (no instrumentation)..."
-            clang -S -emit-llvm -O0 \
-                -Xclang -disable-llvm-passes \
-                -Xclang -disable-O0-optnone \
-                "$INPUT_FILE" -o "$RAW_LL"
+    # Step 1: Compile C to LLVM IR. The 'none' variant compiles without
+    # ASan and 'bounds' with UBSan's bounds checks; every other variant
+    # shares the same cached raw IR unless the source reads CIMA_VARIANT
+    # (tests/cima_variant.h). Object-size checks need the optimizer.
+    local VARIANT_DEFINE="-DCIMA_VARIANT=\"$variant\""
+    local SANITIZE_FLAG="-fsanitize=address"
+    if [ "$variant" == "none" ]; then
+        SANITIZE_FLAG=""
+        echo "Step 1: Compiling C to LLVM IR (no instrumentation)..."
+    elif [ "$variant" == "bounds" ]; then
+        SANITIZE_FLAG="-fsanitize=bounds"
+        if [ -n "$OPT_LEVEL" ]; then
+            SANITIZE_FLAG="-fsanitize=bounds,object-size"
+        fi
+        echo "Step 1: Compiling C to LLVM IR with UBSan bounds checks..."
+    else
+        echo "Step 1: Compiling C to LLVM IR with ASan..."
+    fi
+    local key=""
+    if [ -n "$CACHE_DIR" ]; then
+        key=$(stage_key raw "$(source_hash $SANITIZE_FLAG $VARIANT_DEFINE)" "$FRONTEND_OPT_FLAGS" "$SANITIZE_FLAG" \
+                        "$OPT_LEVEL")
+    fi
+    cached "$key" "$RAW_BC" compile_raw "$SANITIZE_FLAG" "$RAW_BC"
+
+    if [ "$CFG_MODE" == "all" ]; then
+        generate_cfg "$RAW_BC" "0_raw${suffix}"
+    fi
+
+    # Step 2: Run ASan pass (if not 'none'). Functions with policy none
+    # lose sanitize_address first. The native pass instruments its functions
+    # before ASan, which skips the accesses it marks nosanitize.
+    local ASAN_INPUT="$RAW_BC"
+    if [ "$variant" != "none" ] && [ -n "$POLICY_OPTS" ]; then
+        echo "Step 2a: Applying CIMA instrumentation policy..."
+        require_plugin "CIMAPass.so"
+        local policy_passes="cima-policy-prepare"
+        local budget_opts=""
+        key=""
+        if [ -n "$OVERHEAD_BUDGET" ]; then
+            # Not cached, so the report is written every time
+            policy_passes="cima-budget,cima-policy-prepare"
+            budget_opts="-cima-overhead-budget=$OVERHEAD_BUDGET -cima-budget-report-file=${BINARY}_budget.json"
         else
-            echo "Step 1: Compiling C to LLVM IR with ASan..."
-            clang -S -emit-llvm -O0 \
-                -fsanitize=address \
-                -Xclang -disable-llvm-passes \
-                -Xclang -disable-O0-optnone \
-                "$INPUT_FILE" -o "$RAW_LL"
+            key=$(plugin_key policy "$ASAN_INPUT" CIMAPass.so "$POLICY_OPTS" "$(policy_list_hash)")
         fi
+        cached "$key" "$ASAN_BC" \
+            opt -load-pass-plugin="$BUILD_DIR/CIMAPass.so" \
+                -passes="$policy_passes" \
+                $POLICY_OPTS $budget_opts \
+                "$ASAN_INPUT" -o "$ASAN_BC"
+        ASAN_INPUT="$ASAN_BC"
+    fi
 
-        if [ "$CFG_MODE" == "all" ]; then
-            generate_cfg "$RAW_LL" "0_raw${suffix}"
+    if [ "$variant" == "native" ] || [ "$variant" == "mixed" ]; then
+        echo "Step 2b: Running CIMA native instrumentation (CIMAPassNative)..."
+        require_plugin "CIMAPassNative.so"
+        local report_opts
+        report_opts=$(cima_report_opts "$BINARY" CIMAPassNative)
+        key=""
+        if [ -z "$report_opts" ]; then
+            key=$(plugin_key native "$ASAN_INPUT" CIMAPassNative.so "$NATIVE_OPTS $POLICY_OPTS" \
+                             "$(policy_list_hash)")
         fi
+        cached "$key" "$ASAN_BC" \
+            run_plugin CIMAPassNative.so CIMAPassNative "$ASAN_INPUT" "$ASAN_BC" \
+                $NATIVE_OPTS $POLICY_OPTS $report_opts
+        ASAN_INPUT="$ASAN_BC"
     fi
 
-    # Step 2: Run ASan pass (if not 'none')
-    if [ "$variant" != "none" ]; then
+    if [ "$variant" != "none" ] && [ "$variant" != "bounds" ]; then
         echo "Step 2: Running ASan pass..."
-        opt -passes='module(asan),asan' \
-            "$RAW_LL" -S -o "$ASAN_LL" 2>&1 | grep -v "Redundant instrumentation detected" || true
+        key=""
+        if [ -n "$CACHE_DIR" ]; then
+            key=$(stage_key asan "$(file_hash "$ASAN_INPUT")" "$ASAN_PASS_OPTS")
+        fi
+        cached "$key" "$ASAN_BC" \
+            opt -passes='module(asan),asan' $ASAN_PASS_OPTS \
+                "$ASAN_INPUT" -o "$ASAN_BC" 2>&1 | grep -v "Redundant instrumentation detected" || true
 
         if [ "$CFG_MODE" == "all" ]; then
-            generate_cfg "$ASAN_LL" "1_asan${suffix}"
+            generate_cfg "$ASAN_BC" "1_asan${suffix}"
         fi
     else
-        echo "Step 2: Skipping ASan pass (none variant)"
-        cp "$RAW_LL" "$ASAN_LL"
+        echo "Step 2: Skipping ASan pass ($variant variant)"
+        if [ "$ASAN_INPUT" != "$ASAN_BC" ]; then
+            cp "$ASAN_INPUT" "$ASAN_BC"
+        fi
     fi
 
-    # Step 3: Run CIMA pass (if not 'none' or 'asan')
-    if [ "$variant" != "none" ] && [ "$variant" != "asan" ]; then
+    # Step 3: Run CIMA pass (if not 'none', 'asan' or 'native'). The mixed
+    # variant runs every post-ASan pass in turn; each one only touches the
+    # functions whose policy names it.
+    if [ "$variant" == "mixed" ]; then
+        echo "Step 3: Running CIMA passes per function policy..."
+        local STAGE_BC="$ASAN_BC"
+        local stage
+        for stage in "CIMAPass:$COALESCE_FLAG" \
+                     "CIMAPassNearestValid:-cima-use-nearest-valid $COALESCE_FLAG" \
+                     "CIMAPassTainted:$DEBUG_FLAG $COALESCE_FLAG"; do
+            local stage_pass="${stage%%:*}"
+            require_plugin "$stage_pass.so"
+            local stage_out="$FINAL_BC.$stage_pass"
+            report_opts=$(cima_report_opts "$BINARY" "$stage_pass")
+            key=""
+            if [ -z "$report_opts" ]; then
+                key=$(plugin_key "$stage_pass" "$STAGE_BC" "$stage_pass.so" \
+                                 "${stage#*:} $POLICY_OPTS $PROFILE_OPTS" "$(policy_list_hash)" \
+                                 "$(profile_hash)")
+            fi
+            cached "$key" "$stage_out" \
+                run_plugin "$stage_pass.so" "$stage_pass" "$STAGE_BC" "$stage_out" \
+                    ${stage#*:} $POLICY_OPTS $PROFILE_OPTS $report_opts 2>&1 | grep -v "Redundant instrumentation detected" || true
+            if [ "$STAGE_BC" != "$ASAN_BC" ]; then
+                rm -f "$STAGE_BC"
+            fi
+            STAGE_BC="$stage_out"
+        done
+        mv "$STAGE_BC" "$FINAL_BC"
+    elif [ "$variant" != "none" ] && [ "$variant" != "asan" ] && [ "$variant" != "native" ]; then
         echo "Step 3: Running CIMA pass ($PASS_NAME)..."
+        require_plugin "$PLUGIN"
 
-        if [ ! -f "$BUILD_DIR/$PLUGIN" ]; then
-            echo "Error: Plugin not found: $BUILD_DIR/$PLUGIN"
-            echo "Please run ./build.sh first"
-            exit 1
+        report_opts=$(cima_report_opts "$BINARY" "$PASS_NAME")
+        key=""
+        if [ -z "$report_opts" ]; then
+            key=$(plugin_key "$PASS_NAME" "$ASAN_BC" "$PLUGIN" "$PASS_OPTS" "$(policy_list_hash)" \
+                             "$(profile_hash)")
         fi
-
-        opt -load-pass-plugin="$BUILD_DIR/$PLUGIN" \
-            -passes="$PASS_NAME" \
-            $PASS_OPTS \
-            "$ASAN_LL" -S -o "$FINAL_LL" 2>&1 | grep -v "Redundant instrumentation detected" || true
+        cached "$key" "$FINAL_BC" \
+            run_plugin "$PLUGIN" "$PASS_NAME" "$ASAN_BC" "$FINAL_BC" \
+                $PASS_OPTS $report_opts 2>&1 | grep -v "Redundant instrumentation detected" || true
     else
         echo "Step 3: Skipping CIMA pass ($variant variant)"
-        cp "$ASAN_LL" "$FINAL_LL"
+        cp "$ASAN_BC" "$FINAL_BC"
     fi
 
     if [ "$CFG_MODE" == "final" ] || [ "$CFG_MODE" == "all" ]; then
-        generate_cfg "$FINAL_LL" "2_${variant}${suffix}"
+        generate_cfg "$FINAL_BC" "2_${variant}${suffix}"
     fi
 
     # Step 4: Link binary
     echo "Step 4: Linking binary..."
-    if [ "$variant" == "none" ]; then
-        clang "$FINAL_LL" -o "$BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
-    elif [ -n "$RUNTIME_OBJ" ] && [ -n "$NEAREST_VALID_FLAG" ]; then
-        clang -fsanitize=address "$FINAL_LL" "$RUNTIME_OBJ" -o "$BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
-    else
-        clang -fsanitize=address "$FINAL_LL" -o "$BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
+    local LINK_INPUTS="$FINAL_BC $RUNTIME_OBJ $FORKSERVER_OBJ"
+    key=""
+    if [ -n "$CACHE_DIR" ]; then
+        local input
+        local input_hashes=""
+        for input in $LINK_INPUTS; do
+            input_hashes="$input_hashes $(file_hash "$input")"
+        done
+        key=$(stage_key link "$input_hashes" "$LINK_OPT_FLAGS $CODEGEN_FLAGS $SANITIZE_FLAG")
     fi
+    cached "$key" "$BINARY" \
+        clang $LINK_OPT_FLAGS $CODEGEN_FLAGS $SANITIZE_FLAG $LINK_INPUTS -o "$BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
 
     echo "Binary created: $BINARY"
 
-    # Clean up intermediate files if not keeping IR
-    if [ "$KEEP_IR" = false ]; then
-        rm -f "$ASAN_LL"
+    # Clean up intermediate files; --keep-ir leaves them as text IR. The
+    # final IR of each --pass=all variant stays for bench/overhead_report.py.
+    if [ "$KEEP_IR" = true ]; then
+        keep_as_text "$ASAN_BC"
+        keep_as_text "$FINAL_BC"
+    else
+        rm -f "$ASAN_BC"
         if [ "$variant" == "all" ] || [ "$PASS_VARIANT" != "all" ]; then
-            rm -f "$FINAL_LL"
+            rm -f "$FINAL_BC"
         fi
     fi
 
@@ -343,7 +925,18 @@ compile_with_pass() {
     if [ "$variant" != "none" ]; then
         export ASAN_OPTIONS="detect_stack_use_after_return=0"
     fi
-    ./"$BINARY" || true
+    if { [ "$variant" == "native" ] || [ "$variant" == "mixed" ]; } && [ -n "$NATIVE_REPORT_FLAG" ]; then
+        export ASAN_OPTIONS="$ASAN_OPTIONS:halt_on_error=0"
+    fi
+    # Only the post-ASan plugins count check sites
+    if [ "$PROFILE_GENERATE" = true ] && [ "$variant" != "native" ] && \
+       [ "$variant" != "asan" ] && [ "$variant" != "none" ]; then
+        local profile="${CIMA_PROFILE_FILE:-$BINARY.profile}"
+        CIMA_PROFILE_FILE="$profile" "$BINARY" $RUN_ARGS || true
+        echo "Check-site profile appended to $profile"
+    else
+        "$BINARY" $RUN_ARGS || true
+    fi
     echo ""
 }
 
@@ -354,16 +947,16 @@ run_validation() {
     echo ""
 
     # Ensure we have the raw IR and run ASan on it first
-    local RAW_LL="$OUTPUT_DIR/${BASENAME}.ll"
-    if [ ! -f "$RAW_LL" ]; then
+    local RAW_BC="$OUTPUT_DIR/${BASENAME}.bc"
+    if [ ! -f "$RAW_BC" ]; then
         echo "Error: Raw IR not found. Validation requires IR files."
         exit 1
     fi
 
     # Generate ASan-instrumented IR for validation
     local VALIDATION_ASAN_LL="$OUTPUT_DIR/${BASENAME}_validation_asan.ll"
-    opt -passes='module(asan),asan' \
-        "$RAW_LL" -S -o "$VALIDATION_ASAN_LL" 2>&1 | grep -v "Redundant instrumentation detected" || true
+    opt -passes='module(asan),asan' $ASAN_PASS_OPTS \
+        "$RAW_BC" -S -o "$VALIDATION_ASAN_LL" 2>&1 | grep -v "Redundant instrumentation detected" || true
 
     echo "1. Testing base CIMA pass (should use UndefValue)..."
     opt -load-pass-plugin="$BUILD_DIR/CIMAPass.so" \
@@ -399,13 +992,13 @@ run_validation() {
     echo "3. Comparing runtime behavior..."
     echo "   Base pass output (undef values):"
     local BASE_BINARY="$OUTPUT_DIR/${BASENAME}_validation_base_final"
-    clang -fsanitize=address "$OUTPUT_DIR/${BASENAME}_validation_base.ll" -o "$BASE_BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
+    clang -fsanitize=address "$OUTPUT_DIR/${BASENAME}_validation_base.ll" "$BUILD_DIR/cima_runtime.o" -o "$BASE_BINARY" 2>&1 | grep -v "Redundant instrumentation detected" || true
     export ASAN_OPTIONS="detect_stack_use_after_return=0"
     "$BASE_BINARY" 2>&1 | head -3 || true
 
     echo ""
     echo "   Nearest valid pass output (recovers from OOB):"
-    ./"$OUTPUT_DIR/${BASENAME}_final" 2>&1 | head -3 || true
+    "$OUTPUT_DIR/${BASENAME}_final" 2>&1 | head -3 || true
 
     # Cleanup validation artifacts
     rm -f "$OUTPUT_DIR/${BASENAME}_validation_asan.ll"
@@ -439,12 +1032,16 @@ if [ "$PASS_VARIANT" == "all" ]; then
     compile_with_pass "base" "_base"
     compile_with_pass "nearest" "_nearest"
     compile_with_pass "tainted" "_tainted"
+    compile_with_pass "native" "_native"
+    compile_with_pass "bounds" "_bounds"
     compile_with_pass "asan" "_asan"
     compile_with_pass "none" "_none"
 
     # Clean up shared raw IR if not keeping
     if [ "$KEEP_IR" = false ]; then
-        rm -f "$OUTPUT_DIR/${BASENAME}.ll"
+        rm -f "$OUTPUT_DIR/${BASENAME}.bc"
+    else
+        keep_as_text "$OUTPUT_DIR/${BASENAME}.bc"
     fi
 
     echo ""
@@ -453,6 +1050,8 @@ if [ "$PASS_VARIANT" == "all" ]; then
     echo "  - $OUTPUT_DIR/${BASENAME}_base_final"
     echo "  - $OUTPUT_DIR/${BASENAME}_nearest_final"
     echo "  - $OUTPUT_DIR/${BASENAME}_tainted_final"
+    echo "  - $OUTPUT_DIR/${BASENAME}_native_final"
+    echo "  - $OUTPUT_DIR/${BASENAME}_bounds_final"
     echo "  - $OUTPUT_DIR/${BASENAME}_asan_final"
     echo "  - $OUTPUT_DIR/${BASENAME}_none_final"
 else
@@ -471,7 +1070,9 @@ else
 
     # Clean up raw IR if not keeping
     if [ "$KEEP_IR" = false ]; then
-        rm -f "$OUTPUT_DIR/${BASENAME}.ll"
+        rm -f "$OUTPUT_DIR/${BASENAME}.bc"
+    else
+        keep_as_text "$OUTPUT_DIR/${BASENAME}.bc"
     fi
 fi
 
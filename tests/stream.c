@@ -46,6 +46,10 @@
 # include <float.h>
 # include <limits.h>
 # include <sys/time.h>
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
+# include "cima_variant.h"
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -195,6 +199,7 @@ static double	bytes[4] = {
 
 extern double mysecond();
 extern void checkSTREAMresults();
+extern int stream_sweep(void);
 #ifdef TUNED
 extern void tuned_STREAM_Copy();
 extern void tuned_STREAM_Scale(STREAM_TYPE scalar);
@@ -205,7 +210,7 @@ extern void tuned_STREAM_Triad(STREAM_TYPE scalar);
 extern int omp_get_num_threads();
 #endif
 int
-main()
+main(int argc, char **argv)
     {
     int			quantum, checktick();
     int			BytesPerWord;
@@ -214,6 +219,10 @@ main()
     STREAM_TYPE		scalar;
     double		t, times[4][NTIMES];
 
+    /* --- SWEEP --- cache-hierarchy mode, see stream_sweep() --- */
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0)
+	return stream_sweep();
+
     /* --- SETUP --- determine precision and check timing --- */
 
     printf(HLINE);
@@ -582,4 +591,136 @@ void tuned_STREAM_Triad(STREAM_TYPE scalar)
 	    a[j] = b[j]+scalar*c[j];
 }
 /* end of stubs for the "tuned" versions of the kernels */
-#endif
\ No newline at end of file
+#endif
+
+/*-----------------------------------------------------------------------
+ * Cache-hierarchy sweep (not part of STREAM proper; run with --sweep)
+ *
+ * Runs the four kernels on heap arrays sized so that all three arrays fit
+ * in L1, L2 and the LLC in turn, and once more on DRAM-sized arrays (the
+ * static arrays above are fixed at STREAM_ARRAY_SIZE, so they are unused).
+ * Small sizes repeat each kernel until a timed trial covers at least
+ * SWEEP_MIN_ELEMENTS elements, so every trial spans many clock ticks.
+ * Results are printed as CSV lines prefixed with "sweep," (header first):
+ *
+ *   sweep,variant,level,elements,array_bytes,kernel,best_mbs,avg_s,min_s,max_s
+ *
+ * The variant is the CIMA_VARIANT the pipeline compiled the binary with
+ * (cima_variant.h), so runs of several variants can simply be concatenated.
+ *-----------------------------------------------------------------------*/
+
+#ifndef SWEEP_MIN_ELEMENTS
+#   define SWEEP_MIN_ELEMENTS	(4 * 1024 * 1024)
+#endif
+
+static double sweep_now()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1.0E-9;
+    }
+
+/* Cache capacity in bytes from sysconf, or fallback when unknown */
+static long sweep_cache_size(int name, long fallback)
+    {
+    long size = sysconf(name);
+    return size > 0 ? size : fallback;
+    }
+
+static void sweep_level(const char *variant, const char *level, ssize_t n)
+    {
+    static const char *kernel[4] = {"copy", "scale", "add", "triad"};
+    double	times[4][NTIMES], avg, min, max;
+    double	kbytes[4];
+    ssize_t	j, r, reps;
+    int		k, i;
+    STREAM_TYPE scalar = 3.0;
+    STREAM_TYPE *a, *b, *c;	/* shadow the static arrays */
+
+    reps = SWEEP_MIN_ELEMENTS / n;
+    if (reps < 1)
+	reps = 1;
+
+    a = malloc(n * sizeof(STREAM_TYPE));
+    b = malloc(n * sizeof(STREAM_TYPE));
+    c = malloc(n * sizeof(STREAM_TYPE));
+    if (!a || !b || !c) {
+	fprintf(stderr, "sweep: cannot allocate %s arrays\n", level);
+	free(a);
+	free(b);
+	free(c);
+	return;
+	}
+
+    for (j = 0; j < n; j++) {
+	a[j] = 1.0;
+	b[j] = 2.0;
+	c[j] = 0.0;
+	}
+
+    for (k = 0; k < NTIMES; k++) {
+	times[0][k] = sweep_now();
+	for (r = 0; r < reps; r++)
+	    for (j = 0; j < n; j++)
+		c[j] = a[j];
+	times[0][k] = sweep_now() - times[0][k];
+
+	times[1][k] = sweep_now();
+	for (r = 0; r < reps; r++)
+	    for (j = 0; j < n; j++)
+		b[j] = scalar*c[j];
+	times[1][k] = sweep_now() - times[1][k];
+
+	times[2][k] = sweep_now();
+	for (r = 0; r < reps; r++)
+	    for (j = 0; j < n; j++)
+		c[j] = a[j]+b[j];
+	times[2][k] = sweep_now() - times[2][k];
+
+	times[3][k] = sweep_now();
+	for (r = 0; r < reps; r++)
+	    for (j = 0; j < n; j++)
+		a[j] = b[j]+scalar*c[j];
+	times[3][k] = sweep_now() - times[3][k];
+	}
+
+    kbytes[0] = kbytes[1] = 2.0 * sizeof(STREAM_TYPE) * n * reps;
+    kbytes[2] = kbytes[3] = 3.0 * sizeof(STREAM_TYPE) * n * reps;
+
+    for (i = 0; i < 4; i++) {
+	avg = 0.0;
+	min = FLT_MAX;
+	max = 0.0;
+	for (k = 1; k < NTIMES; k++) { /* skip first iteration, as above */
+	    avg += times[i][k];
+	    min = MIN(min, times[i][k]);
+	    max = MAX(max, times[i][k]);
+	    }
+	avg /= (double)(NTIMES-1);
+	printf("sweep,%s,%s,%lld,%lld,%s,%.1f,%.9f,%.9f,%.9f\n", variant, level,
+	    (long long) n, (long long) (n * sizeof(STREAM_TYPE)), kernel[i],
+	    1.0E-06 * kbytes[i] / min, avg / reps, min / reps, max / reps);
+	}
+
+    free(a);
+    free(b);
+    free(c);
+    }
+
+int
+stream_sweep(void)
+    {
+    long	l1, l2, llc;
+
+    l1 = sweep_cache_size(_SC_LEVEL1_DCACHE_SIZE, 32L * 1024);
+    l2 = sweep_cache_size(_SC_LEVEL2_CACHE_SIZE, 1024L * 1024);
+    llc = sweep_cache_size(_SC_LEVEL3_CACHE_SIZE, l2 * 8);
+
+    /* Three arrays using half of each level; DRAM at 4x the LLC */
+    printf("sweep,variant,level,elements,array_bytes,kernel,best_mbs,avg_s,min_s,max_s\n");
+    sweep_level(CIMA_VARIANT, "L1", l1 / 2 / (3 * sizeof(STREAM_TYPE)));
+    sweep_level(CIMA_VARIANT, "L2", l2 / 2 / (3 * sizeof(STREAM_TYPE)));
+    sweep_level(CIMA_VARIANT, "LLC", llc / 2 / (3 * sizeof(STREAM_TYPE)));
+    sweep_level(CIMA_VARIANT, "DRAM", llc * 4 / (3 * sizeof(STREAM_TYPE)));
+    return 0;
+    }
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Compare STREAM cache-hierarchy sweeps across pass variants.
+
+Runs every stream*_final binary in a directory with --sweep (or reads saved
+sweep output), then prints, for each cache level and kernel, the best
+bandwidth of every variant and its overhead relative to the none variant.
+An overhead that stays flat from L1 to DRAM points at compute (shadow
+checks, taint propagation); one that grows with the working set points at
+memory traffic (shadow and taint-shadow accesses).
+"""
+import argparse
+import csv
+import json
+import os
+import subprocess
+import sys
+
+LEVELS = ["L1", "L2", "LLC", "DRAM"]
+KERNELS = ["copy", "scale", "add", "triad"]
+VARIANT_ORDER = ["none", "asan", "base", "nearest", "tainted", "native", "mixed", "bounds"]
+
+
+def parse_sweep(lines):
+    """Rows of the "sweep,..." CSV lines in a program's output."""
+    sweep = [line[len("sweep,"):] for line in lines if line.startswith("sweep,")]
+    if not sweep:
+        return []
+    return list(csv.DictReader(sweep))
+
+
+def collect(paths):
+    rows = []
+    for path in paths:
+        if os.path.isdir(path):
+            for name in sorted(os.listdir(path)):
+                binary = os.path.join(path, name)
+                if name.startswith("stream") and name.endswith("_final") and os.access(binary, os.X_OK):
+                    print(f"Running {binary} --sweep ...", file=sys.stderr)
+                    result = subprocess.run([binary, "--sweep"], stdout=subprocess.PIPE, text=True,
+                                            env=dict(os.environ, ASAN_OPTIONS="detect_leaks=0"))
+                    rows += parse_sweep(result.stdout.splitlines())
+        else:
+            with open(path) as f:
+                rows += parse_sweep(f.read().splitlines())
+    return rows
+
+
+def variant_key(variant):
+    return (VARIANT_ORDER.index(variant) if variant in VARIANT_ORDER else len(VARIANT_ORDER), variant)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare STREAM --sweep results across pass variants.")
+    parser.add_argument("inputs", nargs="+",
+                        help="Directories with stream*_final binaries, or files with saved sweep output")
+    parser.add_argument("--json", help="Write the combined results to this file")
+    args = parser.parse_args()
+
+    rows = collect(args.inputs)
+    if not rows:
+        print("No sweep results found")
+        sys.exit(1)
+
+    # best[(level, kernel)][variant] = row
+    best = {}
+    for row in rows:
+        best.setdefault((row["level"], row["kernel"]), {})[row["variant"]] = row
+    variants = sorted({row["variant"] for row in rows}, key=variant_key)
+
+    header = f"{'Level':<5} {'Kernel':<6} {'Elements':>10}"
+    for v in variants:
+        header += f" | {v + ' MB/s':>14} {'ovh %':>7}"
+    print(header)
+    print("-" * len(header))
+
+    results = []
+    for level in LEVELS:
+        for kernel in KERNELS:
+            per_variant = best.get((level, kernel))
+            if not per_variant:
+                continue
+            baseline = per_variant.get("none")
+            elements = next(iter(per_variant.values()))["elements"]
+            line = f"{level:<5} {kernel:<6} {elements:>10}"
+            for v in variants:
+                row = per_variant.get(v)
+                if not row:
+                    line += f" | {'-':>14} {'-':>7}"
+                    continue
+                overhead = None
+                if baseline and float(baseline["min_s"]) > 0:
+                    overhead = (float(row["min_s"]) / float(baseline["min_s"]) - 1) * 100
+                line += f" | {float(row['best_mbs']):>14.1f} "
+                line += f"{overhead:>7.1f}" if overhead is not None else f"{'-':>7}"
+                results.append({
+                    "level": level, "kernel": kernel, "variant": v,
+                    "elements": int(row["elements"]), "array_bytes": int(row["array_bytes"]),
+                    "best_mbs": float(row["best_mbs"]), "min_s": float(row["min_s"]),
+                    "avg_s": float(row["avg_s"]), "max_s": float(row["max_s"]),
+                    "overhead_pct": overhead,
+                })
+            print(line)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"results": results}, f, indent=2)
+        print(f"JSON written to {args.json}")
+
+
+if __name__ == "__main__":
+    main()